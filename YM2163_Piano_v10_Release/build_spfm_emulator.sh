@@ -0,0 +1,21 @@
+#!/bin/bash
+# Build script for the SPFM emulator (Linux / POSIX host, no hardware needed)
+
+echo "Building SPFM emulator..."
+
+CC=g++
+CFLAGS="-Wall -Wextra -O2 -std=c++11"
+TARGET=spfm_emulator
+
+$CC $CFLAGS spfm_emulator.cpp -o $TARGET || exit 1
+
+echo ""
+echo "============================================"
+echo "Build successful!"
+echo "============================================"
+echo "Executable: $TARGET"
+echo ""
+echo "Record on the piano (Windows) with --transport=capture:out.spfm, then"
+echo "Run:  ./$TARGET --replay out.spfm"
+echo "(--link /tmp/spfm --baud 1500000 serves a local POSIX serial sender instead)"
+echo ""
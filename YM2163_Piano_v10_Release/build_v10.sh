@@ -6,7 +6,7 @@ echo "Building YM2163 Piano GUI v10 (Quad YM2163 Edition)..."
 # Compiler settings
 CC=g++
 CFLAGS="-Wall -Wextra -O2 -I. -Iftdi_driver -Iimgui -Imidifile/include -std=c++11"
-LDFLAGS="ftdi_driver/amd64/libftd2xx.a -ld3d11 -ldxgi -ld3dcompiler -ldwmapi -lws2_32 -lgdi32 -static -lcomdlg32 -mwindows"
+LDFLAGS="-ld3d11 -ldxgi -ld3dcompiler -ldwmapi -lwinmm -lws2_32 -lgdi32 -static -lcomdlg32 -mwindows"
 
 # Output
 TARGET=ym2163_piano_gui_v10.exe
@@ -27,28 +27,36 @@ echo "Step 2: Compiling MidiFile library..."
 echo "============================================"
 
 $CC $CFLAGS -c midifile/src/Binasc.cpp -o midifile/Binasc.o || exit 1
+$CC $CFLAGS -c midifile/src/MidiArena.cpp -o midifile/MidiArena.o || exit 1
 $CC $CFLAGS -c midifile/src/MidiEvent.cpp -o midifile/MidiEvent.o || exit 1
 $CC $CFLAGS -c midifile/src/MidiEventList.cpp -o midifile/MidiEventList.o || exit 1
 $CC $CFLAGS -c midifile/src/MidiFile.cpp -o midifile/MidiFile.o || exit 1
 $CC $CFLAGS -c midifile/src/MidiMessage.cpp -o midifile/MidiMessage.o || exit 1
+$CC $CFLAGS -c midifile/src/MidiStreamReader.cpp -o midifile/MidiStreamReader.o || exit 1
+$CC $CFLAGS -c midifile/src/MidiTempoMap.cpp -o midifile/MidiTempoMap.o || exit 1
+$CC $CFLAGS -c midifile/src/SmfFileView.cpp -o midifile/SmfFileView.o || exit 1
 $CC $CFLAGS -c midifile/src/Options.cpp -o midifile/Options.o || exit 1
 
 echo "============================================"
 echo "Step 3: Compiling main application..."
 echo "============================================"
 
+$CC $CFLAGS -c spfm_transport.cpp -o spfm_transport.o || exit 1
+$CC $CFLAGS -c vgm_logger.cpp -o vgm_logger.o || exit 1
 $CC $CFLAGS -c ym2163_piano_gui_v10.cpp -o ym2163_piano_gui_v10.o || exit 1
 
 echo "============================================"
 echo "Step 4: Linking..."
 echo "============================================"
 
-$CC -o $TARGET ym2163_piano_gui_v10.o \
+$CC -o $TARGET ym2163_piano_gui_v10.o spfm_transport.o vgm_logger.o \
     imgui/imgui.o imgui/imgui_draw.o imgui/imgui_tables.o \
     imgui/imgui_widgets.o imgui/imgui_impl_win32.o \
     imgui/imgui_impl_dx11.o \
-    midifile/Binasc.o midifile/MidiEvent.o midifile/MidiEventList.o \
-    midifile/MidiFile.o midifile/MidiMessage.o midifile/Options.o \
+    midifile/Binasc.o midifile/MidiArena.o midifile/MidiEvent.o midifile/MidiEventList.o \
+    midifile/MidiFile.o midifile/MidiMessage.o midifile/MidiStreamReader.o \
+    midifile/MidiTempoMap.o midifile/SmfFileView.o \
+    midifile/Options.o \
     $LDFLAGS || exit 1
 
 echo ""
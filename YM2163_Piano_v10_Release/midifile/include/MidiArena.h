@@ -0,0 +1,70 @@
+//
+// Creation Date: Fri Oct 16 2026
+// Filename:      midifile/include/MidiArena.h
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// Description:   Block allocator for the MidiEvents of a MidiFile and the
+//                bytes of their longer (meta/sysex) messages.  Reading a
+//                file makes a few large allocations instead of one or two
+//                per event, and the whole song is released by freeing the
+//                blocks.
+//
+
+#ifndef _MIDIARENA_H_INCLUDED
+#define _MIDIARENA_H_INCLUDED
+
+#include "MidiEvent.h"
+
+#include <utility>
+#include <vector>
+
+
+namespace smf {
+
+class MidiArena {
+	public:
+		                 MidiArena         (void);
+		                 MidiArena         (MidiArena&& other);
+		                ~MidiArena         ();
+
+		MidiArena&       operator=         (MidiArena&& other);
+
+		// Default-constructed event owned by the arena (isArenaEvent() is true):
+		MidiEvent*       newEvent          (void);
+		// Uninitialized bytes owned by the arena:
+		uchar*           newBytes          (size_t size);
+
+		// Destroy all events and free all blocks.  Event lists must not
+		// refer to the events any more.
+		void             clear             (void);
+		// Take over the blocks of another arena (which is left empty);
+		// events and bytes stay where they are:
+		void             merge             (MidiArena& other);
+
+		int              getEventCount     (void) const;
+		size_t           getAllocatedBytes (void) const;
+
+	private:
+		                 MidiArena         (const MidiArena&);
+		MidiArena&       operator=         (const MidiArena&);
+
+		// m_eventBlocks == raw storage for blocks of events, with the
+		// number of events constructed in each.  New events go into the
+		// last block.
+		std::vector<std::pair<MidiEvent*, int>> m_eventBlocks;
+
+		// m_byteBlocks == storage for message bytes; m_byteFree bytes are
+		// left at the end of the last block.
+		std::vector<uchar*> m_byteBlocks;
+		size_t m_byteFree = 0;
+
+		size_t m_allocated = 0;
+};
+
+} // end of namespace smf
+
+#endif /* _MIDIARENA_H_INCLUDED */
+
+
+
@@ -0,0 +1,197 @@
+//
+// Creation Date: Fri Oct 16 2026
+// Filename:      midifile/include/MidiBytes.h
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// Description:   Byte storage for MidiMessage.  It has the interface of
+//                the std::vector<uchar> that MidiMessage used to derive
+//                from, but messages of up to MIDI_BYTES_INLINE bytes
+//                (all channel messages, tempo, time/key signatures,
+//                end-of-track) are stored inside the object without a heap
+//                allocation.  Longer messages use the heap, or memory
+//                handed in with setExternal() (see MidiArena) which the
+//                object does not own.
+//
+
+#ifndef _MIDIBYTES_H_INCLUDED
+#define _MIDIBYTES_H_INCLUDED
+
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+
+namespace smf {
+
+typedef unsigned char  uchar;
+
+#define MIDI_BYTES_INLINE 7
+
+class MidiBytes {
+	public:
+		typedef uchar                                 value_type;
+		typedef size_t                                size_type;
+		typedef uchar&                                reference;
+		typedef const uchar&                          const_reference;
+		typedef uchar*                                iterator;
+		typedef const uchar*                          const_iterator;
+		typedef std::reverse_iterator<iterator>       reverse_iterator;
+		typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+		                 MidiBytes     (void) { init(); }
+		                 MidiBytes     (size_t count, uchar value = 0) {
+		                    init(); resize(count, value); }
+		                 MidiBytes     (const MidiBytes& other) {
+		                    init(); assign(other.begin(), other.end()); }
+		                ~MidiBytes     () { release(); }
+
+		MidiBytes&       operator=     (const MidiBytes& other) {
+		                    if (this != &other) { assign(other.begin(), other.end()); }
+		                    return *this; }
+
+		// Copy for interfaces that need a real vector (explicit, so that no
+		// copy is made by accident):
+		                 explicit operator std::vector<uchar> (void) const {
+		                    return std::vector<uchar>(begin(), end()); }
+
+		size_t           size          (void) const { return m_size; }
+		bool             empty         (void) const { return m_size == 0; }
+		size_t           capacity      (void) const { return m_capacity; }
+		uchar*           data          (void)       { return m_data; }
+		const uchar*     data          (void) const { return m_data; }
+
+		iterator         begin         (void)       { return m_data; }
+		const_iterator   begin         (void) const { return m_data; }
+		iterator         end           (void)       { return m_data + m_size; }
+		const_iterator   end           (void) const { return m_data + m_size; }
+		const_iterator   cbegin        (void) const { return m_data; }
+		const_iterator   cend          (void) const { return m_data + m_size; }
+		reverse_iterator rbegin        (void)       { return reverse_iterator(end()); }
+		const_reverse_iterator rbegin  (void) const { return const_reverse_iterator(end()); }
+		reverse_iterator rend          (void)       { return reverse_iterator(begin()); }
+		const_reverse_iterator rend    (void) const { return const_reverse_iterator(begin()); }
+
+		uchar&           operator[]    (size_t index)       { return m_data[index]; }
+		const uchar&     operator[]    (size_t index) const { return m_data[index]; }
+		uchar&           at            (size_t index) {
+		                    check(index); return m_data[index]; }
+		const uchar&     at            (size_t index) const {
+		                    check(index); return m_data[index]; }
+		uchar&           front         (void)       { return m_data[0]; }
+		const uchar&     front         (void) const { return m_data[0]; }
+		uchar&           back          (void)       { return m_data[m_size - 1]; }
+		const uchar&     back          (void) const { return m_data[m_size - 1]; }
+
+		void             clear         (void) { m_size = 0; }
+		void             reserve       (size_t count) {
+		                    if (count > m_capacity) { grow(count); } }
+		void             resize        (size_t count, uchar value = 0) {
+		                    reserve(count);
+		                    if (count > m_size) { memset(m_data + m_size, value, count - m_size); }
+		                    m_size = (unsigned int)count; }
+		void             push_back     (uchar value) {
+		                    if (m_size == m_capacity) { grow(m_size * 2); }
+		                    m_data[m_size++] = value; }
+		void             pop_back      (void) { m_size--; }
+
+		void             assign        (const uchar* first, const uchar* last) {
+		                    size_t count = last - first;
+		                    if (count > m_capacity) {
+		                       // first may point into the current storage
+		                       MidiBytes copy; copy.grow(count);
+		                       memcpy(copy.m_data, first, count); copy.m_size = (unsigned int)count;
+		                       swap(copy); return; }
+		                    memmove(m_data, first, count); m_size = (unsigned int)count; }
+		void             assign        (size_t count, uchar value) {
+		                    m_size = 0; resize(count, value); }
+
+		iterator         insert        (const_iterator pos, uchar value) {
+		                    return insert(pos, 1, value); }
+		iterator         insert        (const_iterator pos, size_t count, uchar value) {
+		                    size_t index = open(pos, count);
+		                    memset(m_data + index, value, count);
+		                    return m_data + index; }
+		iterator         insert        (const_iterator pos, const uchar* first,
+		                                const uchar* last) {
+		                    MidiBytes copy; copy.assign(first, last);
+		                    size_t index = open(pos, copy.m_size);
+		                    memcpy(m_data + index, copy.m_data, copy.m_size);
+		                    return m_data + index; }
+		iterator         erase         (const_iterator pos) {
+		                    return erase(pos, pos + 1); }
+		iterator         erase         (const_iterator first, const_iterator last) {
+		                    size_t index = first - m_data;
+		                    size_t count = last - first;
+		                    memmove(m_data + index, m_data + index + count,
+		                          m_size - index - count);
+		                    m_size -= (unsigned int)count;
+		                    return m_data + index; }
+
+		void             swap          (MidiBytes& other) {
+		                    MidiBytes temp; temp.take(*this); take(other); other.take(temp); }
+
+		bool             operator==    (const MidiBytes& other) const {
+		                    return m_size == other.m_size &&
+		                          memcmp(m_data, other.m_data, m_size) == 0; }
+		bool             operator!=    (const MidiBytes& other) const {
+		                    return !(*this == other); }
+
+		// Use size bytes at data (not owned, must outlive the object or the
+		// next reallocation) as the contents.  Growing past size copies the
+		// bytes to the heap.
+		void             setExternal   (uchar* data, size_t size) {
+		                    release(); m_data = data;
+		                    m_size = m_capacity = (unsigned int)size; m_externalQ = true; }
+		bool             isInline      (void) const { return m_data == m_inline; }
+		bool             isExternal    (void) const { return m_externalQ; }
+
+	private:
+		void             init          (void) {
+		                    m_data = m_inline; m_size = 0;
+		                    m_capacity = MIDI_BYTES_INLINE; m_externalQ = false; }
+		void             release       (void) {
+		                    if (m_data != m_inline && !m_externalQ) { delete [] m_data; }
+		                    init(); }
+		void             check         (size_t index) const {
+		                    if (index >= m_size) { throw std::out_of_range("MidiBytes::at"); } }
+		void             grow          (size_t count) {
+		                    if (count < 16) { count = 16; }
+		                    uchar* newdata = new uchar[count];
+		                    memcpy(newdata, m_data, m_size);
+		                    unsigned int oldsize = m_size;
+		                    release();
+		                    m_data = newdata; m_size = oldsize;
+		                    m_capacity = (unsigned int)count; }
+		size_t           open          (const_iterator pos, size_t count) {
+		                    size_t index = pos - m_data;
+		                    reserve(m_size + count < m_size * 2 ? m_size * 2 : m_size + count);
+		                    memmove(m_data + index + count, m_data + index, m_size - index);
+		                    m_size += (unsigned int)count;
+		                    return index; }
+		void             take          (MidiBytes& other) {
+		                    release();
+		                    if (other.isInline()) {
+		                       memcpy(m_inline, other.m_inline, other.m_size);
+		                    } else {
+		                       m_data = other.m_data; m_capacity = other.m_capacity;
+		                       m_externalQ = other.m_externalQ;
+		                    }
+		                    m_size = other.m_size;
+		                    other.init(); }
+
+		// m_data == m_inline, a heap block or external (arena) memory.
+		uchar*        m_data;
+		unsigned int  m_size;
+		unsigned int  m_capacity;
+		uchar         m_inline[MIDI_BYTES_INLINE];
+		bool          m_externalQ;
+};
+
+} // end of namespace smf
+
+#endif /* _MIDIBYTES_H_INCLUDED */
+
+
+
@@ -63,8 +63,15 @@ class MidiEvent : public MidiMessage {
 		double     seconds;  // calculated time in sec. (after doTimeAnalysis())
 		int        seq;      // sorting sequence number of event
 
+		// True for events allocated by a MidiArena, which are freed with
+		// the arena and must not be deleted:
+		bool       isArenaEvent          (void) const { return m_arenaQ; }
+
 	private:
 		MidiEvent* m_eventlink;  // used to match note-ons and note-offs
+		bool       m_arenaQ = false;
+
+	friend class MidiArena;
 
 };
 
@@ -14,7 +14,9 @@
 #ifndef _MIDIFILE_H_INCLUDED
 #define _MIDIFILE_H_INCLUDED
 
+#include "MidiArena.h"
 #include "MidiEventList.h"
+#include "MidiTempoMap.h"
 
 #include <fstream>
 #include <istream>
@@ -34,10 +36,24 @@ enum {
     TIME_STATE_ABSOLUTE = 1  // MidiMessage::ticks are in absolute time format (0=start time).
 };
 
-class _TickTime {
+// Counts collected for each track while a file is read (see
+// MidiFile::getTrackStats()).
+class MidiTrackStats {
 	public:
-		int    tick;
-		double seconds;
+		               MidiTrackStats              (void);
+
+		void           clear                       (void);
+		void           addEvent                    (const MidiMessage& message);
+		void           add                         (const MidiTrackStats& other);
+
+		int            events;             // all events, including end-of-track
+		int            noteOns;            // note-ons with non-zero velocity
+		int            noteOffs;           // note-offs and zero-velocity note-ons
+		int            metas;              // meta messages
+		int            sysex;              // 0xf0 and 0xf7 messages
+		int            channelNoteOns[16]; // note-ons per channel
+		int            velocity[128];      // note-on velocity histogram
+		unsigned short channelMask;        // bit n: channel messages on channel n
 };
 
 
@@ -59,12 +75,14 @@ class MidiFile {
 		// Auto-detected SMF or ASCII-encoded SMF (decoded with Binasc class):
 		bool           read                        (const std::string& filename);
 		bool           read                        (std::istream& instream);
+		bool           read                        (const uchar* data, size_t size);
 		bool           readBase64                  (const std::string& base64data);
 		bool           readBase64                  (std::istream& instream);
 
 		// Only allow Standard MIDI File input:
 		bool           readSmf                     (const std::string& filename);
 		bool           readSmf                     (std::istream& instream);
+		bool           readSmf                     (const uchar* data, size_t size);
 
 #ifdef _WIN32
 		// Windows-specific wide string support for Unicode paths
@@ -146,6 +164,7 @@ class MidiFile {
 		double           getTimeInSeconds          (int aTrack, int anIndex);
 		double           getTimeInSeconds          (int tickvalue);
 		double           getAbsoluteTickTime       (double starttime);
+		const MidiTempoMap& getTempoMap            (void);
 		int              getFileDurationInTicks    (void);
 		double           getFileDurationInQuarters (void);
 		double           getFileDurationInSeconds  (void);
@@ -175,6 +194,25 @@ class MidiFile {
 		void             clear                     (void);
 		void             clear_no_deallocate       (void);
 
+		// Arena mode: events made by reading and by the add functions are
+		// allocated in blocks and all freed at once by clear() or the next
+		// read.  Events must then not be deleted or kept past clear().
+		void             setArenaMode              (bool state = true);
+		bool             getArenaMode              (void) const;
+		size_t           getArenaBytes             (void) const;
+
+		// Number of threads that decode the tracks of a Standard MIDI File:
+		// 1 (default) reads them one after another, 0 uses one thread per
+		// core.  The result does not depend on the setting.
+		void             setReadThreads            (int count);
+		int              getReadThreads            (void) const;
+
+		// Counts for each track of the last file read (not updated by
+		// later edits), and their sum:
+		int                   getTrackStatsCount   (void) const;
+		const MidiTrackStats& getTrackStats        (int track) const;
+		MidiTrackStats        getTotalStats        (void) const;
+
 		// MIDI message adding convenience functions:
 		MidiEvent*        addNoteOn               (int aTrack, int aTick,
 		                                           int aChannel, int key,
@@ -303,8 +341,8 @@ class MidiFile {
 		// m_timemapvalid ==
 		bool m_timemapvalid = false;
 
-		// m_timemap ==
-		std::vector<_TickTime> m_timemap;
+		// m_tempomap == tempo segments used for tick<->seconds conversion.
+		MidiTempoMap m_tempomap;
 
 		// m_rwstatus == True if last read was successful, false if a problem.
 		bool m_rwstatus = true;
@@ -312,28 +350,57 @@ class MidiFile {
 		// m_linkedEventQ == True if link analysis has been done.
 		bool m_linkedEventsQ = false;
 
+		// m_arenaQ == True if new events are allocated from m_arena.
+		bool m_arenaQ = false;
+
+		// m_arena == block storage for events and message bytes in arena mode.
+		MidiArena m_arena;
+
+		// m_readThreads == maximum number of track decoding threads (0 = one
+		// per core).
+		int m_readThreads = 1;
+
+		// m_trackStats == counts for each track of the last file read.
+		std::vector<MidiTrackStats> m_trackStats;
+
 	private:
-		int         extractMidiData                 (std::istream& inputfile,
-		                                             std::vector<uchar>& array,
-		                                             uchar& runningCommand);
-		ulong       readVLValue                     (std::istream& inputfile);
+		bool        readTrack                       (const uchar*& p,
+		                                             const uchar* end,
+		                                             int track,
+		                                             MidiArena* arena,
+		                                             MidiTrackStats& stats,
+		                                             std::ostream& err);
+		int         readTracksParallel              (const uchar*& p,
+		                                             const uchar* end,
+		                                             int tracks);
+		static int  extractMidiData                 (const uchar*& p,
+		                                             const uchar* end,
+		                                             MidiEvent& event,
+		                                             uchar& runningCommand,
+		                                             MidiArena* arena,
+		                                             std::ostream& err);
+		static ulong readVLValue                    (const uchar*& p,
+		                                             const uchar* end,
+		                                             bool& status,
+		                                             std::ostream& err);
+		MidiEvent*  newEvent                        (void);
 		ulong       unpackVLV                       (uchar a = 0, uchar b = 0,
 		                                             uchar c = 0, uchar d = 0,
 		                                             uchar e = 0);
 		void        writeVLValue                    (long aValue,
 		                                             std::vector<uchar>& data);
 		int         makeVLV                         (uchar *buffer, int number);
-		static int  ticksearch                      (const void* A, const void* B);
-		static int  secondsearch                    (const void* A, const void* B);
 		void        buildTimeMap                    (void);
-		double      linearTickInterpolationAtSecond (double seconds);
-		double      linearSecondInterpolationAtTick (int ticktime);
+		bool        mergeSortedTracks               (MidiEventList& output);
 		std::string base64Encode                    (const std::string &input);
 		std::string base64Decode                    (const std::string &input);
 
 		static const std::string encodeLookup;
 		static const std::vector<int> decodeLookup;
 		static const char *GMinstrument[128];
+
+	// Decodes tracks incrementally with the same parsing functions:
+	friend class MidiStreamReader;
 };
 
 } // end of namespace smf
@@ -14,6 +14,8 @@
 #ifndef _MIDIMESSAGE_H_INCLUDED
 #define _MIDIMESSAGE_H_INCLUDED
 
+#include "MidiBytes.h"
+
 #include <iostream>
 #include <string>
 #include <utility>
@@ -26,7 +28,7 @@ typedef unsigned char  uchar;
 typedef unsigned short ushort;
 typedef unsigned long  ulong;
 
-class MidiMessage : public std::vector<uchar> {
+class MidiMessage : public MidiBytes {
 
 	public:
 		               MidiMessage          (void);
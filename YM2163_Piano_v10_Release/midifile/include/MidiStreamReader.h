@@ -0,0 +1,126 @@
+//
+// Creation Date: Fri Oct 16 2026
+// Filename:      midifile/include/MidiStreamReader.h
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// Description:   Incremental reader for Standard MIDI Files.  Each track
+//                is decoded only as far as it is needed, and the tracks
+//                are merged into a single stream of events in the order
+//                that reading the file with MidiFile and calling
+//                joinTracks() and doTimeAnalysis() gives, with the same
+//                absolute ticks and times.  The start of a song is
+//                available after decoding only the start of each track.
+//
+
+#ifndef _MIDISTREAMREADER_H_INCLUDED
+#define _MIDISTREAMREADER_H_INCLUDED
+
+#include "MidiFile.h"
+#include "SmfFileView.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+
+namespace smf {
+
+class _StreamTrack {
+	public:
+		const uchar* p;               // next byte to decode
+		const uchar* end;             // end of the track chunk
+		uchar        runningCommand;
+		int          tick;            // absolute tick of event
+		MidiEvent    event;           // next event of the track, decoded ahead
+};
+
+
+class MidiStreamReader {
+	public:
+		                 MidiStreamReader       (void);
+		                ~MidiStreamReader       ();
+
+		// Read the header and find the tracks.  The track chunk sizes must
+		// be correct (the tracks are not decoded one after another as in
+		// MidiFile::readSmf()), and ASCII-encoded files are not accepted.
+		bool             open                   (const std::string& filename);
+#ifdef _WIN32
+		bool             open                   (const std::wstring& filename);
+#endif
+		// The data is not copied and must stay valid while reading:
+		bool             open                   (const uchar* data, size_t size);
+		void             close                  (void);
+
+		// Next event of the merged tracks with its absolute tick, track and
+		// time in seconds.  Returns false at the end of all tracks, or after
+		// an error in the track data (getStatus() is then false).
+		bool             readEvent              (MidiEvent& event);
+
+		bool             isOpen                 (void) const;
+		bool             getStatus              (void) const;
+		int              getTrackCount          (void) const;
+		int              getTicksPerQuarterNote (void) const;
+
+		// Time of the last event read, in seconds:
+		double           getSeconds             (void) const;
+
+		// Tick of the next event, or -1 at the end (after the last event, or
+		// after an error):
+		int              getNextTick            (void) const;
+
+		// Time in seconds of the last note, controller, program change or
+		// tempo change of the file, from a pass over the track data that
+		// reads only delta times and tempo changes.  The read position is
+		// not changed.  Track data after an error is not counted.  Returns
+		// -1 if *cancel is set while scanning.
+		double           scanEndSeconds         (const std::atomic<bool>* cancel = NULL) const;
+
+		// Track data decoded so far and in total, for progress display:
+		size_t           getBytesRead           (void) const;
+		size_t           getTrackBytes          (void) const;
+
+		// Counts for the events read so far (see MidiFile::getTrackStats()):
+		const MidiTrackStats& getTrackStats     (int track) const;
+		MidiTrackStats   getTotalStats          (void) const;
+
+	private:
+		                 MidiStreamReader       (const MidiStreamReader&);
+		MidiStreamReader& operator=             (const MidiStreamReader&);
+
+		bool             readHeader             (const uchar* data, size_t size);
+		bool             decodeNext             (int track);
+		void             push                   (int track);
+
+		// m_view == the file when opened by name.
+		SmfFileView m_view;
+
+		// m_tracks == decoding state of each track; m_start == first byte
+		// of each track's data.
+		std::vector<_StreamTrack> m_tracks;
+		std::vector<const uchar*> m_start;
+
+		// m_heap == min-heap of (tick, track) keys of the tracks that have
+		// a decoded event waiting.
+		std::vector<unsigned long long> m_heap;
+
+		std::vector<MidiTrackStats> m_stats;
+
+		int  m_ticksPerQuarterNote = 120;
+		bool m_openQ  = false;
+		bool m_status = true;
+
+		// Tempo segment in effect (as in MidiTempoMap), and the time of the
+		// last event read.
+		int    m_segmentTick    = 0;
+		double m_segmentSeconds = 0.0;
+		double m_secondsPerTick = 0.5 / 120;
+		double m_seconds        = 0.0;
+};
+
+} // end of namespace smf
+
+#endif /* _MIDISTREAMREADER_H_INCLUDED */
+
+
+
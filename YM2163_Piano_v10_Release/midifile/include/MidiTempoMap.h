@@ -0,0 +1,70 @@
+//
+// Creation Date: Fri Oct 16 2026
+// Filename:      midifile/include/MidiTempoMap.h
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// Description:   Tempo segment index for a MidiFile.  Each segment
+//                starts at a tempo change and stores the cumulative
+//                time at its first tick, so tick<->time conversions
+//                are a binary search over the segments plus one
+//                multiply, for any number of tempo changes.
+//
+
+#ifndef _MIDITEMPOMAP_H_INCLUDED
+#define _MIDITEMPOMAP_H_INCLUDED
+
+#include <vector>
+
+
+namespace smf {
+
+class MidiFile;
+
+class _TempoSegment {
+	public:
+		int    tick;            // absolute tick where this tempo starts
+		double seconds;         // time at tick
+		double secondsPerTick;  // tempo in effect from tick onwards
+};
+
+
+class MidiTempoMap {
+	public:
+		                 MidiTempoMap          (void);
+
+		// Scan all tracks of midifile for tempo meta messages; works with
+		// split or joined tracks and with delta or absolute ticks.
+		void             build                 (const MidiFile& midifile);
+		void             clear                 (void);
+		bool             isValid               (void) const;
+
+		double           getSecondsAtTick      (double tick) const;
+		double           getTickAtSeconds      (double seconds) const;
+		double           getMicrosecondsAtTick (double tick) const;
+		double           getTickAtMicroseconds (double micros) const;
+
+		// Tempo in effect at tick, in microseconds per quarter note:
+		double           getTempoMicrosecondsAtTick (double tick) const;
+
+		int              getSegmentCount       (void) const;
+		const _TempoSegment& getSegment        (int index) const;
+
+	private:
+		int              findSegmentAtTick     (double tick) const;
+		int              findSegmentAtSeconds  (double seconds) const;
+
+		// m_segments == tempo segments sorted by tick; the first one
+		// always starts at tick 0 (120 bpm unless the file says otherwise).
+		std::vector<_TempoSegment> m_segments;
+
+		// m_tpq == ticks per quarter note of the file the map was built from.
+		int m_tpq = 120;
+};
+
+} // end of namespace smf
+
+#endif /* _MIDITEMPOMAP_H_INCLUDED */
+
+
+
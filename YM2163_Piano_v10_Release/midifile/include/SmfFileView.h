@@ -0,0 +1,57 @@
+//
+// Creation Date: Fri Oct 16 2026
+// Filename:      midifile/include/SmfFileView.h
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// Description:   Read-only view of a whole file for the byte span readers
+//                (MidiFile::readSmf() and MidiStreamReader).  On Windows
+//                the file is memory-mapped, so opening it does not depend
+//                on its size; elsewhere it is read into memory with a
+//                single block read.
+//
+
+#ifndef _SMFFILEVIEW_H_INCLUDED
+#define _SMFFILEVIEW_H_INCLUDED
+
+#include <string>
+#include <vector>
+
+
+namespace smf {
+
+typedef unsigned char uchar;
+
+class SmfFileView {
+	public:
+		              SmfFileView   (void) { }
+		             ~SmfFileView   () { close(); }
+
+		bool          open          (const std::string& filename);
+#ifdef _WIN32
+		bool          open          (const std::wstring& filename);
+#endif
+		void          close         (void);
+		const uchar*  data          (void) const { return m_data; }
+		size_t        size          (void) const { return m_size; }
+
+	private:
+		              SmfFileView   (const SmfFileView&);
+		SmfFileView&  operator=     (const SmfFileView&);
+
+#ifdef _WIN32
+		bool          map           (void* file);
+		void*         m_mapping = NULL;   // mapping HANDLE
+#else
+		std::vector<uchar> m_buffer;
+#endif
+		const uchar*  m_data = NULL;
+		size_t        m_size = 0;
+};
+
+} // end of namespace smf
+
+#endif /* _SMFFILEVIEW_H_INCLUDED */
+
+
+
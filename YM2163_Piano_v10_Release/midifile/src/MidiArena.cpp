@@ -0,0 +1,207 @@
+//
+// Creation Date: Fri Oct 16 2026
+// Filename:      midifile/src/MidiArena.cpp
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// Description:   Block allocator for MidiEvents (see MidiArena.h).
+//
+
+#include "MidiArena.h"
+
+#include <new>
+#include <utility>
+#include <vector>
+
+
+namespace smf {
+
+// Events per event block, and bytes per byte block (larger messages get a
+// block of their own).
+#define ARENA_EVENT_BLOCK 4096
+#define ARENA_BYTE_BLOCK  65536
+
+
+//////////////////////////////
+//
+// MidiArena::MidiArena -- Constructor.
+//
+
+MidiArena::MidiArena(void) {
+	// do nothing
+}
+
+
+MidiArena::MidiArena(MidiArena&& other) {
+	*this = std::move(other);
+}
+
+
+
+//////////////////////////////
+//
+// MidiArena::~MidiArena -- Deconstructor.
+//
+
+MidiArena::~MidiArena() {
+	clear();
+}
+
+
+
+//////////////////////////////
+//
+// MidiArena::operator= -- Take over the blocks of another arena; events
+//    stay where they are.
+//
+
+MidiArena& MidiArena::operator=(MidiArena&& other) {
+	if (this == &other) {
+		return *this;
+	}
+	clear();
+	m_eventBlocks.swap(other.m_eventBlocks);
+	m_byteBlocks.swap(other.m_byteBlocks);
+	m_byteFree      = other.m_byteFree;
+	m_allocated     = other.m_allocated;
+	other.m_byteFree      = 0;
+	other.m_allocated     = 0;
+	return *this;
+}
+
+
+
+//////////////////////////////
+//
+// MidiArena::newEvent -- Construct an event in the current event block.
+//
+
+MidiEvent* MidiArena::newEvent(void) {
+	if (m_eventBlocks.empty() || m_eventBlocks.back().second == ARENA_EVENT_BLOCK) {
+		m_eventBlocks.emplace_back(static_cast<MidiEvent*>(
+				::operator new(sizeof(MidiEvent) * ARENA_EVENT_BLOCK)), 0);
+		m_allocated += sizeof(MidiEvent) * ARENA_EVENT_BLOCK;
+	}
+	std::pair<MidiEvent*, int>& block = m_eventBlocks.back();
+	MidiEvent* event = new (block.first + block.second) MidiEvent;
+	block.second++;
+	event->m_arenaQ = true;
+	return event;
+}
+
+
+
+//////////////////////////////
+//
+// MidiArena::newBytes -- Take size bytes from the current byte block.
+//
+
+uchar* MidiArena::newBytes(size_t size) {
+	if (size > ARENA_BYTE_BLOCK / 4) {
+		// Keep the current block for the small messages that follow.
+		uchar* block = new uchar[size];
+		if (m_byteBlocks.empty()) {
+			m_byteBlocks.push_back(block);
+		} else {
+			m_byteBlocks.insert(m_byteBlocks.end() - 1, block);
+		}
+		m_allocated += size;
+		return block;
+	}
+	if (size > m_byteFree) {
+		m_byteBlocks.push_back(new uchar[ARENA_BYTE_BLOCK]);
+		m_byteFree = ARENA_BYTE_BLOCK;
+		m_allocated += ARENA_BYTE_BLOCK;
+	}
+	uchar* bytes = m_byteBlocks.back() + ARENA_BYTE_BLOCK - m_byteFree;
+	m_byteFree -= size;
+	return bytes;
+}
+
+
+
+//////////////////////////////
+//
+// MidiArena::clear -- Destroy the events (which only frees messages that
+//    were grown onto the heap after they were created) and free the blocks.
+//
+
+void MidiArena::clear(void) {
+	for (auto& block : m_eventBlocks) {
+		MidiEvent* events = block.first;
+		for (int j=0; j<block.second; j++) {
+			if (!events[j].isInline() && !events[j].isExternal()) {
+				events[j].~MidiEvent();
+			}
+		}
+		::operator delete(events);
+	}
+	m_eventBlocks.clear();
+
+	for (auto block : m_byteBlocks) {
+		delete [] block;
+	}
+	m_byteBlocks.clear();
+	m_byteFree = 0;
+	m_allocated = 0;
+}
+
+
+
+//////////////////////////////
+//
+// MidiArena::merge -- Take over the blocks of another arena, such as one
+//    that a reading thread filled.  The blocks of the other arena go in
+//    front of the current ones, so the partly used last blocks of this
+//    arena stay the ones that new events and bytes come from.
+//
+
+void MidiArena::merge(MidiArena& other) {
+	if (this == &other) {
+		return;
+	}
+	m_eventBlocks.insert(m_eventBlocks.begin(), other.m_eventBlocks.begin(),
+			other.m_eventBlocks.end());
+	if (m_byteBlocks.empty()) {
+		m_byteFree = other.m_byteFree;
+	}
+	m_byteBlocks.insert(m_byteBlocks.begin(), other.m_byteBlocks.begin(),
+			other.m_byteBlocks.end());
+	m_allocated += other.m_allocated;
+	other.m_eventBlocks.clear();
+	other.m_byteBlocks.clear();
+	other.m_byteFree  = 0;
+	other.m_allocated = 0;
+}
+
+
+
+//////////////////////////////
+//
+// MidiArena::getEventCount -- Number of events made with newEvent().
+//
+
+int MidiArena::getEventCount(void) const {
+	int count = 0;
+	for (const auto& block : m_eventBlocks) {
+		count += block.second;
+	}
+	return count;
+}
+
+
+
+//////////////////////////////
+//
+// MidiArena::getAllocatedBytes -- Memory held by the arena.
+//
+
+size_t MidiArena::getAllocatedBytes(void) const {
+	return m_allocated;
+}
+
+
+} // end of namespace smf
+
+
+
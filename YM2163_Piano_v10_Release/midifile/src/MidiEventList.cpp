@@ -161,13 +161,16 @@ const MidiEvent& MidiEventList::getEvent(int index) const {
 //////////////////////////////
 //
 // MidiEventList::clear -- De-allocate any MidiEvents present in the list
-//    and set the size of the list to 0.
+//    and set the size of the list to 0.  Events from a MidiArena are
+//    left to the arena.
 //
 
 void MidiEventList::clear(void) {
 	for (auto& item : list) {
 		if (item != NULL) {
-			delete item;
+			if (!item->isArenaEvent()) {
+				delete item;
+			}
 			item = NULL;
 		}
 	}
@@ -271,7 +274,9 @@ void MidiEventList::removeEmpties(void) {
 	int count = 0;
 	for (auto& item : list) {
 		if (item->empty()) {
-			delete item;
+			if (!item->isArenaEvent()) {
+				delete item;
+			}
 			item = NULL;
 			count++;
 		}
@@ -14,14 +14,19 @@
 
 #include "MidiFile.h"
 #include "Binasc.h"
+#include "SmfFileView.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <iterator>
 #include <sstream>
 #include <string>
+#include <system_error>
+#include <thread>
 #include <vector>
 
 #ifdef _WIN32
@@ -31,6 +36,11 @@
 
 namespace smf {
 
+// Files smaller than this are decoded on one thread even if more are
+// allowed (see MidiFile::setReadThreads()); starting the threads would
+// take longer than reading the tracks.
+#define READ_PARALLEL_MIN_BYTES 65536
+
 
 const std::string MidiFile::encodeLookup = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/=";
 
@@ -131,7 +141,7 @@ MidiFile::~MidiFile() {
 	}
 	m_events.resize(0);
 	m_rwstatus = false;
-	m_timemap.clear();
+	m_tempomap.clear();
 	m_timemapvalid = 0;
 }
 
@@ -158,8 +168,11 @@ MidiFile& MidiFile::operator=(const MidiFile& other) {
 	m_theTimeState        = other.m_theTimeState;
 	m_readFileName        = other.m_readFileName;
 	m_timemapvalid        = other.m_timemapvalid;
-	m_timemap             = other.m_timemap;
+	m_tempomap            = other.m_tempomap;
 	m_rwstatus            = other.m_rwstatus;
+	m_arenaQ              = other.m_arenaQ;
+	m_readThreads         = other.m_readThreads;
+	m_trackStats          = other.m_trackStats;
 	if (other.m_linkedEventsQ) {
 		linkEventPairs();
 	}
@@ -178,8 +191,12 @@ MidiFile& MidiFile::operator=(MidiFile&& other) {
 	m_theTimeState        = other.m_theTimeState;
 	m_readFileName        = other.m_readFileName;
 	m_timemapvalid        = other.m_timemapvalid;
-	m_timemap             = other.m_timemap;
+	m_tempomap            = other.m_tempomap;
 	m_rwstatus            = other.m_rwstatus;
+	m_arenaQ              = other.m_arenaQ;
+	m_arena               = std::move(other.m_arena);
+	m_readThreads         = other.m_readThreads;
+	m_trackStats          = std::move(other.m_trackStats);
 	return *this;
 }
 
@@ -201,15 +218,13 @@ bool MidiFile::read(const std::string& filename) {
 	setFilename(filename);
 	m_rwstatus = true;
 
-	std::fstream input;
-	input.open(filename.c_str(), std::ios::binary | std::ios::in);
-
-	if (!input.is_open()) {
+	SmfFileView view;
+	if (!view.open(filename)) {
 		m_rwstatus = false;
 		return m_rwstatus;
 	}
 
-	m_rwstatus = read(input);
+	m_rwstatus = read(view.data(), view.size());
 	return m_rwstatus;
 }
 
@@ -242,6 +257,20 @@ bool MidiFile::read(std::istream& input) {
 	}
 }
 
+//
+// Byte span version of read().
+//
+
+bool MidiFile::read(const uchar* data, size_t size) {
+	if (size > 0 && data[0] == 'M') {
+		m_rwstatus = readSmf(data, size);
+		return m_rwstatus;
+	}
+	std::istringstream input(std::string((const char*)data, size));
+	m_rwstatus = read(input);
+	return m_rwstatus;
+}
+
 
 
 //////////////////////////////
@@ -277,15 +306,13 @@ bool MidiFile::readSmf(const std::string& filename) {
 	setFilename(filename);
 	m_rwstatus = true;
 
-	std::fstream input;
-	input.open(filename.c_str(), std::ios::binary | std::ios::in);
-
-	if (!input.is_open()) {
+	SmfFileView view;
+	if (!view.open(filename)) {
 		m_rwstatus = false;
 		return m_rwstatus;
 	}
 
-	m_rwstatus = readSmf(input);
+	m_rwstatus = readSmf(view.data(), view.size());
 	return m_rwstatus;
 }
 
@@ -305,15 +332,13 @@ bool MidiFile::read(const std::wstring& filename) {
 	setFilename(utf8_filename);
 	m_rwstatus = true;
 
-	std::fstream input;
-	input.open(filename.c_str(), std::ios::binary | std::ios::in);
-
-	if (!input.is_open()) {
+	SmfFileView view;
+	if (!view.open(filename)) {
 		m_rwstatus = false;
 		return m_rwstatus;
 	}
 
-	m_rwstatus = read(input);
+	m_rwstatus = read(view.data(), view.size());
 	return m_rwstatus;
 }
 
@@ -332,15 +357,13 @@ bool MidiFile::readSmf(const std::wstring& filename) {
 	setFilename(utf8_filename);
 	m_rwstatus = true;
 
-	std::fstream input;
-	input.open(filename.c_str(), std::ios::binary | std::ios::in);
-
-	if (!input.is_open()) {
+	SmfFileView view;
+	if (!view.open(filename)) {
 		m_rwstatus = false;
 		return m_rwstatus;
 	}
 
-	m_rwstatus = readSmf(input);
+	m_rwstatus = readSmf(view.data(), view.size());
 	return m_rwstatus;
 }
 #endif
@@ -352,68 +375,47 @@ bool MidiFile::readSmf(const std::wstring& filename) {
 //
 
 bool MidiFile::readSmf(std::istream& input) {
+	// Take the whole stream in one block and parse it from memory.
+	std::vector<uchar> data((std::istreambuf_iterator<char>(input)),
+			std::istreambuf_iterator<char>());
+	return readSmf(data.data(), data.size());
+}
+
+//
+// Byte span version of readSmf().  The data is only read while parsing, so
+// it can be a memory-mapped file.  Every read is checked against the end of
+// the span.
+//
+
+bool MidiFile::readSmf(const uchar* data, size_t size) {
 	m_rwstatus = true;
 
 	std::string filename = getFilename();
 
-	int    character;
-	// uchar  buffer[123456] = {0};
+	const uchar* p   = data;
+	const uchar* end = data + size;
 	ulong  longdata;
 	ushort shortdata;
 
 	// Read the MIDI header (4 bytes of ID, 4 byte data size,
 	// anticipated 6 bytes of data.
 
-	character = input.get();
-	if (character == EOF) {
-		std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-		std::cerr << "Expecting 'M' at first byte, but found nothing." << std::endl;
-		m_rwstatus = false; return m_rwstatus;
-	} else if (character != 'M') {
-		std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-		std::cerr << "Expecting 'M' at first byte but got '"
-		     << (char)character << "'" << std::endl;
-		m_rwstatus = false; return m_rwstatus;
-	}
-
-	character = input.get();
-	if (character == EOF) {
-		std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-		std::cerr << "Expecting 'T' at second byte, but found nothing." << std::endl;
-		m_rwstatus = false; return m_rwstatus;
-	} else if (character != 'T') {
-		std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-		std::cerr << "Expecting 'T' at second byte but got '"
-		     << (char)character << "'" << std::endl;
-		m_rwstatus = false; return m_rwstatus;
-	}
-
-	character = input.get();
-	if (character == EOF) {
+	if (size < 14) {
 		std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-		std::cerr << "Expecting 'h' at third byte, but found nothing." << std::endl;
-		m_rwstatus = false; return m_rwstatus;
-	} else if (character != 'h') {
-		std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-		std::cerr << "Expecting 'h' at third byte but got '"
-		     << (char)character << "'" << std::endl;
+		std::cerr << "Expecting a 14-byte MIDI header, but found " << size
+		     << " bytes." << std::endl;
 		m_rwstatus = false; return m_rwstatus;
 	}
-
-	character = input.get();
-	if (character == EOF) {
-		std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-		std::cerr << "Expecting 'd' at fourth byte, but found nothing." << std::endl;
-		m_rwstatus = false; return m_rwstatus;
-	} else if (character != 'd') {
+	if (p[0] != 'M' || p[1] != 'T' || p[2] != 'h' || p[3] != 'd') {
 		std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-		std::cerr << "Expecting 'd' at fourth byte but got '"
-		     << (char)character << "'" << std::endl;
+		std::cerr << "Expecting 'MThd' at start of file" << std::endl;
 		m_rwstatus = false; return m_rwstatus;
 	}
+	p += 4;
 
 	// read header size (allow larger header size?)
-	longdata = readLittleEndian4Bytes(input);
+	longdata = ((ulong)p[0] << 24) | ((ulong)p[1] << 16) | ((ulong)p[2] << 8) | p[3];
+	p += 4;
 	if (longdata != 6) {
 		std::cerr << "File " << filename
 		     << " is not a MIDI 1.0 Standard MIDI file." << std::endl;
@@ -423,7 +425,8 @@ bool MidiFile::readSmf(std::istream& input) {
 
 	// Header parameter #1: format type
 	int type;
-	shortdata = readLittleEndian2Bytes(input);
+	shortdata = (ushort)((p[0] << 8) | p[1]);
+	p += 2;
 	switch (shortdata) {
 		case 0:
 			type = 0;
@@ -442,7 +445,8 @@ bool MidiFile::readSmf(std::istream& input) {
 
 	// Header parameter #2: track count
 	int tracks;
-	shortdata = readLittleEndian2Bytes(input);
+	shortdata = (ushort)((p[0] << 8) | p[1]);
+	p += 2;
 	if (type == 0 && shortdata != 1) {
 		std::cerr << "Error: Type 0 MIDI file can only contain one track" << std::endl;
 		std::cerr << "Instead track count is: " << shortdata << std::endl;
@@ -457,12 +461,11 @@ bool MidiFile::readSmf(std::istream& input) {
 	m_events.resize(tracks);
 	for (int z=0; z<tracks; z++) {
 		m_events[z] = new MidiEventList;
-		m_events[z]->reserve(10000);   // Initialize with 10,000 event storage.
-		m_events[z]->clear();
 	}
 
 	// Header parameter #3: Ticks per quarter note
-	shortdata = readLittleEndian2Bytes(input);
+	shortdata = (ushort)((p[0] << 8) | p[1]);
+	p += 2;
 	if (shortdata >= 0x8000) {
 		int framespersecond = 255 - ((shortdata >> 8) & 0x00ff) + 1;
 		int subframes       = shortdata & 0x00ff;
@@ -476,10 +479,6 @@ bool MidiFile::readSmf(std::istream& input) {
 					std::cerr << "Using non-standard FPS: " << framespersecond << std::endl;
 		}
 		m_ticksPerQuarterNote = framespersecond * subframes;
-
-		// std::cerr << "SMPTE ticks: " << m_ticksPerQuarterNote << " ticks/sec" << std::endl;
-		// std::cerr << "SMPTE frames per second: " << framespersecond << std::endl;
-		// std::cerr << "SMPTE subframes per frame: " << subframes << std::endl;
 	}  else {
 		m_ticksPerQuarterNote = shortdata;
 	}
@@ -490,107 +489,48 @@ bool MidiFile::readSmf(std::istream& input) {
 	// now read individual tracks:
 	//
 
-	uchar runningCommand;
-	MidiEvent event;
-	std::vector<uchar> bytes;
-	int xstatus;
+	m_trackStats.assign(tracks, MidiTrackStats());
+	MidiArena* arena = m_arenaQ ? &m_arena : NULL;
 
-	for (int i=0; i<tracks; i++) {
-		runningCommand = 0;
+	// Tracks decoded in parallel (if any) are complete; the rest are read
+	// one after another from p.
+	int first = readTracksParallel(p, end, tracks);
+	if (!m_rwstatus) {
+		return m_rwstatus;
+	}
 
-		// std::cout << "\nReading Track: " << i + 1 << flush;
+	for (int i=first; i<tracks; i++) {
 
 		// read track header...
 
-		character = input.get();
-		if (character == EOF) {
+		if (end - p < 8) {
 			std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-			std::cerr << "Expecting 'M' at first byte in track, but found nothing."
-			     << std::endl;
-			m_rwstatus = false; return m_rwstatus;
-		} else if (character != 'M') {
-			std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-			std::cerr << "Expecting 'M' at first byte in track but got '"
-			     << (char)character << "'" << std::endl;
+			std::cerr << "Expecting 'MTrk' header for track " << i + 1
+			     << ", but found nothing." << std::endl;
 			m_rwstatus = false; return m_rwstatus;
 		}
-
-		character = input.get();
-		if (character == EOF) {
-			std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-			std::cerr << "Expecting 'T' at second byte in track, but found nothing."
-			     << std::endl;
-			m_rwstatus = false; return m_rwstatus;
-		} else if (character != 'T') {
+		if (p[0] != 'M' || p[1] != 'T' || p[2] != 'r' || p[3] != 'k') {
 			std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-			std::cerr << "Expecting 'T' at second byte in track but got '"
-			     << (char)character << "'" << std::endl;
+			std::cerr << "Expecting 'MTrk' at start of track " << i + 1 << std::endl;
 			m_rwstatus = false; return m_rwstatus;
 		}
-
-		character = input.get();
-		if (character == EOF) {
-			std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-			std::cerr << "Expecting 'r' at third byte in track, but found nothing."
-			     << std::endl;
-			m_rwstatus = false; return m_rwstatus;
-		} else if (character != 'r') {
-			std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-			std::cerr << "Expecting 'r' at third byte in track but got '"
-			     << (char)character << "'" << std::endl;
-			m_rwstatus = false; return m_rwstatus;
+		p += 4;
+
+		// The track chunk size is only used to size the event list: the
+		// track MUST end with an end of track meta event, and many MIDI
+		// files found in the wild do not correctly give the track size.
+		longdata = ((ulong)p[0] << 24) | ((ulong)p[1] << 16) | ((ulong)p[2] << 8) | p[3];
+		p += 4;
+		if (longdata > (ulong)(end - p)) {
+			longdata = (ulong)(end - p);
 		}
 
-		character = input.get();
-		if (character == EOF) {
-			std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-			std::cerr << "Expecting 'k' at fourth byte in track, but found nothing."
-			     << std::endl;
-			m_rwstatus = false; return m_rwstatus;
-		} else if (character != 'k') {
-			std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-			std::cerr << "Expecting 'k' at fourth byte in track but got '"
-			     << (char)character << "'" << std::endl;
-			m_rwstatus = false; return m_rwstatus;
-		}
+		// Events take at least 3 bytes on average (delta, status/running
+		// data bytes), so this usually covers the track in one allocation.
+		m_events[i]->reserve((int)(longdata / 3) + 16);
 
-		// Now read track chunk size and throw it away because it is
-		// not really necessary since the track MUST end with an
-		// end of track meta event, and many MIDI files found in the wild
-		// do not correctly give the track size.
-		longdata = readLittleEndian4Bytes(input);
-
-		// Set the size of the track allocation so that it might
-		// approximately fit the data.
-		m_events[i]->reserve((int)longdata/2);
-		m_events[i]->clear();
-
-		// Read MIDI events in the track, which are pairs of VLV values
-		// and then the bytes for the MIDI message.  Running status messages
-		// will be filled in with their implicit command byte.
-		// The timestamps are converted from delta ticks to absolute ticks,
-		// with the absticks variable accumulating the VLV tick values.
-		int absticks = 0;
-		while (!input.eof()) {
-			longdata = readVLValue(input);
-			absticks += longdata;
-			xstatus = extractMidiData(input, bytes, runningCommand);
-			if (xstatus == 0) {
-				m_rwstatus = false; return m_rwstatus;
-			}
-			event.setMessage(bytes);
-			event.tick = absticks;
-			event.track = i;
-
-			if (bytes[0] == 0xff && bytes[1] == 0x2f) {
-				// end-of-track message
-				// comment out the following line if you don't want to see the
-				// end of track message (which is always required, and will added
-				// automatically when a MIDI is written, so it is not necessary.
-				m_events[i]->push_back(event);
-				break;
-			}
-			m_events[i]->push_back(event);
+		if (!readTrack(p, end, i, arena, m_trackStats[i], std::cerr)) {
+			m_rwstatus = false; return m_rwstatus;
 		}
 	}
 
@@ -1108,9 +1048,14 @@ void MidiFile::joinTracks(void) {
 	if (oldTimeState == TIME_STATE_DELTA) {
 		makeAbsoluteTicks();
 	}
-	for (i=0; i<length; i++) {
-		for (j=0; j<(int)m_events[i]->size(); j++) {
-			joinedTrack->push_back_no_copy(&(*m_events[i])[j]);
+	// The tracks are normally each in order already, so they are merged
+	// rather than concatenated and sorted.
+	bool mergedQ = mergeSortedTracks(*joinedTrack);
+	if (!mergedQ) {
+		for (i=0; i<length; i++) {
+			for (j=0; j<(int)m_events[i]->size(); j++) {
+				joinedTrack->push_back_no_copy(&(*m_events[i])[j]);
+			}
 		}
 	}
 
@@ -1119,7 +1064,9 @@ void MidiFile::joinTracks(void) {
 	delete m_events[0];
 	m_events.resize(0);
 	m_events.push_back(joinedTrack);
-	sortTracks();
+	if (!mergedQ) {
+		sortTracks();
+	}
 	if (oldTimeState == TIME_STATE_DELTA) {
 		makeDeltaTicks();
 	}
@@ -1129,6 +1076,124 @@ void MidiFile::joinTracks(void) {
 
 
 
+//////////////////////////////
+//
+// MidiFile::mergeSortedTracks -- Append the events of all tracks to
+//   output in the order sortTracks() would give them, with a k-way merge
+//   (loser tree over the next event of each track).  Events that compare
+//   equal keep their track order.  This takes about n log2(k) comparisons
+//   for n events in k tracks instead of the n log2(n) of sorting, but
+//   requires each track to be in order already (absolute ticks, as after
+//   reading a file).  If a track turns out not to be, the output is emptied
+//   and false is returned.
+//
+
+bool MidiFile::mergeSortedTracks(MidiEventList& output) {
+	int length = getNumTracks();
+	int leaves = 1;
+	while (leaves < length) {
+		leaves *= 2;
+	}
+
+	// Next event of each track with its tick and sequence number packed
+	// into key, so that the usual comparison is a single integer compare.
+	// Finished (and padding) tracks have the largest key.
+	const unsigned long long doneKey = ~0ULL;
+	std::vector<unsigned long long> key(leaves, doneKey);
+	std::vector<MidiEvent**> next(leaves, (MidiEvent**)NULL);
+	std::vector<MidiEvent**> last(leaves, (MidiEvent**)NULL);
+	auto makeKey = [](const MidiEvent* event) {
+		return ((unsigned long long)((unsigned int)event->tick ^ 0x80000000u) << 32)
+				| ((unsigned int)event->seq ^ 0x80000000u);
+	};
+	for (int i=0; i<length; i++) {
+		if (m_events[i]->size() > 0) {
+			next[i] = m_events[i]->data();
+			last[i] = next[i] + m_events[i]->size();
+			key[i] = makeKey(*next[i]);
+		}
+	}
+
+	// Same result as eventCompareNoteOnsBeforeOffs(): tick, then seq if
+	// both are set, then message types.
+	auto compare = [](unsigned long long akey, MidiEvent* aevent,
+			unsigned long long bkey, MidiEvent* bevent) {
+		const unsigned long long noSeq = 0x80000000u;
+		if (((akey ^ bkey) >> 32) || (((akey & 0xffffffffu) != noSeq)
+				&& ((bkey & 0xffffffffu) != noSeq) && (akey != bkey))) {
+			return akey < bkey ? -1 : +1;
+		}
+		return MidiEventList::eventCompareNoteOnsBeforeOffs(&aevent, &bevent);
+	};
+	// True if the next event of track a goes before that of track b;
+	// equal events keep the track order.
+	auto before = [&](int a, int b) {
+		const unsigned long long noSeq = 0x80000000u;
+		unsigned long long akey = key[a];
+		unsigned long long bkey = key[b];
+		if (((akey ^ bkey) >> 32) || ((akey != bkey) && ((akey & 0xffffffffu) != noSeq)
+				&& ((bkey & 0xffffffffu) != noSeq))) {
+			// different ticks, or different sequence numbers (doneKey is
+			// larger than any event)
+			return akey < bkey;
+		}
+		if (next[a] == last[a]) {
+			return false;
+		}
+		if (next[b] == last[b]) {
+			return true;
+		}
+		int order = compare(akey, *next[a], bkey, *next[b]);
+		return order < 0 || (order == 0 && a < b);
+	};
+
+	// Loser tree: tree[1..leaves-1] == track that lost the match at each
+	// node, tree[0] == overall winner.  Track i is leaf node leaves + i.
+	std::vector<int> tree(leaves);
+	std::vector<int> winner(2 * leaves);
+	for (int i=0; i<leaves; i++) {
+		winner[leaves + i] = i;
+	}
+	for (int node=leaves-1; node>0; node--) {
+		int a = winner[2 * node];
+		int b = winner[2 * node + 1];
+		if (before(b, a)) {
+			std::swap(a, b);
+		}
+		winner[node] = a;
+		tree[node] = b;
+	}
+	tree[0] = winner[1];
+
+	while (next[tree[0]] != last[tree[0]]) {
+		int track = tree[0];
+		MidiEvent* event = *next[track]++;
+		output.push_back_no_copy(event);
+		if (next[track] == last[track]) {
+			key[track] = doneKey;
+		} else {
+			unsigned long long following = makeKey(*next[track]);
+			if (compare(key[track], event, following, *next[track]) > 0) {
+				output.detach();
+				return false;
+			}
+			key[track] = following;
+		}
+		// Replay the matches on the path from the leaf to the root.
+		int current = track;
+		for (int node=(leaves + track)/2; node>0; node/=2) {
+			if (before(tree[node], current)) {
+				std::swap(tree[node], current);
+			}
+		}
+		tree[0] = current;
+	}
+
+	return true;
+}
+
+
+
 //////////////////////////////
 //
 // MidiFile::splitTracks -- Take the joined tracks and split them
@@ -1571,25 +1636,7 @@ double MidiFile::getTimeInSeconds(int tickvalue) {
 			return -1.0;    // something went wrong
 		}
 	}
-
-	_TickTime key;
-	key.tick    = tickvalue;
-	key.seconds = -1;
-
-	void* ptr = bsearch(&key, m_timemap.data(), m_timemap.size(),
-			sizeof(_TickTime), ticksearch);
-
-	if (ptr == NULL) {
-		// The specific tick value was not found, so do a linear
-		// search for the two tick values which occur before and
-		// after the tick value, and do a linear interpolation of
-		// the time in seconds values to figure out the final
-		// time in seconds.
-		// Since the code is not yet written, kill the program at this point:
-		return linearSecondInterpolationAtTick(tickvalue);
-	} else {
-		return ((_TickTime*)ptr)->seconds;
-	}
+	return m_tempomap.getSecondsAtTick(tickvalue);
 }
 
 
@@ -1597,8 +1644,10 @@ double MidiFile::getTimeInSeconds(int tickvalue) {
 //////////////////////////////
 //
 // MidiFile::getAbsoluteTickTime -- return the tick value represented
-//    by the input time in seconds.  If there is not tick entry at
-//    the given time in seconds, then interpolate between two values.
+//    by the input time in seconds.  Values between ticks are
+//    interpolated within the tempo segment containing the time.
+//    Returns -1 if the time is before the first event or after the
+//    last event of the file.
 //
 
 double MidiFile::getAbsoluteTickTime(double starttime) {
@@ -1609,23 +1658,43 @@ double MidiFile::getAbsoluteTickTime(double starttime) {
 		}
 	}
 
-	_TickTime key;
-	key.tick    = -1;
-	key.seconds = starttime;
+	// give an error value of -1 if time is out of range of data.
+	bool found = false;
+	double firsttime = 0.0;
+	double lasttime = 0.0;
+	for (int i=0; i<getTrackCount(); i++) {
+		const MidiEventList& track = *m_events[i];
+		if (track.size() == 0) {
+			continue;
+		}
+		if (!found || track[0].seconds < firsttime) {
+			firsttime = track[0].seconds;
+		}
+		if (!found || track[track.size()-1].seconds > lasttime) {
+			lasttime = track[track.size()-1].seconds;
+		}
+		found = true;
+	}
+	if (!found || starttime < firsttime || starttime > lasttime) {
+		return -1.0;
+	}
+
+	return m_tempomap.getTickAtSeconds(starttime);
+}
 
-	void* ptr = bsearch(&key, m_timemap.data(), m_timemap.size(),
-			sizeof(_TickTime), secondsearch);
 
-	if (ptr == NULL) {
-		// The specific seconds value was not found, so do a linear
-		// search for the two time values which occur before and
-		// after the given time value, and do a linear interpolation of
-		// the time in tick values to figure out the final time in ticks.
-		return linearTickInterpolationAtSecond(starttime);
-	} else {
-		return ((_TickTime*)ptr)->tick;
-	}
 
+//////////////////////////////
+//
+// MidiFile::getTempoMap -- return the tempo segment index, building
+//    it first if needed.
+//
+
+const MidiTempoMap& MidiFile::getTempoMap(void) {
+	if (m_timemapvalid == 0) {
+		buildTimeMap();
+	}
+	return m_tempomap;
 }
 
 
@@ -1720,7 +1789,7 @@ const char* MidiFile::getFilename(void) const {
 MidiEvent* MidiFile::addEvent(int aTrack, int aTick,
 		std::vector<uchar>& midiData) {
 	m_timemapvalid = 0;
-	MidiEvent* me = new MidiEvent;
+	MidiEvent* me = newEvent();
 	me->tick = aTick;
 	me->track = aTrack;
 	me->setMessage(midiData);
@@ -1811,7 +1880,7 @@ MidiEvent* MidiFile::addMetaEvent(int aTrack, int aTick, int aType,
 //
 
 MidiEvent* MidiFile::addText(int aTrack, int aTick, const std::string& text) {
-	MidiEvent* me = new MidiEvent;
+	MidiEvent* me = newEvent();
 	me->makeText(text);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -1826,7 +1895,7 @@ MidiEvent* MidiFile::addText(int aTrack, int aTick, const std::string& text) {
 //
 
 MidiEvent* MidiFile::addCopyright(int aTrack, int aTick, const std::string& text) {
-	MidiEvent* me = new MidiEvent;
+	MidiEvent* me = newEvent();
 	me->makeCopyright(text);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -1841,7 +1910,7 @@ MidiEvent* MidiFile::addCopyright(int aTrack, int aTick, const std::string& text
 //
 
 MidiEvent* MidiFile::addTrackName(int aTrack, int aTick, const std::string& name) {
-	MidiEvent* me = new MidiEvent;
+	MidiEvent* me = newEvent();
 	me->makeTrackName(name);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -1857,7 +1926,7 @@ MidiEvent* MidiFile::addTrackName(int aTrack, int aTick, const std::string& name
 
 MidiEvent* MidiFile::addInstrumentName(int aTrack, int aTick,
 		const std::string& name) {
-	MidiEvent* me = new MidiEvent;
+	MidiEvent* me = newEvent();
 	me->makeInstrumentName(name);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -1872,7 +1941,7 @@ MidiEvent* MidiFile::addInstrumentName(int aTrack, int aTick,
 //
 
 MidiEvent* MidiFile::addLyric(int aTrack, int aTick, const std::string& text) {
-	MidiEvent* me = new MidiEvent;
+	MidiEvent* me = newEvent();
 	me->makeLyric(text);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -1887,7 +1956,7 @@ MidiEvent* MidiFile::addLyric(int aTrack, int aTick, const std::string& text) {
 //
 
 MidiEvent* MidiFile::addMarker(int aTrack, int aTick, const std::string& text) {
-	MidiEvent* me = new MidiEvent;
+	MidiEvent* me = newEvent();
 	me->makeMarker(text);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -1902,7 +1971,7 @@ MidiEvent* MidiFile::addMarker(int aTrack, int aTick, const std::string& text) {
 //
 
 MidiEvent* MidiFile::addCue(int aTrack, int aTick, const std::string& text) {
-	MidiEvent* me = new MidiEvent;
+	MidiEvent* me = newEvent();
 	me->makeCue(text);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -1917,7 +1986,7 @@ MidiEvent* MidiFile::addCue(int aTrack, int aTick, const std::string& text) {
 //
 
 MidiEvent* MidiFile::addTempo(int aTrack, int aTick, double aTempo) {
-	MidiEvent* me = new MidiEvent;
+	MidiEvent* me = newEvent();
 	me->makeTempo(aTempo);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -1941,7 +2010,7 @@ MidiEvent* MidiFile::addTempo(int aTrack, int aTick, double aTempo) {
 //
 
 MidiEvent* MidiFile::addKeySignature (int aTrack, int aTick, int fifths, bool mode) {
-    MidiEvent* me = new MidiEvent;
+    MidiEvent* me = newEvent();
     me->makeKeySignature(fifths, mode);
     me->tick = aTick;
     m_events[aTrack]->push_back_no_copy(me);
@@ -1975,7 +2044,7 @@ MidiEvent* MidiFile::addKeySignature (int aTrack, int aTick, int fifths, bool mo
 
 MidiEvent* MidiFile::addTimeSignature(int aTrack, int aTick, int top, int bottom,
 		int clocksPerClick, int num32ndsPerQuarter) {
-	MidiEvent* me = new MidiEvent;
+	MidiEvent* me = newEvent();
 	me->makeTimeSignature(top, bottom, clocksPerClick, num32ndsPerQuarter);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -2067,7 +2136,7 @@ int MidiFile::makeVLV(uchar *buffer, int number) {
 //
 
 MidiEvent* MidiFile::addNoteOn(int aTrack, int aTick, int aChannel, int key, int vel) {
-	MidiEvent* me = new MidiEvent;
+	MidiEvent* me = newEvent();
 	me->makeNoteOn(aChannel, key, vel);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -2083,7 +2152,7 @@ MidiEvent* MidiFile::addNoteOn(int aTrack, int aTick, int aChannel, int key, int
 
 MidiEvent* MidiFile::addNoteOff(int aTrack, int aTick, int aChannel, int key,
 		int vel) {
-	MidiEvent* me = new MidiEvent;
+	MidiEvent* me = newEvent();
 	me->makeNoteOff(aChannel, key, vel);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -2099,7 +2168,7 @@ MidiEvent* MidiFile::addNoteOff(int aTrack, int aTick, int aChannel, int key,
 //
 
 MidiEvent* MidiFile::addNoteOff(int aTrack, int aTick, int aChannel, int key) {
-	MidiEvent* me = new MidiEvent;
+	MidiEvent* me = newEvent();
 	me->makeNoteOff(aChannel, key);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -2116,7 +2185,7 @@ MidiEvent* MidiFile::addNoteOff(int aTrack, int aTick, int aChannel, int key) {
 
 MidiEvent* MidiFile::addController(int aTrack, int aTick, int aChannel,
 		int num, int value) {
-	MidiEvent* me = new MidiEvent;
+	MidiEvent* me = newEvent();
 	me->makeController(aChannel, num, value);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -2133,7 +2202,7 @@ MidiEvent* MidiFile::addController(int aTrack, int aTick, int aChannel,
 
 MidiEvent* MidiFile::addPatchChange(int aTrack, int aTick, int aChannel,
 		int patchnum) {
-	MidiEvent* me = new MidiEvent;
+	MidiEvent* me = newEvent();
 	me->makePatchChange(aChannel, patchnum);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -2387,13 +2456,134 @@ void MidiFile::clear(void) {
 	}
 	m_events.resize(1);
 	m_events[0] = new MidiEventList;
+	m_arena.clear();
 	m_timemapvalid=0;
-	m_timemap.clear();
+	m_tempomap.clear();
 	m_theTrackState = TRACK_STATE_SPLIT;
 	m_theTimeState = TIME_STATE_ABSOLUTE;
 }
 
 
+
+//////////////////////////////
+//
+// MidiFile::setArenaMode -- Allocate new events (when reading and in the
+//     add functions) from an arena owned by the MidiFile.  Messages of up
+//     to MIDI_BYTES_INLINE bytes are stored in the event itself and longer
+//     ones read from a file in the arena, so a whole song is a few large
+//     allocations which clear() releases together.  Events already present
+//     are not affected.
+//
+
+void MidiFile::setArenaMode(bool state) {
+	m_arenaQ = state;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::getArenaMode -- True if new events are allocated from the arena.
+//
+
+bool MidiFile::getArenaMode(void) const {
+	return m_arenaQ;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::getArenaBytes -- Memory held by the arena.
+//
+
+size_t MidiFile::getArenaBytes(void) const {
+	return m_arena.getAllocatedBytes();
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::setReadThreads -- Number of threads that decode the tracks
+//     of a Standard MIDI File: 1 (the default) reads the tracks one after
+//     another, 0 uses one thread per core and n up to n threads.  See
+//     readTracksParallel() for how the tracks are split up.
+//
+
+void MidiFile::setReadThreads(int count) {
+	m_readThreads = count < 0 ? 1 : count;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::getReadThreads -- Maximum number of track decoding threads
+//     (0 = one per core).
+//
+
+int MidiFile::getReadThreads(void) const {
+	return m_readThreads;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::getTrackStatsCount -- Number of tracks in the last file read
+//     that have statistics (0 if nothing was read).
+//
+
+int MidiFile::getTrackStatsCount(void) const {
+	return (int)m_trackStats.size();
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::getTrackStats -- Counts for a track of the last file read,
+//     collected while its events were decoded.  They describe the file
+//     as read, not later edits or joined/split tracks.
+//
+
+const MidiTrackStats& MidiFile::getTrackStats(int track) const {
+	return m_trackStats.at(track);
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::getTotalStats -- Sum of the counts of all tracks of the last
+//     file read.
+//
+
+MidiTrackStats MidiFile::getTotalStats(void) const {
+	MidiTrackStats total;
+	for (const auto& stats : m_trackStats) {
+		total.add(stats);
+	}
+	return total;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::newEvent -- Allocate an empty event for one of the tracks,
+//     from the arena in arena mode.
+//
+
+MidiEvent* MidiFile::newEvent(void) {
+	if (m_arenaQ) {
+		return m_arena.newEvent();
+	}
+	return new MidiEvent;
+}
+
+
 void MidiFile::erase(void) {
 	clear();
 }
@@ -2654,356 +2844,266 @@ void MidiFile::clearLinks(void) {
 
 //////////////////////////////
 //
-// MidiFile::linearTickInterpolationAtSecond -- return the tick value at the
-//    given input time.
+// MidiFile::buildTimeMap -- build the tempo segment index of the MIDI
+//      file (see MidiTempoMap) and store the time in seconds of every
+//      event, taking into consideration tempo change messages.  If no
+//      tempo messages are given (or until they are given, then the
+//      tempo is set to 120 beats per minute).  If SMPTE time code is
+//      used, then ticks are actually time values.  So don't build
+//      a time map for SMPTE ticks, and just calculate the time in
+//      seconds from the tick value (1000 ticks per second SMPTE
+//      is the only mode tested (25 frames per second and 40 subframes
+//      per frame).
 //
 
-double MidiFile::linearTickInterpolationAtSecond(double seconds) {
-	if (m_timemapvalid == 0) {
-		buildTimeMap();
-		if (m_timemapvalid == 0) {
-			return -1.0;    // something went wrong
-		}
-	}
+void MidiFile::buildTimeMap(void) {
 
-	int i;
-	double lasttime = m_timemap[m_timemap.size()-1].seconds;
-	// give an error value of -1 if time is out of range of data.
-	if (seconds < 0.0) {
-		return -1.0;
-	}
-	if (seconds > m_timemap[m_timemap.size()-1].seconds) {
-		return -1.0;
-	}
+	// The tempo map reads tempo messages from all tracks in place, so
+	// the track and tick states of the file are left untouched.
+	m_tempomap.build(*this);
 
-	// Guess which side of the list is closest to target:
-	// Could do a more efficient algorithm since time values are sorted,
-	// but good enough for now...
-	int startindex = -1;
-	if (seconds < lasttime / 2) {
-		for (i=0; i<(int)m_timemap.size(); i++) {
-			if (m_timemap[i].seconds > seconds) {
-				startindex = i-1;
-				break;
-			} else if (m_timemap[i].seconds == seconds) {
-				startindex = i;
-				break;
-			}
-		}
-	} else {
-		for (i=(int)m_timemap.size()-1; i>0; i--) {
-			if (m_timemap[i].seconds < seconds) {
-				startindex = i+1;
-				break;
-			} else if (m_timemap[i].seconds == seconds) {
-				startindex = i;
-				break;
-			}
+	bool delta = isDeltaTicks();
+	for (int i=0; i<getTrackCount(); i++) {
+		MidiEventList& track = *m_events[i];
+		int tick = 0;
+		for (int j=0; j<track.size(); j++) {
+			tick = delta ? tick + track[j].tick : track[j].tick;
+			track[j].seconds = m_tempomap.getSecondsAtTick(tick);
 		}
 	}
 
-	if (startindex < 0) {
-		return -1.0;
-	}
-	if (startindex >= (int)m_timemap.size()-1) {
-		return -1.0;
-	}
-
-	double x1 = m_timemap[startindex].seconds;
-	double x2 = m_timemap[startindex+1].seconds;
-	double y1 = m_timemap[startindex].tick;
-	double y2 = m_timemap[startindex+1].tick;
-	double xi = seconds;
+	m_timemapvalid = 1;
 
-	return (xi-x1) * ((y2-y1)/(x2-x1)) + y1;
 }
 
 
 
 //////////////////////////////
 //
-// MidiFile::linearSecondInterpolationAtTick -- return the time in seconds
-//    value at the given input tick time. (Ticks input could be made double).
+// MidiFile::readTrack -- Read the MIDI events of a track, starting at p
+//    just after the MTrk chunk header, into m_events[track] and advance p
+//    past the end-of-track message.  The events are pairs of VLV delta
+//    times and MIDI messages; running status messages will be filled in
+//    with their implicit command byte and the delta times are converted
+//    to absolute ticks.  Events are allocated from arena if it is not
+//    NULL, stats is updated for every event and errors are written to
+//    err.  Nothing else in the object is changed, so several tracks can
+//    be read at the same time.  Return value is false if the track is
+//    truncated or malformed.
 //
 
-double MidiFile::linearSecondInterpolationAtTick(int ticktime) {
-	if (m_timemapvalid == 0) {
-		buildTimeMap();
-		if (m_timemapvalid == 0) {
-			return -1.0;    // something went wrong
+bool MidiFile::readTrack(const uchar*& p, const uchar* end, int track,
+		MidiArena* arena, MidiTrackStats& stats, std::ostream& err) {
+	MidiEventList& list = *m_events[track];
+	uchar runningCommand = 0;
+	bool status = true;
+	int absticks = 0;
+	while (p < end) {
+		ulong delta = readVLValue(p, end, status, err);
+		if (!status) {
+			return false;
 		}
-	}
-
-	int i;
-	double lasttick = m_timemap[m_timemap.size()-1].tick;
-	// give an error value of -1 if time is out of range of data.
-	if (ticktime < 0.0) {
-		return -1;
-	}
-	if (ticktime > m_timemap.back().tick) {
-		return -1;  // don't try to extrapolate
-	}
-
-	// Guess which side of the list is closest to target:
-	// Could do a more efficient algorithm since time values are sorted,
-	// but good enough for now...
-	int startindex = -1;
-	if (ticktime < lasttick / 2) {
-		for (i=0; i<(int)m_timemap.size(); i++) {
-			if (m_timemap[i].tick > ticktime) {
-				startindex = i-1;
-				break;
-			} else if (m_timemap[i].tick == ticktime) {
-				startindex = i;
-				break;
+		absticks += delta;
+		MidiEvent* event = arena ? arena->newEvent() : new MidiEvent;
+		if (!extractMidiData(p, end, *event, runningCommand, arena, err)) {
+			if (!event->isArenaEvent()) {
+				delete event;
 			}
+			return false;
 		}
-	} else {
-		for (i=(int)m_timemap.size()-1; i>0; i--) {
-			if (m_timemap[i].tick < ticktime) {
-				startindex = i;
-				break;
-			} else if (m_timemap[i].tick == ticktime) {
-				startindex = i;
-				break;
-			}
+		event->tick = absticks;
+		event->track = track;
+		list.push_back_no_copy(event);
+		stats.addEvent(*event);
+
+		if ((*event)[0] == 0xff && event->size() > 1 && (*event)[1] == 0x2f) {
+			// end-of-track message (always required, and added
+			// automatically when a MIDI file is written).
+			break;
 		}
 	}
-
-	if (startindex < 0) {
-		return -1;
-	}
-	if (startindex >= (int)m_timemap.size()-1) {
-		return -1;
-	}
-
-	if (m_timemap[startindex].tick == ticktime) {
-		return m_timemap[startindex].seconds;
-	}
-
-	double x1 = m_timemap[startindex].tick;
-	double x2 = m_timemap[startindex+1].tick;
-	double y1 = m_timemap[startindex].seconds;
-	double y2 = m_timemap[startindex+1].seconds;
-	double xi = ticktime;
-
-	return (xi-x1) * ((y2-y1)/(x2-x1)) + y1;
+	return true;
 }
 
 
 
 //////////////////////////////
 //
-// MidiFile::buildTimeMap -- build an index of the absolute tick values
-//      found in a MIDI file, and their corresponding time values in
-//      seconds, taking into consideration tempo change messages.  If no
-//      tempo messages are given (or until they are given, then the
-//      tempo is set to 120 beats per minute).  If SMPTE time code is
-//      used, then ticks are actually time values.  So don't build
-//      a time map for SMPTE ticks, and just calculate the time in
-//      seconds from the tick value (1000 ticks per second SMPTE
-//      is the only mode tested (25 frames per second and 40 subframes
-//      per frame).
+// MidiFile::readTracksParallel -- Decode the tracks starting at p on up
+//    to m_readThreads threads.  The MTrk chunk sizes give the start of
+//    each track; each thread takes the next unread track, with its own
+//    arena and its error messages kept back.  The tracks are then
+//    accepted in file order for as long as each one ended exactly where
+//    the next chunk starts, which is where a sequential read would have
+//    continued, so the result is the same as reading the tracks one after
+//    another.  Returns the number of tracks accepted (0 if the file is
+//    read on one thread) and advances p past them; the remaining tracks
+//    are read again sequentially.  m_rwstatus is set to false if an
+//    accepted track is malformed.
 //
 
-void MidiFile::buildTimeMap(void) {
-
-	// convert the MIDI file to absolute time representation
-	// in single track mode (and undo if the MIDI file was not
-	// in that state when this function was called.
-	//
-	int trackstate = getTrackState();
-	int timestate  = getTickState();
-
-	makeAbsoluteTicks();
-	joinTracks();
-
-	int allocsize = getNumEvents(0);
-	m_timemap.reserve(allocsize+10);
-	m_timemap.clear();
-
-	_TickTime value;
-
-	int lasttick = 0;
-	int tickinit = 0;
-
-	int i;
-	int tpq = getTicksPerQuarterNote();
-	double defaultTempo = 120.0;
-	double secondsPerTick = 60.0 / (defaultTempo * tpq);
-
-	double lastsec = 0.0;
-	double cursec = 0.0;
+int MidiFile::readTracksParallel(const uchar*& p, const uchar* end,
+		int tracks) {
+	int threads = m_readThreads;
+	if (threads == 0) {
+		threads = (int)std::thread::hardware_concurrency();
+	}
+	if (threads < 2 || tracks < 2 || end - p < READ_PARALLEL_MIN_BYTES) {
+		return 0;
+	}
 
-	for (i=0; i<getNumEvents(0); i++) {
-		int curtick = getEvent(0, i).tick;
-		getEvent(0, i).seconds = cursec;
-		if ((curtick > lasttick) || !tickinit) {
-			tickinit = 1;
+	// Chunk table: data start and (clipped) size of each track, up to the
+	// first missing MTrk header.
+	std::vector<const uchar*> start;
+	std::vector<ulong> length;
+	const uchar* q = p;
+	while ((int)start.size() < tracks && end - q >= 8 && memcmp(q, "MTrk", 4) == 0) {
+		ulong size = ((ulong)q[4] << 24) | ((ulong)q[5] << 16) | ((ulong)q[6] << 8) | q[7];
+		q += 8;
+		if (size > (ulong)(end - q)) {
+			size = (ulong)(end - q);
+		}
+		start.push_back(q);
+		length.push_back(size);
+		q += size;
+	}
+	int count = (int)start.size();
+	if (count < 2) {
+		return 0;
+	}
+	if (threads > count) {
+		threads = count;
+	}
 
-			// calculate the current time in seconds:
-			cursec = lastsec + (curtick - lasttick) * secondsPerTick;
-			getEvent(0, i).seconds = cursec;
+	std::vector<MidiArena> arenas(m_arenaQ ? threads : 0);
+	std::vector<const uchar*> stop(count);
+	std::vector<char> okay(count);
+	std::vector<std::string> errors(count);
+	std::atomic<int> next(0);
 
-			// store the new tick to second mapping
-			value.tick = curtick;
-			value.seconds = cursec;
-			m_timemap.push_back(value);
-			lasttick   = curtick;
-			lastsec    = cursec;
+	auto worker = [&](int index) {
+		MidiArena* arena = m_arenaQ ? &arenas[index] : NULL;
+		int i;
+		while ((i = next++) < count) {
+			const uchar* r = start[i];
+			std::ostringstream err;
+			m_events[i]->reserve((int)(length[i] / 3) + 16);
+			okay[i] = readTrack(r, end, i, arena, m_trackStats[i], err);
+			stop[i] = r;
+			errors[i] = err.str();
 		}
-
-		// update the tempo if needed:
-		if (getEvent(0,i).isTempo()) {
-			secondsPerTick = getEvent(0,i).getTempoSPT(getTicksPerQuarterNote());
+	};
+
+	std::vector<std::thread> pool;
+	for (int t=1; t<threads; t++) {
+		try {
+			pool.emplace_back(worker, t);
+		} catch (const std::system_error&) {
+			break;   // the threads already started do the rest
 		}
 	}
-
-	// reset the states of the tracks or time values if necessary here:
-	if (timestate == TIME_STATE_DELTA) {
-		deltaTicks();
+	worker(0);
+	for (auto& thread : pool) {
+		thread.join();
 	}
-	if (trackstate == TRACK_STATE_SPLIT) {
-		splitTracks();
+	for (auto& arena : arenas) {
+		m_arena.merge(arena);
 	}
 
-	m_timemapvalid = 1;
-
+	// Tracks after a malformed track are not read at all, and the ones
+	// after a track with a wrong chunk size were decoded from the wrong
+	// place.
+	int accepted = 0;
+	while (accepted < count) {
+		int i = accepted++;
+		if (!okay[i]) {
+			std::cerr << errors[i];
+			m_rwstatus = false;
+			break;
+		}
+		if (i < count - 1 && stop[i] != start[i+1] - 8) {
+			break;
+		}
+	}
+	for (int j=accepted; j<count; j++) {
+		m_events[j]->clear();
+		m_trackStats[j].clear();
+	}
+	p = stop[accepted - 1];
+	return accepted;
 }
 
 
 
 //////////////////////////////
 //
-// MidiFile::extractMidiData -- Extract MIDI data from input
-//    stream.  Return value is 0 if failure; otherwise, returns 1.
+// MidiFile::extractMidiData -- Extract the MIDI message starting at p
+//    into event and advance p past it.  Running status messages are filled
+//    in with their implicit command byte.  Messages longer than
+//    MIDI_BYTES_INLINE bytes are stored in arena if it is not NULL.
+//    Return value is 0 if failure (truncated or malformed data, reported
+//    to err); otherwise, returns 1.
 //
 
-int MidiFile::extractMidiData(std::istream& input, std::vector<uchar>& array,
-	uchar& runningCommand) {
-
-	int character;
-	uchar byte;
-	array.clear();
-	int runningQ;
+int MidiFile::extractMidiData(const uchar*& p, const uchar* end,
+		MidiEvent& event, uchar& runningCommand, MidiArena* arena,
+		std::ostream& err) {
 
-	character = input.get();
-	if (character == EOF) {
-		std::cerr << "Error: unexpected end of file." << std::endl;
+	if (p >= end) {
+		err << "Error: unexpected end of file." << std::endl;
 		return 0;
-	} else {
-		byte = (uchar)character;
 	}
+	uchar byte = *p++;
 
 	if (byte < 0x80) {
-		runningQ = 1;
 		if (runningCommand == 0) {
-			std::cerr << "Error: running command with no previous command" << std::endl;
+			err << "Error: running command with no previous command" << std::endl;
 			return 0;
 		}
 		if (runningCommand >= 0xf0) {
-			std::cerr << "Error: running status not permitted with meta and sysex"
+			err << "Error: running status not permitted with meta and sysex"
 			     << " event." << std::endl;
-			std::cerr << "Byte is 0x" << std::hex << (int)byte << std::dec << std::endl;
+			err << "Byte is 0x" << std::hex << (int)byte << std::dec << std::endl;
 			return 0;
 		}
+		p--;   // the byte is the first data byte of the message
 	} else {
 		runningCommand = byte;
-		runningQ = 0;
-	}
-
-	array.push_back(runningCommand);
-	if (runningQ) {
-		array.push_back(byte);
 	}
 
+	// Number of bytes after the command byte.
+	size_t length;
+	const uchar* body = p;
 	switch (runningCommand & 0xf0) {
 		case 0x80:        // note off (2 more bytes)
 		case 0x90:        // note on (2 more bytes)
 		case 0xA0:        // aftertouch (2 more bytes)
 		case 0xB0:        // cont. controller (2 more bytes)
 		case 0xE0:        // pitch wheel (2 more bytes)
-			byte = readByte(input);
-			if (!status()) { return m_rwstatus; }
-			if (byte > 0x7f) {
-				std::cerr << "MIDI data byte too large: " << (int)byte << std::endl;
-				m_rwstatus = false; return m_rwstatus;
-			}
-			array.push_back(byte);
-			if (!runningQ) {
-				byte = readByte(input);
-				if (!status()) { return m_rwstatus; }
-				if (byte > 0x7f) {
-					std::cerr << "MIDI data byte too large: " << (int)byte << std::endl;
-					m_rwstatus = false; return m_rwstatus;
-				}
-				array.push_back(byte);
-			}
+			length = 2;
 			break;
 		case 0xC0:        // patch change (1 more byte)
 		case 0xD0:        // channel pressure (1 more byte)
-			if (!runningQ) {
-				byte = readByte(input);
-				if (!status()) { return m_rwstatus; }
-				if (byte > 0x7f) {
-					std::cerr << "MIDI data byte too large: " << (int)byte << std::endl;
-					m_rwstatus = false; return m_rwstatus;
-				}
-				array.push_back(byte);
-			}
+			length = 1;
 			break;
 		case 0xF0:
 			switch (runningCommand) {
 				case 0xff:                 // meta event
 					{
-					if (!runningQ) {
-						byte = readByte(input); // meta type
-						if (!status()) { return m_rwstatus; }
-						array.push_back(byte);
+					// meta type, VLV data length, data
+					if (p >= end) {
+						err << "Error: unexpected end of file." << std::endl;
+						return 0;
 					}
-					ulong length = 0;
-					uchar byte1 = 0;
-					uchar byte2 = 0;
-					uchar byte3 = 0;
-					uchar byte4 = 0;
-					byte1 = readByte(input);
-					if (!status()) { return m_rwstatus; }
-					array.push_back(byte1);
-					if (byte1 >= 0x80) {
-						byte2 = readByte(input);
-						if (!status()) { return m_rwstatus; }
-						array.push_back(byte2);
-						if (byte2 > 0x80) {
-							byte3 = readByte(input);
-							if (!status()) { return m_rwstatus; }
-							array.push_back(byte3);
-							if (byte3 >= 0x80) {
-								byte4 = readByte(input);
-								if (!status()) { return m_rwstatus; }
-								array.push_back(byte4);
-								if (byte4 >= 0x80) {
-									std::cerr << "Error: cannot handle large VLVs" << std::endl;
-									m_rwstatus = false; return m_rwstatus;
-								} else {
-									length = unpackVLV(byte1, byte2, byte3, byte4);
-									if (!m_rwstatus) { return m_rwstatus; }
-								}
-							} else {
-								length = unpackVLV(byte1, byte2, byte3);
-								if (!m_rwstatus) { return m_rwstatus; }
-							}
-						} else {
-							length = unpackVLV(byte1, byte2);
-							if (!m_rwstatus) { return m_rwstatus; }
-						}
-					} else {
-						length = byte1;
-					}
-					for (int j=0; j<(int)length; j++) {
-						byte = readByte(input); // meta type
-						if (!status()) { return m_rwstatus; }
-						array.push_back(byte);
+					p++;
+					bool status = true;
+					ulong datalength = readVLValue(p, end, status, err);
+					if (!status) { return 0; }
+					if (datalength > (ulong)(end - p)) {
+						err << "Error: meta message runs past end of file." << std::endl;
+						return 0;
 					}
+					length = (size_t)(p - body) + datalength;
 					}
 					break;
 
@@ -3015,30 +3115,63 @@ int MidiFile::extractMidiData(std::istream& input, std::vector<uchar>& array,
 				// 0xf7 byte at the start of the message is not part of the
 				// outgoing raw MIDI bytes, but is kept in the MidiFile message
 				// to indicate a raw MIDI byte message (typically a partial
-				// system exclusive message).
+				// system exclusive message).  The VLV length is not stored.
 				case 0xf7:   // Raw bytes. 0xf7 is not part of the raw
 				             // bytes, but are included to indicate
 				             // that this is a raw byte message.
 				case 0xf0:   // System Exclusive message
 					{         // (complete, or start of message).
-					int length = (int)readVLValue(input);
-					for (int i=0; i<length; i++) {
-						byte = readByte(input);
-						if (!status()) { return m_rwstatus; }
-						array.push_back(byte);
+					bool status = true;
+					ulong datalength = readVLValue(p, end, status, err);
+					if (!status) { return 0; }
+					if (datalength > (ulong)(end - p)) {
+						err << "Error: system exclusive message runs past end of file."
+						     << std::endl;
+						return 0;
 					}
+					body = p;
+					length = datalength;
 					}
 					break;
 
-				// other "F" MIDI commands are not expected, but can be
-				// handled here if they exist.
+				// other "F" MIDI commands are not expected.
+				default:
+					err << "Error: unexpected command byte 0x" << std::hex
+					     << (int)runningCommand << std::dec << std::endl;
+					return 0;
 			}
 			break;
 		default:
-			std::cout << "Error reading midifile" << std::endl;
-			std::cout << "Command byte was " << (int)runningCommand << std::endl;
+			err << "Error reading midifile" << std::endl;
+			err << "Command byte was " << (int)runningCommand << std::endl;
+			return 0;
+	}
+
+	if ((runningCommand & 0xf0) != 0xf0) {
+		if ((size_t)(end - p) < length) {
+			err << "Error: unexpected end of file." << std::endl;
 			return 0;
+		}
+		for (size_t i=0; i<length; i++) {
+			if (p[i] > 0x7f) {
+				err << "MIDI data byte too large: " << (int)p[i] << std::endl;
+				return 0;
+			}
+		}
+	}
+
+	// Short messages are stored inside the event; longer ones take arena
+	// memory in arena mode.
+	if (arena && length + 1 > MIDI_BYTES_INLINE) {
+		event.setExternal(arena->newBytes(length + 1), length + 1);
+	} else {
+		event.resize(length + 1);
+	}
+	event[0] = runningCommand;
+	if (length > 0) {
+		std::copy(body, body + length, event.begin() + 1);
 	}
+	p = body + length;
 	return 1;
 }
 
@@ -3046,28 +3179,31 @@ int MidiFile::extractMidiData(std::istream& input, std::vector<uchar>& array,
 
 //////////////////////////////
 //
-// MidiFile::readVLValue -- The VLV value is expected to be unpacked into
-//   a 4-byte integer no greater than 0x0fffFFFF, so a VLV value up to
-//   4-bytes in size (FF FF FF 7F) will only be considered.  Longer
-//   VLV values are not allowed in standard MIDI files, so the extract
-//   delta time would be truncated and the extra byte(s) will be parsed
-//   incorrectly as a MIDI command.
+// MidiFile::readVLValue -- Decode the VLV value at p and advance p past
+//   it.  The VLV value is expected to be unpacked into a 4-byte integer
+//   no greater than 0x0fffFFFF, so a VLV value up to 4-bytes in size
+//   (FF FF FF 7F) is allowed.  Longer values or a value cut off by the
+//   end of the data are reported to err, set status to false and return 0.
 //
 
-ulong MidiFile::readVLValue(std::istream& input) {
-	uchar b[5] = {0};
-
-    for (uchar &item : b) {
-            item = readByte(input);
-            if (!status()) {
-                    return m_rwstatus;
-            }
-            if (item < 0x80) {
-                    break;
-            }
-    }
-
-    return unpackVLV(b[0], b[1], b[2], b[3], b[4]);
+ulong MidiFile::readVLValue(const uchar*& p, const uchar* end, bool& status,
+		std::ostream& err) {
+	ulong output = 0;
+	for (int i=0; i<4; i++) {
+		if (p >= end) {
+			err << "Error: unexpected end of file." << std::endl;
+			status = false;
+			return 0;
+		}
+		uchar byte = *p++;
+		output = (output << 7) | (byte & 0x7f);
+		if (byte < 0x80) {
+			return output;
+		}
+	}
+	err << "VLV number is too large" << std::endl;
+	status = false;
+	return 0;
 }
 
 
@@ -3155,49 +3291,12 @@ void MidiFile::clear_no_deallocate(void) {
 	m_events.resize(1);
 	m_events[0] = new MidiEventList;
 	m_timemapvalid=0;
-	m_timemap.clear();
+	m_tempomap.clear();
 	// m_events.resize(0);   // causes a memory leak [20150205 Jorden Thatcher]
 }
 
 
 
-//////////////////////////////
-//
-// MidiFile::ticksearch -- for finding a tick entry in the time map.
-//
-
-int MidiFile::ticksearch(const void* A, const void* B) {
-	_TickTime& a = *((_TickTime*)A);
-	_TickTime& b = *((_TickTime*)B);
-
-	if (a.tick < b.tick) {
-		return -1;
-	} else if (a.tick > b.tick) {
-		return 1;
-	}
-	return 0;
-}
-
-
-
-//////////////////////////////
-//
-// MidiFile::secondsearch -- for finding a second entry in the time map.
-//
-
-int MidiFile::secondsearch(const void* A, const void* B) {
-	_TickTime& a = *((_TickTime*)A);
-	_TickTime& b = *((_TickTime*)B);
-
-	if (a.seconds < b.seconds) {
-		return -1;
-	} else if (a.seconds > b.seconds) {
-		return 1;
-	}
-	return 0;
-}
-
-
 ///////////////////////////////////////////////////////////////////////////
 //
 // Static functions:
@@ -3545,6 +3644,93 @@ std::string MidiFile::base64Decode(const std::string& input) {
 
 
 
+///////////////////////////////////////////////////////////////////////////
+//
+// MidiTrackStats functions --
+//
+
+//////////////////////////////
+//
+// MidiTrackStats::MidiTrackStats -- Constructor.
+//
+
+MidiTrackStats::MidiTrackStats(void) {
+	clear();
+}
+
+
+
+//////////////////////////////
+//
+// MidiTrackStats::clear -- Set all counts to zero.
+//
+
+void MidiTrackStats::clear(void) {
+	events   = 0;
+	noteOns  = 0;
+	noteOffs = 0;
+	metas    = 0;
+	sysex    = 0;
+	memset(channelNoteOns, 0, sizeof(channelNoteOns));
+	memset(velocity, 0, sizeof(velocity));
+	channelMask = 0;
+}
+
+
+
+//////////////////////////////
+//
+// MidiTrackStats::addEvent -- Count a message.  Note-ons and note-offs
+//    are classified as by MidiMessage::isNoteOn() and isNoteOff().
+//
+
+void MidiTrackStats::addEvent(const MidiMessage& message) {
+	events++;
+	if (message.empty()) {
+		return;
+	}
+	int command = message[0] & 0xf0;
+	if (message[0] == 0xff) {
+		metas++;
+	} else if (command == 0xf0) {
+		sysex++;
+	} else if (command >= 0x80) {
+		int channel = message[0] & 0x0f;
+		channelMask |= (unsigned short)(1 << channel);
+		if (message.isNoteOn()) {
+			noteOns++;
+			channelNoteOns[channel]++;
+			velocity[message[2]]++;
+		} else if (message.isNoteOff()) {
+			noteOffs++;
+		}
+	}
+}
+
+
+
+//////////////////////////////
+//
+// MidiTrackStats::add -- Add the counts of another track.
+//
+
+void MidiTrackStats::add(const MidiTrackStats& other) {
+	events   += other.events;
+	noteOns  += other.noteOns;
+	noteOffs += other.noteOffs;
+	metas    += other.metas;
+	sysex    += other.sysex;
+	for (int i=0; i<16; i++) {
+		channelNoteOns[i] += other.channelNoteOns[i];
+	}
+	for (int i=0; i<128; i++) {
+		velocity[i] += other.velocity[i];
+	}
+	channelMask |= other.channelMask;
+}
+
+
+
 } // end namespace smf
 
 ///////////////////////////////////////////////////////////////////////////
@@ -28,45 +28,45 @@ namespace smf {
 // MidiMessage::MidiMessage -- Constructor.
 //
 
-MidiMessage::MidiMessage(void) : vector<uchar>() {
+MidiMessage::MidiMessage(void) : MidiBytes() {
 	// do nothing
 }
 
 
-MidiMessage::MidiMessage(int command) : vector<uchar>(1, (uchar)command) {
+MidiMessage::MidiMessage(int command) : MidiBytes(1, (uchar)command) {
 	// do nothing
 }
 
 
-MidiMessage::MidiMessage(int command, int p1) : vector<uchar>(2) {
+MidiMessage::MidiMessage(int command, int p1) : MidiBytes(2) {
 	(*this)[0] = (uchar)command;
 	(*this)[1] = (uchar)p1;
 }
 
 
-MidiMessage::MidiMessage(int command, int p1, int p2) : vector<uchar>(3) {
+MidiMessage::MidiMessage(int command, int p1, int p2) : MidiBytes(3) {
 	(*this)[0] = (uchar)command;
 	(*this)[1] = (uchar)p1;
 	(*this)[2] = (uchar)p2;
 }
 
 
-MidiMessage::MidiMessage(const MidiMessage& message) : vector<uchar>() {
+MidiMessage::MidiMessage(const MidiMessage& message) : MidiBytes() {
 	(*this) = message;
 }
 
 
-MidiMessage::MidiMessage(const std::vector<uchar>& message) : vector<uchar>() {
+MidiMessage::MidiMessage(const std::vector<uchar>& message) : MidiBytes() {
 	setMessage(message);
 }
 
 
-MidiMessage::MidiMessage(const std::vector<char>& message) : vector<uchar>() {
+MidiMessage::MidiMessage(const std::vector<char>& message) : MidiBytes() {
 	setMessage(message);
 }
 
 
-MidiMessage::MidiMessage(const std::vector<int>& message) : vector<uchar>() {
+MidiMessage::MidiMessage(const std::vector<int>& message) : MidiBytes() {
 	setMessage(message);
 }
 
@@ -92,15 +92,12 @@ MidiMessage& MidiMessage::operator=(const MidiMessage& message) {
 	if (this == &message) {
 		return *this;
 	}
-	std::vector<uchar>::operator=(static_cast<const std::vector<uchar> &>(message));
+	MidiBytes::operator=(message);
 	return *this;
 }
 
 
 MidiMessage& MidiMessage::operator=(const std::vector<uchar>& bytes) {
-	if (this == &bytes) {
-		return *this;
-	}
 	setMessage(bytes);
 	return *this;
 }
@@ -327,7 +324,7 @@ bool MidiMessage::isMetaMessage(void) const {
 
 bool MidiMessage::isNoteOff(void) const {
 	const MidiMessage& message = *this;
-	const vector<uchar>& chars = message;
+	const MidiBytes& chars = message;
 	if (message.size() != 3) {
 		return false;
 	} else if ((chars[0] & 0xf0) == 0x80) {
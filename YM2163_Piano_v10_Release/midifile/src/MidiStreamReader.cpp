@@ -0,0 +1,537 @@
+//
+// Creation Date: Fri Oct 16 2026
+// Filename:      midifile/src/MidiStreamReader.cpp
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// Description:   Incremental reader for Standard MIDI Files (see
+//                MidiStreamReader.h).
+//
+
+#include "MidiStreamReader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace smf {
+
+// Messages scanEndSeconds() walks between checks of its cancel flag.
+#define SCAN_CANCEL_EVENTS 65536
+
+
+//////////////////////////////
+//
+// MidiStreamReader::MidiStreamReader -- Constructor.
+//
+
+MidiStreamReader::MidiStreamReader(void) {
+	// do nothing
+}
+
+
+
+//////////////////////////////
+//
+// MidiStreamReader::~MidiStreamReader -- Deconstructor.
+//
+
+MidiStreamReader::~MidiStreamReader() {
+	close();
+}
+
+
+
+//////////////////////////////
+//
+// MidiStreamReader::open -- Open a Standard MIDI File for reading.
+//    Returns false if the file cannot be read, is not a Standard MIDI
+//    File, or its track chunks are not where their sizes say.
+//
+
+bool MidiStreamReader::open(const std::string& filename) {
+	close();
+	if (!m_view.open(filename)) {
+		std::cerr << "Error: could not open file " << filename << std::endl;
+		return false;
+	}
+	return readHeader(m_view.data(), m_view.size());
+}
+
+
+#ifdef _WIN32
+
+bool MidiStreamReader::open(const std::wstring& filename) {
+	close();
+	if (!m_view.open(filename)) {
+		std::cerr << "Error: could not open file" << std::endl;
+		return false;
+	}
+	return readHeader(m_view.data(), m_view.size());
+}
+
+#endif
+
+
+bool MidiStreamReader::open(const uchar* data, size_t size) {
+	close();
+	return readHeader(data, size);
+}
+
+
+
+//////////////////////////////
+//
+// MidiStreamReader::close -- Stop reading and release the file.
+//
+
+void MidiStreamReader::close(void) {
+	m_view.close();
+	m_tracks.clear();
+	m_start.clear();
+	m_heap.clear();
+	m_stats.clear();
+	m_ticksPerQuarterNote = 120;
+	m_openQ  = false;
+	m_status = true;
+	m_segmentTick    = 0;
+	m_segmentSeconds = 0.0;
+	m_secondsPerTick = 0.5 / 120;
+	m_seconds        = 0.0;
+}
+
+
+
+//////////////////////////////
+//
+// MidiStreamReader::readEvent -- Take the earliest waiting event of all
+//    tracks (for equal ticks the one in the lowest track, which is the
+//    file order that MidiFile::joinTracks() keeps), give it its time from
+//    the tempo changes read before it, and decode the next event of its
+//    track.
+//
+
+bool MidiStreamReader::readEvent(MidiEvent& event) {
+	if (m_heap.empty()) {
+		return false;
+	}
+	std::pop_heap(m_heap.begin(), m_heap.end(),
+			std::greater<unsigned long long>());
+	int track = (int)(m_heap.back() & 0xffffffffu);
+	m_heap.pop_back();
+
+	_StreamTrack& stream = m_tracks[track];
+	event.swap(stream.event);
+	event.tick  = stream.tick;
+	event.track = track;
+
+	// Same arithmetic as MidiTempoMap::build() and getSecondsAtTick(), so
+	// the times are identical to those of MidiFile::doTimeAnalysis().
+	if (event.isTempo()) {
+		if (stream.tick != m_segmentTick) {
+			m_segmentSeconds = m_segmentSeconds + (stream.tick - m_segmentTick) * m_secondsPerTick;
+			m_segmentTick = stream.tick;
+		}
+		m_secondsPerTick = event.getTempoSPT(m_ticksPerQuarterNote);
+	}
+	m_seconds = m_segmentSeconds + ((double)stream.tick - m_segmentTick) * m_secondsPerTick;
+	event.seconds = m_seconds;
+	m_stats[track].addEvent(event);
+
+	if (event.isEndOfTrack()) {
+		// Anything after the end-of-track message is ignored, as when
+		// reading the whole file.
+		stream.p = stream.end;
+	} else if (decodeNext(track)) {
+		push(track);
+	} else if (!m_status) {
+		// No events past a data error.
+		m_heap.clear();
+	}
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// MidiStreamReader::isOpen -- True if a file was opened successfully.
+//
+
+bool MidiStreamReader::isOpen(void) const {
+	return m_openQ;
+}
+
+
+
+//////////////////////////////
+//
+// MidiStreamReader::getStatus -- False after an error in the file.
+//
+
+bool MidiStreamReader::getStatus(void) const {
+	return m_status;
+}
+
+
+
+//////////////////////////////
+//
+// MidiStreamReader::getTrackCount -- Number of tracks in the file.
+//
+
+int MidiStreamReader::getTrackCount(void) const {
+	return (int)m_tracks.size();
+}
+
+
+
+//////////////////////////////
+//
+// MidiStreamReader::getTicksPerQuarterNote -- Tick resolution from the
+//    file header (frames per second times subframes for SMPTE files, as
+//    in MidiFile).
+//
+
+int MidiStreamReader::getTicksPerQuarterNote(void) const {
+	return m_ticksPerQuarterNote;
+}
+
+
+
+//////////////////////////////
+//
+// MidiStreamReader::getSeconds -- Time of the last event read.  All
+//    events still to be read are at this time or later.
+//
+
+double MidiStreamReader::getSeconds(void) const {
+	return m_seconds;
+}
+
+
+
+//////////////////////////////
+//
+// MidiStreamReader::getNextTick -- Tick of the event that readEvent() will
+//    return next, so that a caller can stop between ticks.
+//
+
+int MidiStreamReader::getNextTick(void) const {
+	if (m_heap.empty()) {
+		return -1;
+	}
+	return (int)((unsigned int)(m_heap.front() >> 32) ^ 0x80000000u);
+}
+
+
+
+//////////////////////////////
+//
+// MidiStreamReader::scanEndSeconds -- Length of the song without decoding
+//    it: each track is walked from its start, skipping message data by
+//    the message lengths, for the tick of its last note, controller or
+//    program change and for its tempo changes.  The tempo changes are then
+//    applied in the order readEvent() gives them (by tick, then track), so
+//    the result is the time readEvent() gives that event.  cancel is
+//    checked every SCAN_CANCEL_EVENTS messages.
+//
+
+double MidiStreamReader::scanEndSeconds(const std::atomic<bool>* cancel) const {
+	std::vector<std::pair<int, double>> tempos;   // tick, seconds per tick
+	int endtick = 0;
+	bool status = true;
+	std::ostringstream err;   // errors are reported when the track is read
+	int untilCheck = SCAN_CANCEL_EVENTS;
+
+	for (int i=0; i<(int)m_tracks.size(); i++) {
+		const uchar* p   = m_start[i];
+		const uchar* end = m_tracks[i].end;
+		uchar runningCommand = 0;
+		int tick = 0;
+		while (p < end) {
+			if (--untilCheck == 0) {
+				if (cancel && *cancel) {
+					return -1.0;
+				}
+				untilCheck = SCAN_CANCEL_EVENTS;
+			}
+			tick += MidiFile::readVLValue(p, end, status, err);
+			if (!status || p >= end) {
+				break;
+			}
+			const uchar* message = p;
+			uchar command = runningCommand;
+			if (*p >= 0x80) {
+				command = *p++;
+			} else if (runningCommand == 0 || runningCommand >= 0xf0) {
+				break;
+			}
+			size_t length = 0;
+			switch (command & 0xf0) {
+				case 0x80: case 0x90: case 0xA0: case 0xB0: case 0xE0:
+					length = 2;
+					break;
+				case 0xC0: case 0xD0:
+					length = 1;
+					break;
+				default:
+					if (command == 0xff) {
+						if (p >= end) {
+							status = false;
+							break;
+						}
+						uchar type = *p++;
+						length = MidiFile::readVLValue(p, end, status, err);
+						if (type == 0x2f) {
+							p = end;   // nothing after the end-of-track message is read
+							length = 0;
+						} else if (type == 0x51 && status) {
+							MidiEvent event;
+							uchar tempoCommand = runningCommand;
+							if (MidiFile::extractMidiData(message, end, event, tempoCommand,
+									NULL, err)) {
+								tempos.push_back(std::make_pair(tick,
+										event.getTempoSPT(m_ticksPerQuarterNote)));
+								endtick = std::max(endtick, tick);
+							}
+						}
+					} else if (command == 0xf0 || command == 0xf7) {
+						length = MidiFile::readVLValue(p, end, status, err);
+					} else {
+						status = false;
+					}
+					break;
+			}
+			if (!status || length > (size_t)(end - p)) {
+				break;
+			}
+			switch (command & 0xf0) {
+				case 0x80: case 0x90: case 0xB0: case 0xC0:
+					endtick = std::max(endtick, tick);
+					break;
+			}
+			p += length;
+			runningCommand = command;
+		}
+		status = true;
+	}
+
+	// Same arithmetic as readEvent()
+	std::stable_sort(tempos.begin(), tempos.end(),
+			[](const std::pair<int, double>& a, const std::pair<int, double>& b) {
+				return a.first < b.first;
+			});
+	int timetpq = m_ticksPerQuarterNote > 0 ? m_ticksPerQuarterNote : 120;
+	int segmentTick = 0;
+	double segmentSeconds = 0.0;
+	double secondsPerTick = 60.0 / (120.0 * timetpq);
+	for (const auto& tempo : tempos) {
+		if (tempo.first != segmentTick) {
+			segmentSeconds = segmentSeconds + (tempo.first - segmentTick) * secondsPerTick;
+			segmentTick = tempo.first;
+		}
+		secondsPerTick = tempo.second;
+	}
+	return segmentSeconds + ((double)endtick - segmentTick) * secondsPerTick;
+}
+
+
+
+//////////////////////////////
+//
+// MidiStreamReader::getBytesRead -- Bytes of track data decoded so far.
+//
+
+size_t MidiStreamReader::getBytesRead(void) const {
+	size_t total = 0;
+	for (int i=0; i<(int)m_tracks.size(); i++) {
+		total += m_tracks[i].p - m_start[i];
+	}
+	return total;
+}
+
+
+
+//////////////////////////////
+//
+// MidiStreamReader::getTrackBytes -- Bytes of track data in the file.
+//
+
+size_t MidiStreamReader::getTrackBytes(void) const {
+	size_t total = 0;
+	for (int i=0; i<(int)m_tracks.size(); i++) {
+		total += m_tracks[i].end - m_start[i];
+	}
+	return total;
+}
+
+
+
+//////////////////////////////
+//
+// MidiStreamReader::getTrackStats -- Counts for the events of a track
+//    read so far.
+//
+
+const MidiTrackStats& MidiStreamReader::getTrackStats(int track) const {
+	return m_stats.at(track);
+}
+
+
+
+//////////////////////////////
+//
+// MidiStreamReader::getTotalStats -- Sum of the counts of all tracks.
+//
+
+MidiTrackStats MidiStreamReader::getTotalStats(void) const {
+	MidiTrackStats total;
+	for (const auto& stats : m_stats) {
+		total.add(stats);
+	}
+	return total;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////
+//
+// private functions
+//
+
+//////////////////////////////
+//
+// MidiStreamReader::readHeader -- Check the MThd header (with the same
+//    rules as MidiFile::readSmf()), find the track chunks from their
+//    sizes and decode the first event of each track.
+//
+
+bool MidiStreamReader::readHeader(const uchar* data, size_t size) {
+	const uchar* p   = data;
+	const uchar* end = data + size;
+	m_status = false;
+
+	if (size < 14 || memcmp(p, "MThd", 4) != 0) {
+		std::cerr << "Error: not a Standard MIDI File" << std::endl;
+		return false;
+	}
+	ulong headersize = ((ulong)p[4] << 24) | ((ulong)p[5] << 16) | ((ulong)p[6] << 8) | p[7];
+	int type   = (p[8] << 8) | p[9];
+	int tracks = (p[10] << 8) | p[11];
+	int tpq    = (p[12] << 8) | p[13];
+	p += 14;
+	if (headersize != 6) {
+		std::cerr << "Error: the header size is " << headersize << " bytes" << std::endl;
+		return false;
+	}
+	if (type > 1) {
+		std::cerr << "Error: cannot handle a type-" << type << " MIDI file" << std::endl;
+		return false;
+	}
+	if (type == 0 && tracks != 1) {
+		std::cerr << "Error: Type 0 MIDI file can only contain one track" << std::endl;
+		return false;
+	}
+	if (tpq >= 0x8000) {
+		int framespersecond = 255 - ((tpq >> 8) & 0x00ff) + 1;
+		int subframes       = tpq & 0x00ff;
+		m_ticksPerQuarterNote = framespersecond * subframes;
+	} else {
+		m_ticksPerQuarterNote = tpq;
+	}
+	int timetpq = m_ticksPerQuarterNote > 0 ? m_ticksPerQuarterNote : 120;
+	m_secondsPerTick = 60.0 / (120.0 * timetpq);
+
+	m_tracks.resize(tracks);
+	m_start.resize(tracks);
+	m_stats.assign(tracks, MidiTrackStats());
+	for (int i=0; i<tracks; i++) {
+		if (end - p < 8 || memcmp(p, "MTrk", 4) != 0) {
+			std::cerr << "Error: expecting 'MTrk' at start of track " << i + 1 << std::endl;
+			m_tracks.clear();
+			m_start.clear();
+			return false;
+		}
+		ulong length = ((ulong)p[4] << 24) | ((ulong)p[5] << 16) | ((ulong)p[6] << 8) | p[7];
+		p += 8;
+		if (length > (ulong)(end - p)) {
+			length = (ulong)(end - p);
+		}
+		_StreamTrack& stream = m_tracks[i];
+		stream.p   = p;
+		stream.end = p + length;
+		stream.runningCommand = 0;
+		stream.tick = 0;
+		m_start[i] = p;
+		p += length;
+	}
+
+	m_status = true;
+	m_openQ  = true;
+	m_heap.reserve(tracks);
+	for (int i=0; i<tracks; i++) {
+		if (decodeNext(i)) {
+			push(i);
+		} else if (!m_status) {
+			m_heap.clear();
+			break;
+		}
+	}
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// MidiStreamReader::decodeNext -- Decode the next event of a track into
+//    its waiting event, with the MidiFile parsing functions (so running
+//    status, meta and sysex messages are handled identically).  Returns
+//    false at the end of the track data or on an error (m_status is then
+//    false).
+//
+
+bool MidiStreamReader::decodeNext(int track) {
+	_StreamTrack& stream = m_tracks[track];
+	if (stream.p >= stream.end) {
+		return false;
+	}
+	ulong delta = MidiFile::readVLValue(stream.p, stream.end, m_status, std::cerr);
+	if (!m_status) {
+		return false;
+	}
+	if (!MidiFile::extractMidiData(stream.p, stream.end, stream.event,
+			stream.runningCommand, NULL, std::cerr)) {
+		m_status = false;
+		return false;
+	}
+	stream.tick += delta;
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// MidiStreamReader::push -- Add a track with a waiting event to the heap.
+//
+
+void MidiStreamReader::push(int track) {
+	unsigned long long key =
+			((unsigned long long)((unsigned int)m_tracks[track].tick ^ 0x80000000u) << 32)
+			| (unsigned int)track;
+	m_heap.push_back(key);
+	std::push_heap(m_heap.begin(), m_heap.end(), std::greater<unsigned long long>());
+}
+
+
+} // end of namespace smf
+
+
+
@@ -0,0 +1,241 @@
+//
+// Creation Date: Fri Oct 16 2026
+// Filename:      midifile/src/MidiTempoMap.cpp
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// Description:   Tempo segment index for a MidiFile (see MidiTempoMap.h).
+//
+
+#include "MidiTempoMap.h"
+#include "MidiFile.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+
+namespace smf {
+
+
+//////////////////////////////
+//
+// MidiTempoMap::MidiTempoMap -- Constructor.
+//
+
+MidiTempoMap::MidiTempoMap(void) {
+	clear();
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::clear -- Reset to a single 120 bpm segment.
+//
+
+void MidiTempoMap::clear(void) {
+	m_segments.clear();
+	m_tpq = 120;
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::isValid -- True if build() has been called.
+//
+
+bool MidiTempoMap::isValid(void) const {
+	return !m_segments.empty();
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::build -- Collect the tempo changes of all tracks (in
+//    tick order; for several changes at the same tick the one in the
+//    later track/position wins, as after joinTracks()) and compute the
+//    cumulative time at the start of each segment.  The MidiFile is
+//    not modified.
+//
+
+void MidiTempoMap::build(const MidiFile& midifile) {
+	m_segments.clear();
+	m_tpq = midifile.getTicksPerQuarterNote();
+	if (m_tpq <= 0) {
+		m_tpq = 120;
+	}
+
+	// (absolute tick, seconds per tick), in file order
+	std::vector<std::pair<int, double>> changes;
+	bool delta = midifile.isDeltaTicks();
+	for (int i=0; i<midifile.getTrackCount(); i++) {
+		const MidiEventList& track = midifile[i];
+		int tick = 0;
+		for (int j=0; j<track.size(); j++) {
+			tick = delta ? tick + track[j].tick : track[j].tick;
+			if (track[j].isTempo()) {
+				changes.emplace_back(tick, track[j].getTempoSPT(m_tpq));
+			}
+		}
+	}
+	std::stable_sort(changes.begin(), changes.end(),
+		[](const std::pair<int, double>& a, const std::pair<int, double>& b) {
+			return a.first < b.first;
+		});
+
+	_TempoSegment segment;
+	segment.tick = 0;
+	segment.seconds = 0.0;
+	segment.secondsPerTick = 60.0 / (120.0 * m_tpq);
+	m_segments.push_back(segment);
+
+	for (const auto& change : changes) {
+		_TempoSegment& last = m_segments.back();
+		if (change.first == last.tick) {
+			last.secondsPerTick = change.second;
+			continue;
+		}
+		segment.tick = change.first;
+		segment.seconds = last.seconds + (change.first - last.tick) * last.secondsPerTick;
+		segment.secondsPerTick = change.second;
+		m_segments.push_back(segment);
+	}
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::getSecondsAtTick -- Time of a tick value.  Ticks past
+//    the last tempo change continue at the last tempo.
+//
+
+double MidiTempoMap::getSecondsAtTick(double tick) const {
+	if (m_segments.empty()) {
+		return tick * 60.0 / (120.0 * m_tpq);
+	}
+	const _TempoSegment& segment = m_segments[findSegmentAtTick(tick)];
+	return segment.seconds + (tick - segment.tick) * segment.secondsPerTick;
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::getTickAtSeconds -- Tick position (fractional) at a time.
+//
+
+double MidiTempoMap::getTickAtSeconds(double seconds) const {
+	if (m_segments.empty()) {
+		return seconds * (120.0 * m_tpq) / 60.0;
+	}
+	const _TempoSegment& segment = m_segments[findSegmentAtSeconds(seconds)];
+	return segment.tick + (seconds - segment.seconds) / segment.secondsPerTick;
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::getMicrosecondsAtTick -- Same as getSecondsAtTick() in
+//    microseconds.
+//
+
+double MidiTempoMap::getMicrosecondsAtTick(double tick) const {
+	return getSecondsAtTick(tick) * 1000000.0;
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::getTickAtMicroseconds -- Same as getTickAtSeconds() for
+//    a time in microseconds.
+//
+
+double MidiTempoMap::getTickAtMicroseconds(double micros) const {
+	return getTickAtSeconds(micros / 1000000.0);
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::getTempoMicrosecondsAtTick -- Microseconds per quarter
+//    note in effect at the given tick.
+//
+
+double MidiTempoMap::getTempoMicrosecondsAtTick(double tick) const {
+	if (m_segments.empty()) {
+		return 500000.0;
+	}
+	return m_segments[findSegmentAtTick(tick)].secondsPerTick * m_tpq * 1000000.0;
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::getSegmentCount -- Number of tempo segments.
+//
+
+int MidiTempoMap::getSegmentCount(void) const {
+	return (int)m_segments.size();
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::getSegment -- Access a tempo segment.
+//
+
+const _TempoSegment& MidiTempoMap::getSegment(int index) const {
+	return m_segments[index];
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////
+//
+// private functions
+//
+
+//////////////////////////////
+//
+// MidiTempoMap::findSegmentAtTick -- Index of the last segment starting
+//    at or before tick (0 for negative ticks).
+//
+
+int MidiTempoMap::findSegmentAtTick(double tick) const {
+	auto it = std::upper_bound(m_segments.begin(), m_segments.end(), tick,
+		[](double value, const _TempoSegment& segment) {
+			return value < segment.tick;
+		});
+	return it == m_segments.begin() ? 0 : (int)(it - m_segments.begin()) - 1;
+}
+
+
+
+//////////////////////////////
+//
+// MidiTempoMap::findSegmentAtSeconds -- Index of the last segment
+//    starting at or before the given time (0 for negative times).
+//
+
+int MidiTempoMap::findSegmentAtSeconds(double seconds) const {
+	auto it = std::upper_bound(m_segments.begin(), m_segments.end(), seconds,
+		[](double value, const _TempoSegment& segment) {
+			return value < segment.seconds;
+		});
+	return it == m_segments.begin() ? 0 : (int)(it - m_segments.begin()) - 1;
+}
+
+
+} // end of namespace smf
+
+
+
@@ -0,0 +1,147 @@
+//
+// Creation Date: Fri Oct 16 2026
+// Filename:      midifile/src/SmfFileView.cpp
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// Description:   Read-only view of a whole file (see SmfFileView.h).
+//
+
+#include "SmfFileView.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+
+namespace smf {
+
+
+#ifdef _WIN32
+
+//////////////////////////////
+//
+// SmfFileView::open -- Map a file.  An empty file gives an empty view.
+//
+
+bool SmfFileView::open(const std::string& filename) {
+	close();
+	return map(CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+			OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL));
+}
+
+
+bool SmfFileView::open(const std::wstring& filename) {
+	close();
+	return map(CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+			OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL));
+}
+
+
+
+//////////////////////////////
+//
+// SmfFileView::map -- Map the whole file and close the file handle
+//    (the mapping keeps its own reference).
+//
+
+bool SmfFileView::map(void* file) {
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER filesize;
+	if (!GetFileSizeEx((HANDLE)file, &filesize) || (ULONGLONG)filesize.QuadPart > (ULONGLONG)(size_t)-1) {
+		CloseHandle((HANDLE)file);
+		return false;
+	}
+	if (filesize.QuadPart == 0) {
+		// Empty files cannot be mapped; the readers report them as truncated.
+		CloseHandle((HANDLE)file);
+		return true;
+	}
+	// The mapping keeps its own reference to the file.
+	m_mapping = CreateFileMappingW((HANDLE)file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle((HANDLE)file);
+	if (m_mapping == NULL) {
+		return false;
+	}
+	m_data = (const uchar*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (m_data == NULL) {
+		CloseHandle((HANDLE)m_mapping);
+		m_mapping = NULL;
+		return false;
+	}
+	m_size = (size_t)filesize.QuadPart;
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// SmfFileView::close -- Unmap the file.
+//
+
+void SmfFileView::close(void) {
+	if (m_mapping != NULL) {
+		UnmapViewOfFile(m_data);
+		CloseHandle((HANDLE)m_mapping);
+		m_mapping = NULL;
+	}
+	m_data = NULL;
+	m_size = 0;
+}
+
+#else
+
+//////////////////////////////
+//
+// SmfFileView::open -- Read the whole file into memory.
+//
+
+bool SmfFileView::open(const std::string& filename) {
+	close();
+	std::ifstream input(filename.c_str(), std::ios::binary | std::ios::in);
+	if (!input.is_open()) {
+		return false;
+	}
+	input.seekg(0, std::ios::end);
+	std::streamoff filesize = input.tellg();
+	if (filesize < 0) {
+		return false;
+	}
+	input.seekg(0, std::ios::beg);
+	m_buffer.resize((size_t)filesize);
+	if (filesize > 0 && !input.read((char*)m_buffer.data(), filesize)) {
+		m_buffer.clear();
+		return false;
+	}
+	m_data = m_buffer.data();
+	m_size = m_buffer.size();
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// SmfFileView::close -- Release the file contents.
+//
+
+void SmfFileView::close(void) {
+	m_buffer.clear();
+	m_data = NULL;
+	m_size = 0;
+}
+
+#endif
+
+
+} // end of namespace smf
+
+
+
@@ -0,0 +1,624 @@
+// SPFM Emulator - stand-in SPFM Light + YM2163 for hardware-free testing (Linux/POSIX)
+// Decodes the SPFM packet stream the piano app sends and keeps per-slot register
+// state with a timestamp for every write. The stream comes from either:
+//
+//   ./spfm_emulator --replay out.spfm [--control /tmp/spfm.ctl] [--verbose]
+//       A capture file recorded by the piano with --transport=capture:out.spfm
+//       (the piano is a Windows program; copy the file over). Each write call
+//       of the piano's output thread keeps the timestamp it was recorded with.
+//
+//   ./spfm_emulator [--link /tmp/spfm] [--baud 1500000] [--control /tmp/spfm.ctl] [--verbose]
+//       A pseudo-terminal, for a sender running on this machine that writes the
+//       SPFM stream to a tty (spfm_transport's serial backend built for POSIX:
+//       spfm_transport_create("serial:/tmp/spfm")). The Windows piano cannot open
+//       it: its serial backend only opens COM ports.
+//
+// Timing resolution: writes are timestamped when their bytes are read, so all
+// writes that arrive in one read() of the pty (or one recorded write call of a
+// capture) share a timestamp, with gaps of 0 between them. Throughput is
+// measured over the span from the first to the last chunk (span_us is 0 when
+// everything arrived in one chunk), and latency only to chunk granularity; the
+// "chunks" count in stats shows how coarse that is.
+//
+// Protocol (see write_melody_cmd_chip / ym2163_init):
+//   {slot, 0x80, byte}    byte >= 0x80 latches a register address on that slot,
+//                         byte <  0x80 writes data to the latched register
+//   {0x00, 0x00, 0xFE, 0x00}  reset all slots
+//
+// Query interface: one command per line on stdin, or on the UNIX socket given
+// with --control (one reply block per command, terminated by a line "ok" or
+// "error: ..."). Commands:
+//   regs [slot]          register dump (0x80-0x9D), "--" = never written
+//   reg <slot> <addr>    value, write count, last write time
+//   voices [slot]        decoded melody channels and rhythm state
+//   log [n]              last n writes (default 32)
+//   stats                packet/write counters, throughput, inter-write gaps
+//   now                  current CLOCK_MONOTONIC time in us (to correlate with the sender)
+//   clear                clear statistics and write log (register state kept)
+//   reset                clear register state as if a reset packet was received
+//   quit
+// Times are microseconds since emulator start; "mono" columns are absolute
+// CLOCK_MONOTONIC microseconds.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <string>
+#include <vector>
+
+#include "spfm_transport.h"  // SPFM_CAPTURE_MAGIC
+
+// ===== Constants =====
+
+#define SLOT_COUNT     4
+#define REG_FIRST      0x80
+#define REG_LAST       0x9D
+#define REG_COUNT      (REG_LAST - REG_FIRST + 1)
+#define REG_RHYTHM     0x90
+#define WRITE_LOG_SIZE 65536  // Ring of recent writes (power of two)
+
+// ===== State =====
+
+struct RegisterState {
+    uint8_t value;
+    bool written;
+    uint64_t writes;
+    uint64_t lastUs;
+};
+
+struct SlotState {
+    RegisterState regs[REG_COUNT];
+    int latchedAddr;         // -1 until an address byte arrives
+    uint64_t addressWrites;
+    uint64_t dataWrites;
+    uint64_t orphanData;     // Data bytes without a valid latched address
+};
+
+struct WriteRecord {
+    uint64_t timeUs;
+    uint64_t monoUs;
+    uint8_t slot;
+    uint8_t reg;
+    uint8_t value;
+};
+
+struct EmulatorStats {
+    uint64_t bytes;
+    uint64_t packets;
+    uint64_t writes;
+    uint64_t resets;
+    uint64_t resyncBytes;    // Bytes discarded while looking for a packet boundary
+    uint64_t reads;          // Chunks: read() calls that returned data, or capture records
+    uint64_t firstByteUs;
+    uint64_t lastByteUs;
+    uint64_t lastWriteUs;
+    uint64_t gapMaxUs;       // Largest gap between consecutive register writes
+    uint64_t gapSumUs;
+    uint64_t gapCount;
+};
+
+static SlotState g_slots[SLOT_COUNT];
+static EmulatorStats g_stats;
+static std::vector<WriteRecord> g_writeLog(WRITE_LOG_SIZE);
+static uint64_t g_writeLogCount = 0;
+static uint64_t g_startMonoUs = 0;
+static bool g_verbose = false;
+static volatile sig_atomic_t g_quit = 0;
+
+// Packet decoder: bytes of the packet collected so far
+static uint8_t g_packet[4];
+static int g_packetLength = 0;
+
+static uint64_t mono_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void reset_registers() {
+    for (int s = 0; s < SLOT_COUNT; s++) {
+        memset(g_slots[s].regs, 0, sizeof(g_slots[s].regs));
+        g_slots[s].latchedAddr = -1;
+    }
+}
+
+static void clear_stats() {
+    memset(&g_stats, 0, sizeof(g_stats));
+    for (int s = 0; s < SLOT_COUNT; s++) {
+        g_slots[s].addressWrites = 0;
+        g_slots[s].dataWrites = 0;
+        g_slots[s].orphanData = 0;
+    }
+    g_writeLogCount = 0;
+}
+
+// ===== Protocol Decoding =====
+
+static void apply_byte(int slot, uint8_t byte, uint64_t nowUs, uint64_t nowMono) {
+    SlotState& s = g_slots[slot];
+    if (byte & 0x80) {
+        s.latchedAddr = byte;
+        s.addressWrites++;
+        return;
+    }
+
+    if (s.latchedAddr < REG_FIRST || s.latchedAddr > REG_LAST) {
+        s.orphanData++;
+        if (g_verbose) printf("%12llu  slot%d  data 0x%02X without register address\n",
+                              (unsigned long long)nowUs, slot, byte);
+        return;
+    }
+
+    RegisterState& r = s.regs[s.latchedAddr - REG_FIRST];
+    r.value = byte;
+    r.written = true;
+    r.writes++;
+    r.lastUs = nowUs;
+    s.dataWrites++;
+
+    if (g_stats.writes > 0) {
+        uint64_t gap = nowUs - g_stats.lastWriteUs;
+        if (gap > g_stats.gapMaxUs) g_stats.gapMaxUs = gap;
+        g_stats.gapSumUs += gap;
+        g_stats.gapCount++;
+    }
+    g_stats.writes++;
+    g_stats.lastWriteUs = nowUs;
+
+    WriteRecord& w = g_writeLog[g_writeLogCount & (WRITE_LOG_SIZE - 1)];
+    w.timeUs = nowUs;
+    w.monoUs = nowMono;
+    w.slot = (uint8_t)slot;
+    w.reg = (uint8_t)s.latchedAddr;
+    w.value = byte;
+    g_writeLogCount++;
+
+    if (g_verbose) printf("%12llu  slot%d  [%02X] = %02X\n",
+                          (unsigned long long)nowUs, slot, s.latchedAddr, byte);
+}
+
+// Drop the first collected byte and re-scan the rest for a packet start
+static void resync() {
+    g_stats.resyncBytes++;
+    memmove(g_packet, g_packet + 1, g_packetLength - 1);
+    g_packetLength--;
+}
+
+static void decode_byte(uint8_t byte, uint64_t nowUs, uint64_t nowMono) {
+    g_packet[g_packetLength++] = byte;
+
+    while (g_packetLength > 0) {
+        // Packet start: slot number, or 0x00 for the reset command
+        if (g_packet[0] >= SLOT_COUNT) { resync(); continue; }
+        if (g_packetLength < 2) return;
+
+        if (g_packet[1] == 0x80) {
+            if (g_packetLength < 3) return;
+            g_stats.packets++;
+            apply_byte(g_packet[0], g_packet[2], nowUs, nowMono);
+            g_packetLength = 0;
+            return;
+        }
+
+        if (g_packet[0] == 0x00 && g_packet[1] == 0x00) {
+            if (g_packetLength >= 3 && g_packet[2] != 0xFE) { resync(); continue; }
+            if (g_packetLength >= 4 && g_packet[3] != 0x00) { resync(); continue; }
+            if (g_packetLength < 4) return;
+            g_stats.packets++;
+            g_stats.resets++;
+            reset_registers();
+            if (g_verbose) printf("%12llu  RESET\n", (unsigned long long)nowUs);
+            g_packetLength = 0;
+            return;
+        }
+
+        resync();
+    }
+}
+
+// ===== Query Interface =====
+
+static void cmd_regs(std::string& out, int slotFilter) {
+    char line[256];
+    for (int s = 0; s < SLOT_COUNT; s++) {
+        if (slotFilter >= 0 && s != slotFilter) continue;
+        snprintf(line, sizeof(line), "slot%d:", s);
+        out += line;
+        for (int i = 0; i < REG_COUNT; i++) {
+            const RegisterState& r = g_slots[s].regs[i];
+            if (i % 16 == 0) {
+                snprintf(line, sizeof(line), "\n  %02X:", REG_FIRST + i);
+                out += line;
+            }
+            if (r.written) snprintf(line, sizeof(line), " %02X", r.value);
+            else snprintf(line, sizeof(line), " --");
+            out += line;
+        }
+        out += "\n";
+    }
+}
+
+static void cmd_voices(std::string& out, int slotFilter) {
+    static const char* timbres[] = {"-", "String", "Organ", "Clarinet", "Piano", "Harpsichord", "?", "?"};
+    static const char* envelopes[] = {"Decay", "Fast", "Medium", "Slow"};
+    char line[256];
+    for (int s = 0; s < SLOT_COUNT; s++) {
+        if (slotFilter >= 0 && s != slotFilter) continue;
+        const RegisterState* regs = g_slots[s].regs;
+        for (int ch = 0; ch < 4; ch++) {
+            const RegisterState& lo = regs[0x80 + ch - REG_FIRST];
+            const RegisterState& hi = regs[0x84 + ch - REG_FIRST];
+            const RegisterState& tone = regs[0x88 + ch - REG_FIRST];
+            const RegisterState& vol = regs[0x8C + ch - REG_FIRST];
+            int fnum = ((hi.value & 0x07) << 7) | (lo.value & 0x7F);
+            snprintf(line, sizeof(line),
+                     "slot%d ch%d: key=%s octave=%d fnum=%d timbre=%s env=%s vol=%d last=%llu\n",
+                     s, ch, (hi.value & 0x40) ? "on " : "off", (hi.value >> 3) & 0x07, fnum,
+                     timbres[tone.value & 0x07], envelopes[(tone.value >> 4) & 0x03],
+                     (vol.value >> 4) & 0x03, (unsigned long long)hi.lastUs);
+            out += line;
+        }
+        const RegisterState& rhythm = regs[REG_RHYTHM - REG_FIRST];
+        snprintf(line, sizeof(line), "slot%d rhythm: 0x%02X triggers=%llu last=%llu\n",
+                 s, rhythm.value, (unsigned long long)rhythm.writes,
+                 (unsigned long long)rhythm.lastUs);
+        out += line;
+    }
+}
+
+static void cmd_log(std::string& out, int count) {
+    if (count <= 0) count = 32;
+    uint64_t available = g_writeLogCount < WRITE_LOG_SIZE ? g_writeLogCount : WRITE_LOG_SIZE;
+    if ((uint64_t)count > available) count = (int)available;
+    char line[128];
+    for (uint64_t i = g_writeLogCount - count; i < g_writeLogCount; i++) {
+        const WriteRecord& w = g_writeLog[i & (WRITE_LOG_SIZE - 1)];
+        snprintf(line, sizeof(line), "%12llu mono=%llu slot%d [%02X] = %02X\n",
+                 (unsigned long long)w.timeUs, (unsigned long long)w.monoUs,
+                 w.slot, w.reg, w.value);
+        out += line;
+    }
+}
+
+static void cmd_stats(std::string& out) {
+    char line[256];
+    uint64_t spanUs = g_stats.lastByteUs - g_stats.firstByteUs;
+    double spanSec = spanUs / 1000000.0;
+    snprintf(line, sizeof(line),
+             "bytes=%llu packets=%llu writes=%llu resets=%llu resync_bytes=%llu chunks=%llu\n",
+             (unsigned long long)g_stats.bytes, (unsigned long long)g_stats.packets,
+             (unsigned long long)g_stats.writes, (unsigned long long)g_stats.resets,
+             (unsigned long long)g_stats.resyncBytes, (unsigned long long)g_stats.reads);
+    out += line;
+    snprintf(line, sizeof(line), "span_us=%llu bytes_per_sec=%.0f writes_per_sec=%.0f\n",
+             (unsigned long long)spanUs,
+             spanSec > 0 ? g_stats.bytes / spanSec : 0.0,
+             spanSec > 0 ? g_stats.writes / spanSec : 0.0);
+    out += line;
+    snprintf(line, sizeof(line), "write_gap_avg_us=%.1f write_gap_max_us=%llu\n",
+             g_stats.gapCount > 0 ? (double)g_stats.gapSumUs / g_stats.gapCount : 0.0,
+             (unsigned long long)g_stats.gapMaxUs);
+    out += line;
+    for (int s = 0; s < SLOT_COUNT; s++) {
+        snprintf(line, sizeof(line), "slot%d: address=%llu data=%llu orphan_data=%llu\n", s,
+                 (unsigned long long)g_slots[s].addressWrites,
+                 (unsigned long long)g_slots[s].dataWrites,
+                 (unsigned long long)g_slots[s].orphanData);
+        out += line;
+    }
+}
+
+// Execute one command line; returns the reply block
+static std::string run_command(const char* text) {
+    char cmd[32] = {0};
+    int a = -1, b = -1;
+    std::string out;
+    int n = sscanf(text, "%31s %i %i", cmd, &a, &b);
+    if (n <= 0) return "";
+
+    if (!strcmp(cmd, "regs")) {
+        if (n >= 2 && (a < 0 || a >= SLOT_COUNT)) return "error: slot out of range\n";
+        cmd_regs(out, n >= 2 ? a : -1);
+    } else if (!strcmp(cmd, "reg")) {
+        if (n < 3 || a < 0 || a >= SLOT_COUNT || b < REG_FIRST || b > REG_LAST)
+            return "error: usage reg <slot 0-3> <addr 0x80-0x9D>\n";
+        const RegisterState& r = g_slots[a].regs[b - REG_FIRST];
+        char line[128];
+        if (r.written) {
+            snprintf(line, sizeof(line), "0x%02X writes=%llu last=%llu\n", r.value,
+                     (unsigned long long)r.writes, (unsigned long long)r.lastUs);
+        } else {
+            snprintf(line, sizeof(line), "-- writes=0\n");
+        }
+        out += line;
+    } else if (!strcmp(cmd, "voices")) {
+        if (n >= 2 && (a < 0 || a >= SLOT_COUNT)) return "error: slot out of range\n";
+        cmd_voices(out, n >= 2 ? a : -1);
+    } else if (!strcmp(cmd, "log")) {
+        cmd_log(out, n >= 2 ? a : 32);
+    } else if (!strcmp(cmd, "stats")) {
+        cmd_stats(out);
+    } else if (!strcmp(cmd, "now")) {
+        char line[64];
+        uint64_t now = mono_us();
+        snprintf(line, sizeof(line), "%llu mono=%llu\n",
+                 (unsigned long long)(now - g_startMonoUs), (unsigned long long)now);
+        out += line;
+    } else if (!strcmp(cmd, "clear")) {
+        clear_stats();
+    } else if (!strcmp(cmd, "reset")) {
+        reset_registers();
+    } else if (!strcmp(cmd, "quit")) {
+        g_quit = 1;
+    } else if (!strcmp(cmd, "help")) {
+        out += "commands: regs [slot], reg <slot> <addr>, voices [slot], log [n], stats, now, clear, reset, quit\n";
+    } else {
+        return std::string("error: unknown command '") + cmd + "'\n";
+    }
+    return out + "ok\n";
+}
+
+// ===== Capture Replay =====
+
+static uint64_t read_le(const uint8_t* p, int bytes) {
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--) value = (value << 8) | p[i];
+    return value;
+}
+
+// Decode a capture file (layout in spfm_transport.h); the bytes of each record
+// get the record's timestamp
+static bool replay_capture(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "ERROR: Failed to open capture file %s (%s)\n", path, strerror(errno));
+        return false;
+    }
+    char magic[8];
+    if (fread(magic, 1, 8, file) != 8 || memcmp(magic, SPFM_CAPTURE_MAGIC, 8) != 0) {
+        fprintf(stderr, "ERROR: %s is not an SPFM capture file\n", path);
+        fclose(file);
+        return false;
+    }
+
+    std::vector<uint8_t> data;
+    uint8_t header[12];
+    while (fread(header, 1, sizeof(header), file) == sizeof(header)) {
+        uint64_t timeUs = read_le(header, 8);
+        uint32_t length = (uint32_t)read_le(header + 8, 4);
+        data.resize(length);
+        if (length > 0 && fread(data.data(), 1, length, file) != length) {
+            fprintf(stderr, "WARNING: Capture file ends inside a record\n");
+            break;
+        }
+        if (g_stats.bytes == 0) g_stats.firstByteUs = timeUs;
+        g_stats.bytes += length;
+        g_stats.reads++;
+        g_stats.lastByteUs = timeUs;
+        for (uint32_t i = 0; i < length; i++) decode_byte(data[i], timeUs, timeUs);
+    }
+    fclose(file);
+    printf("Replayed %s: %llu records, %llu bytes, %llu register writes\n", path,
+           (unsigned long long)g_stats.reads, (unsigned long long)g_stats.bytes,
+           (unsigned long long)g_stats.writes);
+    fflush(stdout);
+    return true;
+}
+
+// ===== Setup =====
+
+static int open_pty(const char* linkPath) {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        fprintf(stderr, "ERROR: Failed to create pseudo-terminal (%s)\n", strerror(errno));
+        return -1;
+    }
+
+    // Raw mode so no byte (0x00, 0x11, 0x13, ...) is translated by the line discipline
+    const char* slaveName = ptsname(master);
+    struct termios tio;
+    if (tcgetattr(master, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(master, TCSANOW, &tio);
+    }
+
+    if (linkPath) {
+        unlink(linkPath);
+        if (symlink(slaveName, linkPath) != 0) {
+            fprintf(stderr, "ERROR: Failed to link %s -> %s (%s)\n", linkPath, slaveName, strerror(errno));
+            close(master);
+            return -1;
+        }
+        printf("SPFM emulator listening on %s (-> %s)\n", linkPath, slaveName);
+    } else {
+        printf("SPFM emulator listening on %s\n", slaveName);
+    }
+    fflush(stdout);
+    return master;
+}
+
+static int open_control_socket(const char* path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 4) != 0) {
+        fprintf(stderr, "ERROR: Failed to listen on %s (%s)\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void on_signal(int) { g_quit = 1; }
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "Usage: %s [--replay FILE | --link PATH] [--baud N] [--control SOCKET] [--verbose]\n"
+            "  --replay FILE     decode a capture file (--transport=capture:FILE) instead of a pty\n"
+            "  --link PATH       symlink PATH to the pty slave (stable name for a local serial sender)\n"
+            "  --baud N          pace reads to N baud (8N1) like the real FTDI link; 0 = unpaced\n"
+            "  --control SOCKET  accept query commands on a UNIX socket as well as stdin\n"
+            "  --verbose         print every register write as it arrives\n", argv0);
+}
+
+// ===== Main =====
+
+int main(int argc, char** argv) {
+    const char* linkPath = nullptr;
+    const char* controlPath = nullptr;
+    const char* replayPath = nullptr;
+    long baud = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--link") && i + 1 < argc) linkPath = argv[++i];
+        else if (!strcmp(argv[i], "--control") && i + 1 < argc) controlPath = argv[++i];
+        else if (!strcmp(argv[i], "--replay") && i + 1 < argc) replayPath = argv[++i];
+        else if (!strcmp(argv[i], "--baud") && i + 1 < argc) baud = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--verbose")) g_verbose = true;
+        else { usage(argv[0]); return 1; }
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    g_startMonoUs = mono_us();
+    reset_registers();
+    clear_stats();
+
+    // Replay: decode the capture, then only answer queries (no pty)
+    int master = -1;
+    int keepSlave = -1;
+    if (replayPath) {
+        if (!replay_capture(replayPath)) return 1;
+    } else {
+        master = open_pty(linkPath);
+        if (master < 0) return 1;
+
+        // Keep a slave fd open ourselves so the master doesn't report EIO/HUP
+        // between sender sessions (the app closing and reopening the port)
+        keepSlave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    }
+
+    int controlFd = controlPath ? open_control_socket(controlPath) : -1;
+    if (controlPath && controlFd < 0) return 1;
+
+    std::vector<int> clients;
+    std::vector<std::string> clientBuffers;
+    std::string stdinBuffer;
+    bool stdinOpen = true;
+
+    // Baud pacing: each byte costs 10 bit times on an 8N1 wire
+    double usPerByte = baud > 0 ? 10.0 * 1000000.0 / baud : 0.0;
+    double wireFreeUs = 0.0;
+
+    uint8_t buffer[4096];
+    while (!g_quit) {
+        std::vector<struct pollfd> fds;
+        fds.push_back({master, POLLIN, 0});
+        fds.push_back({stdinOpen ? 0 : -1, POLLIN, 0});
+        fds.push_back({controlFd, POLLIN, 0});
+        for (size_t i = 0; i < clients.size(); i++) fds.push_back({clients[i], POLLIN, 0});
+
+        if (poll(fds.data(), fds.size(), 100) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            ssize_t n = read(master, buffer, sizeof(buffer));
+            if (n > 0) {
+                uint64_t nowMono = mono_us();
+                uint64_t nowUs = nowMono - g_startMonoUs;
+                if (g_stats.bytes == 0) g_stats.firstByteUs = nowUs;
+                g_stats.bytes += n;
+                g_stats.reads++;
+                g_stats.lastByteUs = nowUs;
+                for (ssize_t i = 0; i < n; i++) decode_byte(buffer[i], nowUs, nowMono);
+                if (g_verbose) fflush(stdout);
+
+                if (usPerByte > 0) {
+                    // Hold off the next read until the wire would have carried these bytes;
+                    // the pty buffer then fills and blocks the sender like the real link
+                    if (wireFreeUs < (double)nowUs) wireFreeUs = (double)nowUs;
+                    wireFreeUs += n * usPerByte;
+                    double waitUs = wireFreeUs - (double)(mono_us() - g_startMonoUs);
+                    if (waitUs > 0) {
+                        struct timespec ts;
+                        ts.tv_sec = (time_t)(waitUs / 1000000.0);
+                        ts.tv_nsec = (long)((waitUs - ts.tv_sec * 1000000.0) * 1000.0);
+                        nanosleep(&ts, nullptr);
+                    }
+                }
+            }
+        }
+
+        if (fds[1].revents & (POLLIN | POLLHUP)) {
+            char text[1024];
+            ssize_t n = read(0, text, sizeof(text));
+            if (n <= 0) {
+                stdinOpen = false;
+                if (replayPath && controlFd < 0) break;  // Nothing left to answer
+            } else {
+                stdinBuffer.append(text, n);
+                size_t eol;
+                while ((eol = stdinBuffer.find('\n')) != std::string::npos) {
+                    std::string reply = run_command(stdinBuffer.substr(0, eol).c_str());
+                    stdinBuffer.erase(0, eol + 1);
+                    fputs(reply.c_str(), stdout);
+                    fflush(stdout);
+                }
+            }
+        }
+
+        if (controlFd >= 0 && (fds[2].revents & POLLIN)) {
+            int client = accept(controlFd, nullptr, nullptr);
+            if (client >= 0) {
+                clients.push_back(client);
+                clientBuffers.push_back(std::string());
+            }
+        }
+
+        // Client fds in the poll set start at index 3; newly accepted ones are polled next round
+        size_t polledClients = fds.size() - 3;
+        for (size_t i = polledClients; i-- > 0; ) {
+            if (!(fds[3 + i].revents & (POLLIN | POLLHUP))) continue;
+            char text[1024];
+            ssize_t n = read(clients[i], text, sizeof(text));
+            if (n <= 0) {
+                close(clients[i]);
+                clients.erase(clients.begin() + i);
+                clientBuffers.erase(clientBuffers.begin() + i);
+                continue;
+            }
+            clientBuffers[i].append(text, n);
+            size_t eol;
+            while ((eol = clientBuffers[i].find('\n')) != std::string::npos) {
+                std::string reply = run_command(clientBuffers[i].substr(0, eol).c_str());
+                clientBuffers[i].erase(0, eol + 1);
+                if (write(clients[i], reply.data(), reply.size()) < 0) break;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < clients.size(); i++) close(clients[i]);
+    if (controlFd >= 0) { close(controlFd); unlink(controlPath); }
+    if (linkPath && master >= 0) unlink(linkPath);
+    if (keepSlave >= 0) close(keepSlave);
+    if (master >= 0) close(master);
+    return 0;
+}
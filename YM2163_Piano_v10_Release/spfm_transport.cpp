@@ -0,0 +1,505 @@
+// SPFM Transport - FTDI D2XX, serial, capture-file and null backends
+// See spfm_transport.h for the spec string syntax.
+
+#include "spfm_transport.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+extern "C" {
+#include "ftdi_driver/ftd2xx.h"
+}
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+// ===== Logging =====
+
+static void spfm_transport_log_stderr(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+static SpfmTransportLogFn g_transportLog = spfm_transport_log_stderr;
+
+void spfm_transport_set_logger(SpfmTransportLogFn logger) {
+    g_transportLog = logger ? logger : spfm_transport_log_stderr;
+}
+
+// ===== FTDI D2XX Backend =====
+// The D2XX DLL is resolved at runtime so the executable starts (and the other
+// backends work) on machines without the FTDI driver installed.
+
+#ifdef _WIN32
+
+class FtdiTransport : public SpfmTransport {
+public:
+    FtdiTransport(const std::string& spec, int deviceIndex)
+        : SpfmTransport(spec), m_deviceIndex(deviceIndex), m_dll(NULL), m_handle(NULL) {}
+    ~FtdiTransport() { close(); }
+
+    bool open() {
+        if (!loadDriver()) return false;
+
+        DWORD numDevs = 0;
+        FT_STATUS status = p_CreateDeviceInfoList(&numDevs);
+        if (status == FT_OK && numDevs > 0) {
+            g_transportLog("=== FTDI Device Detection ===");
+            g_transportLog("Found %lu FTDI device(s)", numDevs);
+
+            FT_DEVICE_LIST_INFO_NODE *devInfo = (FT_DEVICE_LIST_INFO_NODE*)
+                malloc(sizeof(FT_DEVICE_LIST_INFO_NODE) * numDevs);
+            status = p_GetDeviceInfoList(devInfo, &numDevs);
+
+            if (status == FT_OK) {
+                for (DWORD i = 0; i < numDevs; i++) {
+                    g_transportLog("Device %lu: %s (Serial: %s)",
+                        i, devInfo[i].Description, devInfo[i].SerialNumber);
+                }
+            }
+            free(devInfo);
+        }
+
+        g_transportLog("Opening device index %d...", m_deviceIndex);
+        status = p_Open(m_deviceIndex, &m_handle);
+        if (status != FT_OK) {
+            g_transportLog("ERROR: Failed to open device (status=%d)", (int)status);
+            m_handle = NULL;
+            return false;
+        }
+
+        g_transportLog("Configuring FTDI parameters...");
+        p_SetBaudRate(m_handle, SPFM_DEFAULT_BAUD);
+        p_SetDataCharacteristics(m_handle, FT_BITS_8, FT_STOP_BITS_1, FT_PARITY_NONE);
+        p_SetFlowControl(m_handle, FT_FLOW_NONE, 0, 0);
+        p_SetTimeouts(m_handle, 100, 100);
+        p_SetLatencyTimer(m_handle, 2);
+        p_Purge(m_handle, FT_PURGE_RX | FT_PURGE_TX);
+
+        g_transportLog("FTDI initialized successfully");
+        return true;
+    }
+
+    void close() {
+        if (m_handle) {
+            p_Close(m_handle);
+            m_handle = NULL;
+        }
+        if (m_dll) {
+            FreeLibrary(m_dll);
+            m_dll = NULL;
+        }
+    }
+
+    bool isOpen() const { return m_handle != NULL; }
+
+    bool write(const uint8_t* data, int length) {
+        if (!m_handle) return false;
+        DWORD written = 0;
+        FT_STATUS status = p_Write(m_handle, (LPVOID)data, (DWORD)length, &written);
+        m_bytesWritten += written;
+        if (status != FT_OK || (int)written != length) {
+            m_writeErrors++;
+            return false;
+        }
+        return true;
+    }
+
+    const char* kind() const { return "FTDI D2XX"; }
+
+private:
+    template <typename T>
+    bool resolve(T& fn, const char* name) {
+        fn = (T)(void*)GetProcAddress(m_dll, name);
+        if (!fn) g_transportLog("ERROR: %s not found in D2XX driver", name);
+        return fn != NULL;
+    }
+
+    bool loadDriver() {
+        if (m_dll) return true;
+#ifdef _WIN64
+        m_dll = LoadLibraryA("ftd2xx64.dll");
+#endif
+        if (!m_dll) m_dll = LoadLibraryA("ftd2xx.dll");
+        if (!m_dll) {
+            g_transportLog("ERROR: FTDI D2XX driver (ftd2xx.dll) not found");
+            return false;
+        }
+        bool ok = resolve(p_CreateDeviceInfoList, "FT_CreateDeviceInfoList") &&
+                  resolve(p_GetDeviceInfoList, "FT_GetDeviceInfoList") &&
+                  resolve(p_Open, "FT_Open") &&
+                  resolve(p_Close, "FT_Close") &&
+                  resolve(p_Write, "FT_Write") &&
+                  resolve(p_SetBaudRate, "FT_SetBaudRate") &&
+                  resolve(p_SetDataCharacteristics, "FT_SetDataCharacteristics") &&
+                  resolve(p_SetFlowControl, "FT_SetFlowControl") &&
+                  resolve(p_SetTimeouts, "FT_SetTimeouts") &&
+                  resolve(p_SetLatencyTimer, "FT_SetLatencyTimer") &&
+                  resolve(p_Purge, "FT_Purge");
+        if (!ok) {
+            FreeLibrary(m_dll);
+            m_dll = NULL;
+        }
+        return ok;
+    }
+
+    int m_deviceIndex;
+    HMODULE m_dll;
+    FT_HANDLE m_handle;
+
+    decltype(&FT_CreateDeviceInfoList) p_CreateDeviceInfoList;
+    decltype(&FT_GetDeviceInfoList) p_GetDeviceInfoList;
+    decltype(&FT_Open) p_Open;
+    decltype(&FT_Close) p_Close;
+    decltype(&FT_Write) p_Write;
+    decltype(&FT_SetBaudRate) p_SetBaudRate;
+    decltype(&FT_SetDataCharacteristics) p_SetDataCharacteristics;
+    decltype(&FT_SetFlowControl) p_SetFlowControl;
+    decltype(&FT_SetTimeouts) p_SetTimeouts;
+    decltype(&FT_SetLatencyTimer) p_SetLatencyTimer;
+    decltype(&FT_Purge) p_Purge;
+};
+
+#endif // _WIN32
+
+// ===== Serial Backend =====
+// For the FTDI VCP driver (ftdi_sio on Linux, COM port on Windows). Same line
+// settings as the D2XX path: 8N1, no flow control.
+
+class SerialTransport : public SpfmTransport {
+public:
+    SerialTransport(const std::string& spec, const std::string& port, int baud)
+        : SpfmTransport(spec), m_port(port), m_baud(baud),
+#ifdef _WIN32
+          m_handle(INVALID_HANDLE_VALUE)
+#else
+          m_fd(-1)
+#endif
+    {}
+    ~SerialTransport() { close(); }
+
+#ifdef _WIN32
+    bool open() {
+        // "\\.\" prefix is required for COM10 and above
+        std::string path = m_port;
+        if (path.compare(0, 4, "\\\\.\\") != 0) path = "\\\\.\\" + path;
+
+        g_transportLog("Opening serial port %s @ %d baud...", m_port.c_str(), m_baud);
+        m_handle = CreateFileA(path.c_str(), GENERIC_WRITE | GENERIC_READ, 0, NULL,
+                               OPEN_EXISTING, 0, NULL);
+        if (m_handle == INVALID_HANDLE_VALUE) {
+            g_transportLog("ERROR: Failed to open %s (error=%lu)", m_port.c_str(), GetLastError());
+            return false;
+        }
+
+        DCB dcb;
+        memset(&dcb, 0, sizeof(dcb));
+        dcb.DCBlength = sizeof(dcb);
+        GetCommState(m_handle, &dcb);
+        dcb.BaudRate = m_baud;
+        dcb.ByteSize = 8;
+        dcb.Parity = NOPARITY;
+        dcb.StopBits = ONESTOPBIT;
+        dcb.fBinary = TRUE;
+        dcb.fParity = FALSE;
+        dcb.fOutxCtsFlow = FALSE;
+        dcb.fOutxDsrFlow = FALSE;
+        dcb.fDtrControl = DTR_CONTROL_ENABLE;
+        dcb.fRtsControl = RTS_CONTROL_ENABLE;
+        dcb.fOutX = FALSE;
+        dcb.fInX = FALSE;
+        if (!SetCommState(m_handle, &dcb)) {
+            g_transportLog("ERROR: Failed to configure %s (error=%lu)", m_port.c_str(), GetLastError());
+            close();
+            return false;
+        }
+
+        COMMTIMEOUTS timeouts;
+        memset(&timeouts, 0, sizeof(timeouts));
+        timeouts.ReadTotalTimeoutConstant = 100;
+        timeouts.WriteTotalTimeoutConstant = 100;
+        SetCommTimeouts(m_handle, &timeouts);
+        PurgeComm(m_handle, PURGE_RXCLEAR | PURGE_TXCLEAR);
+
+        g_transportLog("Serial port initialized successfully");
+        return true;
+    }
+
+    void close() {
+        if (m_handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(m_handle);
+            m_handle = INVALID_HANDLE_VALUE;
+        }
+    }
+
+    bool isOpen() const { return m_handle != INVALID_HANDLE_VALUE; }
+
+    bool write(const uint8_t* data, int length) {
+        if (m_handle == INVALID_HANDLE_VALUE) return false;
+        DWORD written = 0;
+        BOOL ok = WriteFile(m_handle, data, (DWORD)length, &written, NULL);
+        m_bytesWritten += written;
+        if (!ok || (int)written != length) {
+            m_writeErrors++;
+            return false;
+        }
+        return true;
+    }
+#else
+    bool open() {
+        g_transportLog("Opening serial port %s @ %d baud...", m_port.c_str(), m_baud);
+        m_fd = ::open(m_port.c_str(), O_RDWR | O_NOCTTY);
+        if (m_fd < 0) {
+            g_transportLog("ERROR: Failed to open %s (%s)", m_port.c_str(), strerror(errno));
+            return false;
+        }
+
+        speed_t speed;
+        if (!baud_to_speed(m_baud, &speed)) {
+            g_transportLog("ERROR: Baud rate %d not supported by termios on this host", m_baud);
+            close();
+            return false;
+        }
+
+        struct termios tio;
+        if (tcgetattr(m_fd, &tio) != 0) {
+            g_transportLog("ERROR: %s is not a tty (%s)", m_port.c_str(), strerror(errno));
+            close();
+            return false;
+        }
+        cfmakeraw(&tio);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cflag &= ~(CSTOPB | PARENB);
+#ifdef CRTSCTS
+        tio.c_cflag &= ~CRTSCTS;
+#endif
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 1;
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+        if (tcsetattr(m_fd, TCSANOW, &tio) != 0) {
+            g_transportLog("ERROR: Failed to configure %s (%s)", m_port.c_str(), strerror(errno));
+            close();
+            return false;
+        }
+        tcflush(m_fd, TCIOFLUSH);
+
+        g_transportLog("Serial port initialized successfully");
+        return true;
+    }
+
+    void close() {
+        if (m_fd >= 0) {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    bool isOpen() const { return m_fd >= 0; }
+
+    bool write(const uint8_t* data, int length) {
+        if (m_fd < 0) return false;
+        int done = 0;
+        while (done < length) {
+            ssize_t n = ::write(m_fd, data + done, length - done);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                m_writeErrors++;
+                return false;
+            }
+            done += (int)n;
+            m_bytesWritten += n;
+        }
+        return true;
+    }
+#endif
+
+    const char* kind() const { return "Serial"; }
+
+private:
+#ifndef _WIN32
+    static bool baud_to_speed(int baud, speed_t* speed) {
+        switch (baud) {
+            case 9600:    *speed = B9600;    return true;
+            case 19200:   *speed = B19200;   return true;
+            case 38400:   *speed = B38400;   return true;
+            case 57600:   *speed = B57600;   return true;
+            case 115200:  *speed = B115200;  return true;
+            case 230400:  *speed = B230400;  return true;
+#ifdef B460800
+            case 460800:  *speed = B460800;  return true;
+#endif
+#ifdef B921600
+            case 921600:  *speed = B921600;  return true;
+#endif
+#ifdef B1500000
+            case 1500000: *speed = B1500000; return true;
+#endif
+#ifdef B3000000
+            case 3000000: *speed = B3000000; return true;
+#endif
+            default: return false;
+        }
+    }
+#endif
+
+    std::string m_port;
+    int m_baud;
+#ifdef _WIN32
+    HANDLE m_handle;
+#else
+    int m_fd;
+#endif
+};
+
+// ===== Capture File Backend =====
+
+class CaptureTransport : public SpfmTransport {
+public:
+    CaptureTransport(const std::string& spec, const std::string& path)
+        : SpfmTransport(spec), m_path(path), m_file(NULL) {}
+    ~CaptureTransport() { close(); }
+
+    bool open() {
+        m_file = fopen(m_path.c_str(), "wb");
+        if (!m_file) {
+            g_transportLog("ERROR: Failed to create capture file %s", m_path.c_str());
+            return false;
+        }
+        // Large stdio buffer: the output thread should never wait on the disk
+        setvbuf(m_file, NULL, _IOFBF, 1 << 20);
+        fwrite(SPFM_CAPTURE_MAGIC, 1, 8, m_file);
+        m_start = std::chrono::steady_clock::now();
+        g_transportLog("Capturing SPFM output to %s", m_path.c_str());
+        return true;
+    }
+
+    void close() {
+        if (m_file) {
+            fclose(m_file);
+            m_file = NULL;
+            g_transportLog("Capture closed: %llu bytes written to %s",
+                           (unsigned long long)m_bytesWritten, m_path.c_str());
+        }
+    }
+
+    bool isOpen() const { return m_file != NULL; }
+
+    bool write(const uint8_t* data, int length) {
+        if (!m_file) return false;
+        uint64_t timestampUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - m_start).count();
+        uint32_t len = (uint32_t)length;
+        uint8_t header[12];
+        for (int i = 0; i < 8; i++) header[i] = (uint8_t)(timestampUs >> (8 * i));
+        for (int i = 0; i < 4; i++) header[8 + i] = (uint8_t)(len >> (8 * i));
+        if (fwrite(header, 1, sizeof(header), m_file) != sizeof(header) ||
+            fwrite(data, 1, length, m_file) != (size_t)length) {
+            m_writeErrors++;
+            return false;
+        }
+        m_bytesWritten += length;
+        return true;
+    }
+
+    const char* kind() const { return "Capture"; }
+
+private:
+    std::string m_path;
+    FILE* m_file;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// ===== Null Backend =====
+
+class NullTransport : public SpfmTransport {
+public:
+    explicit NullTransport(const std::string& spec) : SpfmTransport(spec), m_open(false) {}
+
+    bool open() {
+        m_open = true;
+        g_transportLog("Null transport: SPFM output is discarded");
+        return true;
+    }
+    void close() { m_open = false; }
+    bool isOpen() const { return m_open; }
+
+    bool write(const uint8_t* data, int length) {
+        (void)data;
+        if (!m_open) return false;
+        m_bytesWritten += length;
+        return true;
+    }
+
+    const char* kind() const { return "Null"; }
+
+private:
+    bool m_open;
+};
+
+// ===== Factory =====
+
+SpfmTransport* spfm_transport_create(const char* spec) {
+    std::string s = spec ? spec : "";
+    std::string type = s;
+    std::string arg;
+    size_t colon = s.find(':');
+    if (colon != std::string::npos) {
+        type = s.substr(0, colon);
+        arg = s.substr(colon + 1);
+    }
+
+    if (type == "ftdi") {
+#ifdef _WIN32
+        int index = arg.empty() ? 0 : atoi(arg.c_str());
+        return new FtdiTransport(s, index);
+#else
+        g_transportLog("ERROR: D2XX backend is only available on Windows; use serial:<tty>");
+        return nullptr;
+#endif
+    }
+
+    if (type == "serial") {
+        if (arg.empty()) {
+            g_transportLog("ERROR: serial transport needs a port, e.g. serial:COM3 or serial:/dev/ttyUSB0");
+            return nullptr;
+        }
+        int baud = SPFM_DEFAULT_BAUD;
+        size_t at = arg.rfind('@');
+        if (at != std::string::npos) {
+            baud = atoi(arg.c_str() + at + 1);
+            arg = arg.substr(0, at);
+        }
+        if (baud <= 0) {
+            g_transportLog("ERROR: Invalid baud rate in '%s'", s.c_str());
+            return nullptr;
+        }
+        return new SerialTransport(s, arg, baud);
+    }
+
+    if (type == "capture") {
+        if (arg.empty()) {
+            g_transportLog("ERROR: capture transport needs a file name, e.g. capture:out.spfm");
+            return nullptr;
+        }
+        return new CaptureTransport(s, arg);
+    }
+
+    if (type == "null") {
+        return new NullTransport(s);
+    }
+
+    g_transportLog("ERROR: Unknown transport '%s' (expected ftdi, serial, capture or null)", s.c_str());
+    return nullptr;
+}
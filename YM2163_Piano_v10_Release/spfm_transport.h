@@ -0,0 +1,63 @@
+// SPFM Transport - byte sinks for the SPFM Light register stream
+// The piano app only ever produces a stream of SPFM packets (3-byte register
+// writes {slot, 0x80, data} and the 4-byte reset command); this layer decides
+// where those bytes go. Backends:
+//   ftdi[:index]            FTDI D2XX driver (Windows, DLL loaded at runtime)
+//   serial:<port>[@baud]    Serial / FTDI VCP port (COMn on Windows, tty on POSIX)
+//   capture:<file>          Timestamped binary capture file, no hardware needed
+//   null                    Discards everything (throughput/latency benchmarks)
+// All writes come from the SPFM output thread, so backends need not be
+// thread-safe beyond open/close being called while that thread is stopped.
+
+#ifndef SPFM_TRANSPORT_H
+#define SPFM_TRANSPORT_H
+
+#include <stdint.h>
+#include <string>
+
+#define SPFM_DEFAULT_BAUD 1500000
+
+// Capture file layout: 8-byte magic, then one record per write call:
+//   uint64 timestampUs (steady clock, relative to open), uint32 length, bytes[length]
+// All integers little-endian.
+#define SPFM_CAPTURE_MAGIC "SPFMCAP1"
+
+class SpfmTransport {
+public:
+    virtual ~SpfmTransport() {}
+
+    // Open/configure the device. Returns false (after logging why) on failure.
+    virtual bool open() = 0;
+    virtual void close() = 0;
+    virtual bool isOpen() const = 0;
+
+    // Blocking write of the whole buffer. Returns false if any byte was lost.
+    virtual bool write(const uint8_t* data, int length) = 0;
+
+    // Short backend kind ("FTDI D2XX", "Serial", ...) and the spec it was made from
+    virtual const char* kind() const = 0;
+    const std::string& spec() const { return m_spec; }
+
+    // Counters for the Bus Statistics panel
+    uint64_t bytesWritten() const { return m_bytesWritten; }
+    uint64_t writeErrors() const { return m_writeErrors; }
+
+protected:
+    explicit SpfmTransport(const std::string& spec)
+        : m_spec(spec), m_bytesWritten(0), m_writeErrors(0) {}
+
+    std::string m_spec;
+    uint64_t m_bytesWritten;
+    uint64_t m_writeErrors;
+};
+
+// Log sink used by all backends (the app routes this into its Log panel)
+typedef void (*SpfmTransportLogFn)(const char* format, ...);
+void spfm_transport_set_logger(SpfmTransportLogFn logger);
+
+// Build (but do not open) a transport from a spec string such as "ftdi:0",
+// "serial:/dev/ttyUSB0@1500000", "capture:out.spfm" or "null".
+// Returns nullptr for an unknown or unavailable backend.
+SpfmTransport* spfm_transport_create(const char* spec);
+
+#endif // SPFM_TRANSPORT_H
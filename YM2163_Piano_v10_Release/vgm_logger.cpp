@@ -0,0 +1,174 @@
+// VGM Logger - double-buffered register stream recorder (see vgm_logger.h)
+
+#include "vgm_logger.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void put_u32(uint8_t* p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+VgmLogger::VgmLogger()
+    : m_file(NULL), m_startUs(0), m_lastSample(0), m_active(0), m_length(0),
+      m_pendingLength(0), m_pending(-1), m_running(false),
+      m_writes(0), m_dropped(0), m_bytesOnDisk(0) {
+    // Allocated once up front; recording never allocates
+    m_buffers[0] = (uint8_t*)malloc(VGM_BUFFER_SIZE);
+    m_buffers[1] = (uint8_t*)malloc(VGM_BUFFER_SIZE);
+}
+
+VgmLogger::~VgmLogger() {
+    stop();
+    free(m_buffers[0]);
+    free(m_buffers[1]);
+}
+
+bool VgmLogger::start(const char* path, uint64_t nowUs) {
+    stop();
+    if (!m_buffers[0] || !m_buffers[1]) return false;
+
+    m_file = fopen(path, "wb");
+    if (!m_file) return false;
+
+    // Placeholder header; lengths are patched in stop()
+    uint8_t header[VGM_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    fwrite(header, 1, sizeof(header), m_file);
+
+    m_path = path;
+    m_startUs = nowUs;
+    m_lastSample = 0;
+    m_active = 0;
+    m_length = 0;
+    m_pendingLength = 0;
+    m_pending = -1;
+    m_writes = 0;
+    m_dropped = 0;
+    m_bytesOnDisk = VGM_HEADER_SIZE;
+
+    m_running = true;
+    m_thread = std::thread(&VgmLogger::writerThread, this);
+    return true;
+}
+
+void VgmLogger::stop() {
+    if (!m_file) return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_cond.notify_one();
+    if (m_thread.joinable()) m_thread.join();
+
+    // Writer is gone: remaining bytes of the active buffer and the end marker
+    // are written from here
+    if (m_length + 1 > VGM_BUFFER_SIZE) {
+        fwrite(m_buffers[m_active], 1, m_length, m_file);
+        m_bytesOnDisk += m_length;
+        m_length = 0;
+    }
+    m_buffers[m_active][m_length++] = 0x66;
+    fwrite(m_buffers[m_active], 1, m_length, m_file);
+    m_bytesOnDisk += m_length;
+    m_length = 0;
+
+    uint8_t header[VGM_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    memcpy(header, "Vgm ", 4);
+    put_u32(header + 0x04, (uint32_t)(m_bytesOnDisk - 4));  // EOF offset
+    put_u32(header + 0x08, 0x00000171);                      // Version 1.71
+    put_u32(header + 0x18, (uint32_t)m_lastSample);          // Total samples
+    put_u32(header + 0x34, VGM_HEADER_SIZE - 0x34);          // Data offset
+    fseek(m_file, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), m_file);
+
+    fclose(m_file);
+    m_file = NULL;
+}
+
+// Make room for length bytes in the active buffer, handing a full buffer to
+// the writer thread. Returns false if both buffers are busy.
+bool VgmLogger::reserve(int length) {
+    if (m_length + length <= VGM_BUFFER_SIZE) return true;
+    if (m_pending.load(std::memory_order_acquire) != -1) return false;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pendingLength = m_length;
+        m_pending.store(m_active, std::memory_order_release);
+    }
+    m_cond.notify_one();
+    m_active ^= 1;
+    m_length = 0;
+    return true;
+}
+
+void VgmLogger::appendWait(uint64_t samples) {
+    uint8_t* p = m_buffers[m_active];
+    while (samples > 0) {
+        if (samples <= 16) {
+            p[m_length++] = (uint8_t)(0x70 + samples - 1);
+            samples = 0;
+        } else if (samples == 735) {
+            p[m_length++] = 0x62;
+            samples = 0;
+        } else if (samples == 882) {
+            p[m_length++] = 0x63;
+            samples = 0;
+        } else {
+            uint16_t chunk = samples > 0xFFFF ? 0xFFFF : (uint16_t)samples;
+            p[m_length++] = 0x61;
+            p[m_length++] = (uint8_t)chunk;
+            p[m_length++] = (uint8_t)(chunk >> 8);
+            samples -= chunk;
+        }
+    }
+}
+
+void VgmLogger::write(uint8_t slot, uint8_t reg, uint8_t data, uint64_t nowUs) {
+    if (!m_file) return;
+
+    uint64_t elapsedUs = nowUs > m_startUs ? nowUs - m_startUs : 0;
+    uint64_t sample = elapsedUs * VGM_SAMPLE_RATE / 1000000;
+    uint64_t wait = sample > m_lastSample ? sample - m_lastSample : 0;
+
+    // Worst case: one 0x61 per 65535 samples plus a short wait, then the write
+    int length = (int)(wait / 0xFFFF + 1) * 3 + 4;
+    if (!reserve(length)) {
+        // Dropped writes leave m_lastSample alone, so later waits stay exact
+        m_dropped++;
+        return;
+    }
+
+    appendWait(wait);
+    uint8_t* p = m_buffers[m_active];
+    p[m_length++] = VGM_CMD_YM2163;
+    p[m_length++] = slot;
+    p[m_length++] = reg;
+    p[m_length++] = data;
+    m_lastSample = sample > m_lastSample ? sample : m_lastSample;
+    m_writes++;
+}
+
+void VgmLogger::writerThread() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_cond.wait(lock, [this] { return !m_running || m_pending.load() != -1; });
+        int pending = m_pending.load();
+        if (pending != -1) {
+            int length = m_pendingLength;
+            lock.unlock();
+            fwrite(m_buffers[pending], 1, length, m_file);
+            m_bytesOnDisk += length;
+            lock.lock();
+            m_pending.store(-1, std::memory_order_release);
+            continue;
+        }
+        if (!m_running) break;
+    }
+}
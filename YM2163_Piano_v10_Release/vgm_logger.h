@@ -0,0 +1,78 @@
+// VGM Logger - records every YM2163 register write to a VGM-style file
+// Layout: standard VGM 1.71 header (0x100 bytes, data offset 0x34 = 0xCC) and
+// command stream. The YM2163 has no VGM chip ID, so register writes use the
+// reserved 3-operand command 0xD8:
+//   0xD8 slot reg data     register write on SPFM slot 0-3
+//   0x61 nn nn / 0x62 / 0x63 / 0x7n   waits in 44100 Hz samples
+//   0x66                   end of data
+// Timestamps are converted to sample counts from the absolute time since
+// start(), so rounding never accumulates into drift.
+//
+// write() only appends to a preallocated buffer; full buffers are handed to a
+// background thread that writes them to disk. If the writer is still busy with
+// the other buffer, the write is dropped and counted instead of blocking.
+
+#ifndef VGM_LOGGER_H
+#define VGM_LOGGER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define VGM_SAMPLE_RATE   44100
+#define VGM_HEADER_SIZE   0x100
+#define VGM_CMD_YM2163    0xD8
+#define VGM_BUFFER_SIZE   (256 * 1024)  // Bytes per half of the double buffer
+
+class VgmLogger {
+public:
+    VgmLogger();
+    ~VgmLogger();
+
+    // Open path and start the writer thread. nowUs is the time base for write().
+    bool start(const char* path, uint64_t nowUs);
+    // Flush, finish the header (length, total samples) and close the file
+    void stop();
+    bool active() const { return m_file != NULL; }
+    const std::string& path() const { return m_path; }
+
+    // Record one register write issued at nowUs (same clock as start())
+    void write(uint8_t slot, uint8_t reg, uint8_t data, uint64_t nowUs);
+
+    // Statistics for the current/last recording
+    uint64_t writes() const { return m_writes; }
+    uint64_t dropped() const { return m_dropped; }
+    uint64_t bytesOnDisk() const { return m_bytesOnDisk; }
+    uint64_t samples() const { return m_lastSample; }
+
+private:
+    void appendWait(uint64_t samples);
+    bool reserve(int length);
+    void writerThread();
+
+    FILE* m_file;
+    std::string m_path;
+    uint64_t m_startUs;
+    uint64_t m_lastSample;     // Sample position of the last emitted command
+
+    uint8_t* m_buffers[2];
+    int m_active;              // Buffer the producer appends to
+    int m_length;              // Bytes used in the active buffer
+    int m_pendingLength;       // Bytes in the buffer handed to the writer
+    std::atomic<int> m_pending;  // Index of the buffer being written, -1 if none
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+
+    uint64_t m_writes;
+    uint64_t m_dropped;
+    std::atomic<uint64_t> m_bytesOnDisk;
+};
+
+#endif // VGM_LOGGER_H
@@ -18,14 +18,18 @@
 #include <algorithm>
 #include <chrono>
 #include <random>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <mmsystem.h>  // For multimedia timer
 
-extern "C" {
-#include "ftdi_driver/ftd2xx.h"
-}
+#include "spfm_transport.h"
+#include "vgm_logger.h"
 
 // Include midifile library
 #include "midifile/include/MidiFile.h"
+#include "midifile/include/MidiStreamReader.h"
 using namespace smf;
 
 // ===== Global Variables =====
@@ -38,13 +42,19 @@ static bool                     g_SwapChainOccluded = false;
 static UINT                     g_ResizeWidth = 0, g_ResizeHeight = 0;
 static ID3D11RenderTargetView*  g_mainRenderTargetView = nullptr;
 
-// FTDI and YM2163
-static FT_HANDLE g_ftHandle = NULL;
+// SPFM output transport and YM2163
+static SpfmTransport* g_transport = nullptr;
+static char g_transportSpec[256] = "ftdi:0";  // From INI [Settings] Transport or --transport=
+
+// VGM register log (Bus Statistics panel)
+static VgmLogger g_vgmLogger;
+static char g_vgmLogPath[MAX_PATH] = "ym2163_session.vgm";
 
 // UI State
 static int g_currentOctave = 2;
 static bool g_keyStates[256] = {0};
 static std::string g_logBuffer;
+static std::mutex g_logMutex;  // log_command() is called from every thread
 static bool g_autoScroll = true;
 static char g_logDisplayBuffer[32768] = {0};
 static size_t g_lastLogSize = 0;
@@ -130,7 +140,11 @@ typedef struct {
 } ChannelState;
 
 // 16 channels total: 4 on each Slot (Slot0-Slot3)
-static ChannelState g_channels[16] = {
+#define YM_MAX_CHIPS        4
+#define YM_VOICES_PER_CHIP  4
+#define YM_MAX_VOICES       (YM_MAX_CHIPS * YM_VOICES_PER_CHIP)
+
+static ChannelState g_channels[YM_MAX_VOICES] = {
     {0, 0, 0, false, -1, 0, 0, 0, 0, {}, {}, false, 0.0f},  // Chip 0, Channel 0
     {0, 0, 0, false, -1, 0, 0, 0, 0, {}, {}, false, 0.0f},  // Chip 0, Channel 1
     {0, 0, 0, false, -1, 0, 0, 0, 0, {}, {}, false, 0.0f},  // Chip 0, Channel 2
@@ -150,6 +164,16 @@ static ChannelState g_channels[16] = {
 };
 static int g_nextFIFOChannel = 0;  // FIFO channel allocation index
 
+// Voices usable with the enabled chips (the first N entries of g_channels)
+static inline int get_voice_count() {
+    return YM_VOICES_PER_CHIP * (1 + (g_enableSecondYM2163 ? 1 : 0) +
+                                 (g_enableThirdYM2163 ? 1 : 0) + (g_enableFourthYM2163 ? 1 : 0));
+}
+
+static inline int get_chip_count() {
+    return get_voice_count() / YM_VOICES_PER_CHIP;
+}
+
 // Drum pads
 static bool g_drumPressed[5] = {false};
 static bool g_drumActive[4][5] = {{false}};  // Track drum active state for each chip [chipIndex][drumIndex]
@@ -204,10 +228,81 @@ struct DrumConfig {
 static std::map<int, InstrumentConfig> g_instrumentConfigs;
 static std::map<int, DrumConfig> g_drumConfigs;
 
+// Instrument of one note-on, resolved from the channel's program at load time
+// so playback does no config lookups
+struct ResolvedInstrument {
+    int8_t wave;
+    int8_t envelope;
+    int8_t pedalMode;  // Per-instrument override, 0 = use global g_pedalMode
+};
+
+ResolvedInstrument ResolveInstrument(int program) {
+    ResolvedInstrument resolved;
+    std::map<int, InstrumentConfig>::const_iterator it = g_instrumentConfigs.find(program);
+    if (it != g_instrumentConfigs.end()) {
+        resolved.wave = (int8_t)it->second.wave;
+        resolved.envelope = (int8_t)it->second.envelope;
+        resolved.pedalMode = (int8_t)it->second.pedalMode;
+    } else {
+        // Fallback to default (Piano with Decay)
+        resolved.wave = 4;
+        resolved.envelope = 0;
+        resolved.pedalMode = 0;
+    }
+    return resolved;
+}
+
+// ===== Playback Event Array =====
+// LoadMIDIFile() converts the joined track into flat arrays: song time, a packed
+// 4-byte message, the resolved instrument, the note's end time and its planned
+// voices, about 25 bytes per event (the last three are only set for note-ons
+// but kept per event, so every array shares the event index). The sequencer,
+// seek index, analyzers and compiler only walk these arrays; the MidiFile is
+// read in arena mode (events in large blocks, short messages inline) and freed
+// as a whole after loading.
+// Messages playback does not use (other meta events, sysex, pitch bend...) are
+// dropped during the conversion.
+
+enum {
+    PEV_NOTE_ON = 0,   // data1 = key, data2 = velocity (> 0)
+    PEV_NOTE_OFF,      // data1 = key (includes note-on with velocity 0)
+    PEV_CONTROLLER,    // data1 = controller, data2 = value
+    PEV_PROGRAM,       // data1 = program
+    PEV_TEMPO          // channel/data1/data2 = 24-bit microseconds per quarter note
+};
+
+struct PlaybackEvent {
+    uint8_t type;
+    uint8_t channel;
+    uint8_t data1;
+    uint8_t data2;
+};
+
+struct PlaybackEvents {
+    std::vector<uint64_t> timeUs;                // Song time, all tempo changes applied
+    std::vector<PlaybackEvent> message;
+    std::vector<ResolvedInstrument> instrument;  // Set for note-ons (ResolveMIDIInstruments)
+    std::vector<uint64_t> noteEndUs;             // Set for note-ons: time of the matching note-off
+    std::vector<uint16_t> voicePlan;             // Set for note-ons: planned voice per chip count (BuildVoicePlan)
+
+    int size() const { return (int)timeUs.size(); }
+
+    void clear() {
+        // Release the memory, not just the elements
+        std::vector<uint64_t>().swap(timeUs);
+        std::vector<PlaybackEvent>().swap(message);
+        std::vector<ResolvedInstrument>().swap(instrument);
+        std::vector<uint64_t>().swap(noteEndUs);
+        std::vector<uint16_t>().swap(voicePlan);
+    }
+};
+
 // ===== MIDI Player State =====
 
 struct MidiPlayerState {
-    MidiFile midiFile;
+    PlaybackEvents events;   // Flat event arrays of the loaded song
+    MidiTempoMap tempoMap;   // Kept from the MidiFile for tick<->time lookups
+    MidiTrackStats stats;    // Note/channel counts of all tracks, collected while reading
     std::string currentFileName;
     bool isPlaying;
     bool isPaused;
@@ -215,28 +310,85 @@ struct MidiPlayerState {
     std::chrono::steady_clock::time_point playStartTime;
     std::chrono::steady_clock::time_point pauseTime;
     std::chrono::milliseconds pausedDuration;
-    double tempo;  // microseconds per quarter note
+    double tempo;  // microseconds per quarter note currently in effect (informational)
     int ticksPerQuarterNote;
 
     // High-precision timer for accurate MIDI playback (yasp-style optimization)
     LARGE_INTEGER perfCounterFreq;
     LARGE_INTEGER lastPerfCounter;
-    double accumulatedTime;  // Accumulated microseconds for precise timing
+    double accumulatedTime;  // Song position in microseconds (all tempo changes applied)
+
+    // Last program change and bank select (CC0 << 7 | CC32) per MIDI channel
+    int channelProgram[16];
+    int channelBank[16];
 
-    // Track which notes are currently playing for each MIDI channel
-    std::map<int, std::map<int, int>> activeNotes;  // channel -> note -> YM2163 channel
+    // Program per channel before events[0]; not all 0 once bounded memory
+    // playback has dropped the start of the song
+    int firstProgram[16];
+
+    // Set by the sequencer thread at end of track; stop/auto-next run on the UI thread
+    bool trackFinished;
+
+    // Set while the streaming loader is still appending events; resolvePending
+    // is set when an instrument config changes meanwhile
+    bool loading;
+    bool resolvePending;
 
     MidiPlayerState() : isPlaying(false), isPaused(false), currentTick(0),
                         tempo(500000.0), ticksPerQuarterNote(120),
-                        pausedDuration(0), accumulatedTime(0.0) {
+                        pausedDuration(0), accumulatedTime(0.0), trackFinished(false),
+                        loading(false), resolvePending(false) {
         // Initialize high-precision counter
         QueryPerformanceFrequency(&perfCounterFreq);
         QueryPerformanceCounter(&lastPerfCounter);
+        memset(channelProgram, 0, sizeof(channelProgram));
+        memset(channelBank, 0, sizeof(channelBank));
+        memset(firstProgram, 0, sizeof(firstProgram));
     }
 };
 
 static MidiPlayerState g_midiPlayer;
 
+// ===== Sequencer / Engine Lock =====
+// MIDI and register-stream playback run on their own thread (see Sequencer Thread)
+// so event timing does not depend on the render loop, vsync or window dragging.
+// Everything the sequencer touches (player state, channels, register shadow, SPFM
+// producer side, piano key state, settings it reads) is guarded by g_engineMutex.
+// The sequencer holds it only while dispatching due events. The UI takes it around
+// each change it makes and once per frame to copy what it draws (Engine View); it
+// never holds it while building the frame, resetting chips or reading a file.
+// The song data is only replaced while playback is stopped, when the sequencer
+// does not look at it, so loading needs no lock until the song is published.
+// Recursive because the engine functions lock for themselves and call each other.
+
+static std::recursive_mutex g_engineMutex;
+
+#define SEQ_IDLE_US        5000.0  // Longest sleep between checks when nothing is due
+#define SEQ_SPIN_US         200.0  // Finish each wait spinning (high-resolution timer slack)
+#define SEQ_SPIN_US_LOWRES 1500.0  // Spin margin with the 1 ms fallback timer
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+struct SequencerState {
+    std::thread thread;
+    std::atomic<bool> running;
+    HANDLE timer;            // High-resolution waitable timer (falls back to 1 ms timer)
+    HANDLE wakeEvent;        // Signalled when playback starts/seeks so the thread re-plans
+    bool highResTimer;
+
+    // Wake-up accuracy against event deadlines (since last reset)
+    std::atomic<uint64_t> deadlines;
+    std::atomic<uint64_t> lateSumUs;
+    std::atomic<uint64_t> lateMaxUs;
+
+    SequencerState() : running(false), timer(NULL), wakeEvent(NULL), highResTimer(false),
+                       deadlines(0), lateSumUs(0), lateMaxUs(0) {}
+};
+
+static SequencerState g_sequencer;
+
 // ===== File Browser State =====
 
 struct FileEntry {
@@ -278,10 +430,6 @@ static bool g_autoPlayNext = true;  // Auto-play next track when current finishe
 static std::vector<std::string> g_midiFolderHistory;  // History of folders containing MIDI files
 static const char* g_midiFolderHistoryFile = "ym2163_folder_history.ini";
 
-// Timer for MIDI playback during window drag
-#define TIMER_MIDI_UPDATE 1
-static bool g_isWindowDragging = false;
-
 // Tuning window control
 static bool g_showTuningWindow = false;
 
@@ -294,6 +442,11 @@ static HWND g_mainWindow = NULL;
 
 // MIDI playback options
 static bool g_enableAutoSkipSilence = true;  // Auto-skip silence at start of MIDI
+static bool g_lookAheadSteal = true;  // Steal the voice whose note ends soonest (known from the file)
+static bool g_useVoicePlan = true;    // Song notes use the voices assigned at load (BuildVoicePlan)
+static bool g_streamingLoad = true;   // Start playing while the rest of the file is decoded (Streaming Loader)
+static bool g_boundedMemory = true;   // Stream larger files through a fixed event window (Streaming Loader)
+static int g_memoryLimitMB = 256;     // Event memory above which a file uses the window
 
 // Hot key IDs
 #define HK_PLAY_PAUSE 1001
@@ -307,6 +460,10 @@ void PlayMIDI();
 void StopMIDI();
 void PlayNextMIDI();
 void PlayPreviousMIDI();
+void StopRegisterStream();
+void sequencer_wake();
+void ProcessMIDIEvent(const PlaybackEvent& event, int index = -1);
+void ResolveMIDIInstruments();
 void AddToMIDIFolderHistory(const char* folderPath);
 void SaveMIDIFolderHistory();
 void LoadMIDIFolderHistory();
@@ -317,68 +474,408 @@ void UpdateChannelLevels();  // v10: Update envelope levels for level meters
 void UpdateDrumLevels();     // v10: Update drum levels for level meters
 extern IMGUI_IMPL_API LRESULT ImGui_ImplWin32_WndProcHandler(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
-// ===== FTDI Communication =====
+// ===== SPFM Transport =====
 
 static uint8_t g_lastRegAddr = 0xFF;
 static bool g_expectingData = false;
 
-int ftdi_init(int dev_idx) {
-    FT_STATUS status;
+// Create and open the output transport described by spec (see spfm_transport.h)
+int spfm_transport_init(const char* spec) {
+    spfm_transport_set_logger(log_command);
+
+    log_command("Output transport: %s", spec);
+    SpfmTransport* transport = spfm_transport_create(spec);
+    if (!transport) return -1;
+
+    if (!transport->open()) {
+        delete transport;
+        return -1;
+    }
+    g_transport = transport;
+    return 0;
+}
+
+// Transport spec: INI [Settings] Transport, overridden by --transport=<spec>
+void LoadTransportSpec(const char* cmdLine) {
+    GetPrivateProfileStringA("Settings", "Transport", "ftdi:0",
+                             g_transportSpec, sizeof(g_transportSpec), g_midiConfigPath);
+
+    const char* opt = cmdLine ? strstr(cmdLine, "--transport=") : nullptr;
+    if (opt) {
+        opt += strlen("--transport=");
+        size_t len = strcspn(opt, " \t");
+        if (len >= sizeof(g_transportSpec)) len = sizeof(g_transportSpec) - 1;
+        memcpy(g_transportSpec, opt, len);
+        g_transportSpec[len] = '\0';
+    }
+}
+
+// Only call after spfm_output_stop(): the output thread writes through g_transport
+void spfm_transport_shutdown() {
+    if (!g_transport) return;
+    g_transport->close();
+    delete g_transport;
+    g_transport = nullptr;
+}
+
+// ===== SPFM Write Queue / Output Thread =====
+// Register writes never touch USB on the calling thread. Producers (UI and
+// sequencer) stage timestamped SPFM packets in one queue per slot with
+// spfm_queue_packet(). spfm_flush() moves them into a lock-free single-producer
+// / single-consumer ring round-robin, one register write (address + data
+// packet) per slot at a time, so simultaneous key-ons on different chips go out
+// back to back instead of one chip's burst waiting behind another's, and
+// publishes the batch in one step. The SPFM output
+// thread drains all published packets, packs them into one buffer and sends
+// them with a single transport write, so only that thread ever waits on the
+// device.
+//
+// Producers (window procedure, main loop, sequencer thread) only queue while
+// holding g_engineMutex, which keeps the ring single-producer.
+//
+// Backpressure: if the ring is full the producer publishes what it has
+// staged and waits for the output thread to free slots (counted as an
+// overflow). The ring is sized so this only happens if the device stalls.
+
+#define SPFM_RING_CAPACITY   8192  // Packets (power of two)
+#define SPFM_WRITE_BUFFER    4096  // Bytes per transport write on the output thread
+#define SPFM_SLOT_STAGING    1024  // Packets staged per slot between flushes
+#define SPFM_INTERLEAVE      2     // Packets moved from each slot per round (one register write)
+
+struct SpfmPacket {
+    uint64_t timestampUs;  // spfm_now_us() when the packet was queued
+    uint8_t data[4];       // {slot, 0x80, data} or the 4-byte reset command
+    uint8_t length;
+};
+
+// Producer-private packets of one slot, waiting for spfm_flush()
+struct SpfmSlotQueue {
+    SpfmPacket packets[SPFM_SLOT_STAGING];
+    int count;
+};
+
+struct SpfmWriteQueue {
+    SpfmSlotQueue slots[4];
+    SpfmPacket ring[SPFM_RING_CAPACITY];
+    std::atomic<uint32_t> head;  // Published packets (written by producer)
+    std::atomic<uint32_t> tail;  // Consumed packets (written by output thread)
+    std::atomic<uint32_t> sent;  // Packets whose transport write has completed
+    uint32_t stagedHead;         // Producer-private: in the ring but not yet published
+
+    std::thread thread;
+    std::atomic<bool> running;
+    std::mutex wakeMutex;
+    std::condition_variable wakeCond;
+
+    // Statistics (since last reset)
+    std::atomic<uint64_t> totalPackets;     // Packets sent
+    std::atomic<uint64_t> totalBytes;       // Bytes sent
+    std::atomic<uint64_t> totalFlushes;     // Transport writes issued
+    std::atomic<int> lastFlushPackets;      // Packets in the most recent write
+    std::atomic<int> maxFlushPackets;       // Largest single write
+    std::atomic<uint32_t> ringHighWater;    // Highest ring occupancy seen at publish
+    std::atomic<uint64_t> overflowEvents;   // Producer found the ring full
+    std::atomic<uint64_t> overflowWaitUs;   // Total time producers waited for space
+    std::atomic<uint64_t> latencySumUs;     // Queue-to-write-complete latency, summed per packet
+    std::atomic<uint64_t> latencyMaxUs;
+
+    SpfmWriteQueue() : head(0), tail(0), sent(0), stagedHead(0), running(false),
+                       totalPackets(0), totalBytes(0), totalFlushes(0),
+                       lastFlushPackets(0), maxFlushPackets(0), ringHighWater(0),
+                       overflowEvents(0), overflowWaitUs(0),
+                       latencySumUs(0), latencyMaxUs(0) {
+        memset(ring, 0, sizeof(ring));
+        memset(slots, 0, sizeof(slots));
+    }
+};
+
+static SpfmWriteQueue g_spfmQueue;
+
+static inline uint64_t spfm_now_us() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Output thread: waits for published packets and sends each batch in one write
+void spfm_output_thread() {
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+
+    uint8_t buffer[SPFM_WRITE_BUFFER];
+
+    while (true) {
+        uint32_t head = g_spfmQueue.head.load(std::memory_order_acquire);
+        uint32_t tail = g_spfmQueue.tail.load(std::memory_order_relaxed);
+
+        if (head == tail) {
+            if (!g_spfmQueue.running.load(std::memory_order_acquire)) break;
+            std::unique_lock<std::mutex> lock(g_spfmQueue.wakeMutex);
+            g_spfmQueue.wakeCond.wait_for(lock, std::chrono::milliseconds(5), [] {
+                return g_spfmQueue.head.load(std::memory_order_acquire) !=
+                       g_spfmQueue.tail.load(std::memory_order_relaxed) ||
+                       !g_spfmQueue.running.load(std::memory_order_acquire);
+            });
+            continue;
+        }
+
+        // Pack as many published packets as fit into one transfer
+        int length = 0;
+        int packets = 0;
+        uint64_t oldestUs = 0;
+        while (tail != head) {
+            const SpfmPacket& packet = g_spfmQueue.ring[tail & (SPFM_RING_CAPACITY - 1)];
+            if (length + packet.length > SPFM_WRITE_BUFFER) break;
+            if (packets == 0) oldestUs = packet.timestampUs;
+            memcpy(buffer + length, packet.data, packet.length);
+            length += packet.length;
+            packets++;
+            tail++;
+        }
+        // Slots are free as soon as their bytes are copied out
+        g_spfmQueue.tail.store(tail, std::memory_order_release);
+
+        if (g_transport) {
+            g_transport->write(buffer, length);
+        }
+
+        uint64_t latencyUs = spfm_now_us() - oldestUs;
+        g_spfmQueue.sent.store(tail, std::memory_order_release);
+
+        g_spfmQueue.totalPackets += packets;
+        g_spfmQueue.totalBytes += length;
+        g_spfmQueue.totalFlushes++;
+        g_spfmQueue.lastFlushPackets = packets;
+        if (packets > g_spfmQueue.maxFlushPackets) g_spfmQueue.maxFlushPackets = packets;
+        g_spfmQueue.latencySumUs += latencyUs * packets;
+        if (latencyUs > g_spfmQueue.latencyMaxUs) g_spfmQueue.latencyMaxUs = latencyUs;
+    }
+}
+
+// Publish the ring packets written since the last publish and wake the output thread
+static void spfm_publish() {
+    uint32_t staged = g_spfmQueue.stagedHead;
+    if (staged == g_spfmQueue.head.load(std::memory_order_relaxed)) return;
+
+    g_spfmQueue.head.store(staged, std::memory_order_release);
+
+    uint32_t occupancy = staged - g_spfmQueue.tail.load(std::memory_order_acquire);
+    if (occupancy > g_spfmQueue.ringHighWater) g_spfmQueue.ringHighWater = occupancy;
+
+    { std::lock_guard<std::mutex> lock(g_spfmQueue.wakeMutex); }
+    g_spfmQueue.wakeCond.notify_one();
+}
+
+// Append one packet to the ring. Backpressure: if the ring is full, publish
+// what is already in it and wait for the output thread to free slots.
+static void spfm_ring_push(const SpfmPacket& packet) {
+    uint32_t staged = g_spfmQueue.stagedHead;
+
+    if (staged - g_spfmQueue.tail.load(std::memory_order_acquire) >= SPFM_RING_CAPACITY) {
+        g_spfmQueue.overflowEvents++;
+        uint64_t waitStart = spfm_now_us();
+        spfm_publish();
+        while (g_spfmQueue.running.load(std::memory_order_relaxed) &&
+               staged - g_spfmQueue.tail.load(std::memory_order_acquire) >= SPFM_RING_CAPACITY) {
+            std::this_thread::yield();
+        }
+        g_spfmQueue.overflowWaitUs += spfm_now_us() - waitStart;
+    }
+
+    g_spfmQueue.ring[staged & (SPFM_RING_CAPACITY - 1)] = packet;
+    g_spfmQueue.stagedHead = staged + 1;
+}
 
-    DWORD numDevs = 0;
-    status = FT_CreateDeviceInfoList(&numDevs);
-    if (status == FT_OK && numDevs > 0) {
-        log_command("=== FTDI Device Detection ===");
-        log_command("Found %lu FTDI device(s)", numDevs);
+// Move everything staged since the last flush into the ring, interleaving the
+// slots, and publish it
+void spfm_flush() {
+    SpfmSlotQueue* slots = g_spfmQueue.slots;
+    int remaining = slots[0].count + slots[1].count + slots[2].count + slots[3].count;
+    if (remaining == 0) return;
 
-        FT_DEVICE_LIST_INFO_NODE *devInfo = (FT_DEVICE_LIST_INFO_NODE*)
-            malloc(sizeof(FT_DEVICE_LIST_INFO_NODE) * numDevs);
-        status = FT_GetDeviceInfoList(devInfo, &numDevs);
+    if (!g_spfmQueue.running.load(std::memory_order_relaxed)) {
+        // No output thread (device not open): drop the batch
+        for (int slot = 0; slot < 4; slot++) slots[slot].count = 0;
+        return;
+    }
 
-        if (status == FT_OK) {
-            for (DWORD i = 0; i < numDevs; i++) {
-                log_command("Device %lu: %s (Serial: %s)",
-                    i, devInfo[i].Description, devInfo[i].SerialNumber);
+    int taken[4] = {0, 0, 0, 0};
+    while (remaining > 0) {
+        for (int slot = 0; slot < 4; slot++) {
+            for (int n = 0; n < SPFM_INTERLEAVE && taken[slot] < slots[slot].count; n++) {
+                spfm_ring_push(slots[slot].packets[taken[slot]++]);
+                remaining--;
             }
         }
-        free(devInfo);
     }
+    for (int slot = 0; slot < 4; slot++) slots[slot].count = 0;
 
-    log_command("Opening device index %d...", dev_idx);
-    status = FT_Open(dev_idx, &g_ftHandle);
-    if (status != FT_OK) {
-        log_command("ERROR: Failed to open device (status=%d)", status);
-        return -1;
+    spfm_publish();
+}
+
+// Wait until the output thread has written every published packet to the
+// device. Needs no engine lock, so callers release it before settle delays.
+void spfm_wait_sent() {
+    if (!g_spfmQueue.running.load(std::memory_order_relaxed)) return;
+    uint32_t target = g_spfmQueue.head.load(std::memory_order_acquire);
+    while (g_spfmQueue.sent.load(std::memory_order_acquire) != target) {
+        Sleep(1);
     }
+}
 
-    log_command("Configuring FTDI parameters...");
-    FT_SetBaudRate(g_ftHandle, 1500000);
-    FT_SetDataCharacteristics(g_ftHandle, FT_BITS_8, FT_STOP_BITS_1, FT_PARITY_NONE);
-    FT_SetFlowControl(g_ftHandle, FT_FLOW_NONE, 0, 0);
-    FT_SetTimeouts(g_ftHandle, 100, 100);
-    FT_SetLatencyTimer(g_ftHandle, 2);
-    FT_Purge(g_ftHandle, FT_PURGE_RX | FT_PURGE_TX);
+// Flush and wait until the output thread has written everything to the device.
+// Used where the chip needs real settle time (reset, re-init).
+void spfm_drain() {
+    spfm_flush();
+    spfm_wait_sent();
+}
 
-    log_command("FTDI initialized successfully");
-    return 0;
+// Stage one SPFM packet in its slot's queue (packet[0] is the slot); it is
+// sent after the next spfm_flush()
+void spfm_queue_packet(const uint8_t* packet, int length) {
+    SpfmSlotQueue& queue = g_spfmQueue.slots[packet[0] & 3];
+    if (queue.count == SPFM_SLOT_STAGING) spfm_flush();
+
+    SpfmPacket& slot = queue.packets[queue.count++];
+    slot.timestampUs = spfm_now_us();
+    memcpy(slot.data, packet, length);
+    slot.length = (uint8_t)length;
+}
+
+void spfm_output_start() {
+    if (g_spfmQueue.running) return;
+    uint32_t head = g_spfmQueue.head.load();
+    g_spfmQueue.tail = head;
+    g_spfmQueue.sent = head;
+    g_spfmQueue.stagedHead = head;
+    for (int slot = 0; slot < 4; slot++) g_spfmQueue.slots[slot].count = 0;
+    g_spfmQueue.running = true;
+    g_spfmQueue.thread = std::thread(spfm_output_thread);
+}
+
+// Sends whatever is still queued, then stops the output thread
+void spfm_output_stop() {
+    if (!g_spfmQueue.running) return;
+    spfm_flush();
+    g_spfmQueue.running = false;
+    { std::lock_guard<std::mutex> lock(g_spfmQueue.wakeMutex); }
+    g_spfmQueue.wakeCond.notify_one();
+    if (g_spfmQueue.thread.joinable()) g_spfmQueue.thread.join();
+}
+
+uint32_t spfm_ring_occupancy() {
+    return g_spfmQueue.head.load(std::memory_order_acquire) -
+           g_spfmQueue.tail.load(std::memory_order_acquire);
+}
+
+void spfm_reset_stats() {
+    g_spfmQueue.totalPackets = 0;
+    g_spfmQueue.totalBytes = 0;
+    g_spfmQueue.totalFlushes = 0;
+    g_spfmQueue.lastFlushPackets = 0;
+    g_spfmQueue.maxFlushPackets = 0;
+    g_spfmQueue.ringHighWater = 0;
+    g_spfmQueue.overflowEvents = 0;
+    g_spfmQueue.overflowWaitUs = 0;
+    g_spfmQueue.latencySumUs = 0;
+    g_spfmQueue.latencyMaxUs = 0;
+}
+
+void LogSpfmQueueStats() {
+    uint64_t flushes = g_spfmQueue.totalFlushes;
+    if (flushes == 0) return;
+    uint64_t packets = g_spfmQueue.totalPackets;
+    log_command("SPFM queue: %llu packets (%llu bytes) coalesced into %llu writes (avg %.1f, max %d per write)",
+                (unsigned long long)packets,
+                (unsigned long long)g_spfmQueue.totalBytes,
+                (unsigned long long)flushes,
+                (double)packets / (double)flushes,
+                g_spfmQueue.maxFlushPackets.load());
+    log_command("SPFM ring: high-water %u/%d, %llu overflows, latency avg %.0f us / max %llu us",
+                g_spfmQueue.ringHighWater.load(), SPFM_RING_CAPACITY,
+                (unsigned long long)g_spfmQueue.overflowEvents,
+                packets > 0 ? (double)g_spfmQueue.latencySumUs / (double)packets : 0.0,
+                (unsigned long long)g_spfmQueue.latencyMaxUs);
+    uint64_t deadlines = g_sequencer.deadlines;
+    if (deadlines == 0) return;
+    log_command("Sequencer lateness: avg %.0f us  max %llu us  (%llu events, %s timer)",
+                (double)g_sequencer.lateSumUs / (double)deadlines,
+                (unsigned long long)g_sequencer.lateMaxUs, (unsigned long long)deadlines,
+                g_sequencer.highResTimer ? "high-res" : "1 ms");
+}
+
+// ===== Register Stream Format =====
+// Compiled songs (see CompileMIDIToRegisterStream) are a header followed by
+// fixed 8-byte records, one per register write, in the order they were issued.
+// Times are deltas so the file stays compact; playback only has to add them up.
+
+#define REG_STREAM_MAGIC   "YM63RS01"
+#define REG_STREAM_VERSION 1
+
+#pragma pack(push, 1)
+struct RegStreamHeader {
+    char magic[8];          // REG_STREAM_MAGIC
+    uint32_t version;
+    uint32_t recordCount;
+    uint64_t durationUs;    // Time of the last record
+    uint32_t chipMask;      // Slots enabled when compiled (bit n = Slot n)
+    uint32_t reserved;
+};
+
+struct RegStreamRecord {
+    uint32_t deltaUs;       // Microseconds since the previous record
+    uint8_t slot;
+    uint8_t reg;
+    uint8_t data;
+    uint8_t flags;          // Reserved, 0
+};
+#pragma pack(pop)
+
+// While compiling, register writes are appended here instead of going to the SPFM queue
+struct RegStreamCapture {
+    std::vector<RegStreamRecord> records;
+    uint64_t nowUs;         // Song position of the event being compiled
+    uint64_t lastUs;        // Song position of the previous record
+};
+static RegStreamCapture* g_regStreamCapture = nullptr;
+
+// Voice allocation and drum timing read the clock through ym_now(). During a
+// compile it returns the song position, so find_free_channel() makes the same
+// decisions it would make in real time and the output is reproducible.
+static bool g_virtualClockActive = false;
+static std::chrono::steady_clock::time_point g_virtualClockNow;
+
+static inline std::chrono::steady_clock::time_point ym_now() {
+    return g_virtualClockActive ? g_virtualClockNow : std::chrono::steady_clock::now();
 }
 
 // Write to YM2163 melody channel with chip selection
 // chipIndex: 0=Slot0, 1=Slot1
 void write_melody_cmd_chip(uint8_t data, int chipIndex) {
-    if (!g_ftHandle) return;
-    // SPFM format: {slot_select, command, data}
-    // Slot0: 0x00, Slot1: 0x01
-    uint8_t cmd[3] = {(uint8_t)chipIndex, 0x80, data};
-    DWORD written;
-    FT_Write(g_ftHandle, cmd, 3, &written);
-    FT_Purge(g_ftHandle, FT_PURGE_TX);
+    if (!g_transport && !g_regStreamCapture) return;
+    if (!g_regStreamCapture) {
+        // SPFM format: {slot_select, command, data}
+        // Slot0: 0x00, Slot1: 0x01
+        uint8_t cmd[3] = {(uint8_t)chipIndex, 0x80, data};
+        spfm_queue_packet(cmd, 3);
+    }
 
     if (!g_expectingData) {
         g_lastRegAddr = data;
         g_expectingData = true;
     } else {
         g_expectingData = false;
+        if (g_regStreamCapture) {
+            RegStreamRecord record;
+            record.deltaUs = (uint32_t)(g_regStreamCapture->nowUs - g_regStreamCapture->lastUs);
+            record.slot = (uint8_t)chipIndex;
+            record.reg = g_lastRegAddr;
+            record.data = data;
+            record.flags = 0;
+            g_regStreamCapture->records.push_back(record);
+            g_regStreamCapture->lastUs = g_regStreamCapture->nowUs;
+        } else if (g_vgmLogger.active()) {
+            // Data phase completes a register write: record it (melody and drums, all slots)
+            g_vgmLogger.write((uint8_t)chipIndex, g_lastRegAddr, data, spfm_now_us());
+        }
     }
 }
 
@@ -387,42 +884,150 @@ void write_melody_cmd(uint8_t data) {
     write_melody_cmd_chip(data, 0);
 }
 
+// ===== YM2163 Register Shadow =====
+// Last value written to every register (0x80-0x9D) of every slot. A write whose
+// value already matches the shadow is dropped before it reaches the SPFM queue.
+// The shadow is invalidated whenever the chip is reset or re-initialized.
+
+#define YM2163_REG_FIRST  0x80
+#define YM2163_REG_LAST   0x9D
+#define YM2163_REG_COUNT  (YM2163_REG_LAST - YM2163_REG_FIRST + 1)
+#define YM2163_REG_RHYTHM 0x90  // Rhythm key-on bits: every write is a trigger, never elided
+
+struct RegisterShadow {
+    uint8_t value[4][YM2163_REG_COUNT];
+    bool valid[4][YM2163_REG_COUNT];
+
+    // Statistics (since last reset)
+    uint64_t writesRequested[4];  // Register writes issued by the driver, per slot
+    uint64_t writesElided[4];     // Writes dropped because the shadow already matched
+
+    RegisterShadow() {
+        memset(value, 0, sizeof(value));
+        memset(valid, 0, sizeof(valid));
+        memset(writesRequested, 0, sizeof(writesRequested));
+        memset(writesElided, 0, sizeof(writesElided));
+    }
+};
+
+static RegisterShadow g_regShadow;
+
+// Timbre (0x88+ch) and volume (0x8C+ch) register values for a note
+static inline uint8_t ym2163_timbre_value(int timbre, int envelope) {
+    return (uint8_t)((timbre & 0x07) | ((envelope & 0x03) << 4));
+}
+
+static inline uint8_t ym2163_volume_value(int volume) {
+    return (uint8_t)(0x0F | ((volume & 0x03) << 4));
+}
+
+// True if a write of data to reg would be elided
+static inline bool register_shadow_holds(int chipIndex, uint8_t reg, uint8_t data) {
+    int slot = reg - YM2163_REG_FIRST;
+    return g_regShadow.valid[chipIndex][slot] && g_regShadow.value[chipIndex][slot] == data;
+}
+
+void invalidate_register_shadow(int chipIndex) {
+    if (chipIndex < 0 || chipIndex >= 4) return;
+    memset(g_regShadow.valid[chipIndex], 0, sizeof(g_regShadow.valid[chipIndex]));
+}
+
+void invalidate_all_register_shadows() {
+    memset(g_regShadow.valid, 0, sizeof(g_regShadow.valid));
+}
+
+// Write one YM2163 register (address byte + data byte) unless the shadow
+// shows the register already holds this value
+void write_reg_chip(uint8_t reg, uint8_t data, int chipIndex) {
+    if (!g_transport && !g_regStreamCapture) return;
+    if (chipIndex < 0 || chipIndex >= 4) return;
+
+    g_regShadow.writesRequested[chipIndex]++;
+
+    bool cacheable = (reg >= YM2163_REG_FIRST && reg <= YM2163_REG_LAST);
+    int slot = reg - YM2163_REG_FIRST;
+
+    if (cacheable && reg != YM2163_REG_RHYTHM &&
+        g_regShadow.valid[chipIndex][slot] && g_regShadow.value[chipIndex][slot] == data) {
+        g_regShadow.writesElided[chipIndex]++;
+        return;
+    }
+
+    write_melody_cmd_chip(reg, chipIndex);
+    write_melody_cmd_chip(data, chipIndex);
+
+    if (cacheable) {
+        g_regShadow.value[chipIndex][slot] = data;
+        g_regShadow.valid[chipIndex][slot] = true;
+    }
+}
+
+void reset_register_shadow_stats() {
+    memset(g_regShadow.writesRequested, 0, sizeof(g_regShadow.writesRequested));
+    memset(g_regShadow.writesElided, 0, sizeof(g_regShadow.writesElided));
+}
+
+uint64_t get_register_writes_requested() {
+    uint64_t total = 0;
+    for (int chip = 0; chip < 4; chip++) total += g_regShadow.writesRequested[chip];
+    return total;
+}
+
+uint64_t get_register_writes_elided() {
+    uint64_t total = 0;
+    for (int chip = 0; chip < 4; chip++) total += g_regShadow.writesElided[chip];
+    return total;
+}
+
+void LogRegisterShadowStats() {
+    uint64_t requested = get_register_writes_requested();
+    if (requested == 0) return;
+    uint64_t elided = get_register_writes_elided();
+    log_command("Register shadow: %llu of %llu writes elided (%.1f%%)",
+                (unsigned long long)elided, (unsigned long long)requested,
+                100.0 * (double)elided / (double)requested);
+}
+
 // Initialize one YM2163 chip
 void init_single_ym2163(int chipIndex) {
     log_command(chipIndex == 0 ? "=== Initializing YM2163 Slot0 ===" : "=== Initializing YM2163 Slot1 ===");
 
+    // Chip state is unknown until every register has been written again
+    invalidate_register_shadow(chipIndex);
+
     for (int ch = 0; ch < 4; ch++) {
-        write_melody_cmd_chip(0x88 + ch, chipIndex);
-        write_melody_cmd_chip(0x14, chipIndex);
-        write_melody_cmd_chip(0x8C + ch, chipIndex);
-        write_melody_cmd_chip(0x0F, chipIndex);
-        write_melody_cmd_chip(0x84 + ch, chipIndex);
-        write_melody_cmd_chip(0x00, chipIndex);
+        write_reg_chip(0x88 + ch, 0x14, chipIndex);
+        write_reg_chip(0x8C + ch, 0x0F, chipIndex);
+        write_reg_chip(0x84 + ch, 0x00, chipIndex);
     }
 
     for (int reg = 0x94; reg <= 0x97; reg++) {
-        write_melody_cmd_chip(reg, chipIndex);
-        write_melody_cmd_chip((31 << 1) | 0, chipIndex);
+        write_reg_chip(reg, (31 << 1) | 0, chipIndex);
     }
 
-    write_melody_cmd_chip(0x90, chipIndex);
-    write_melody_cmd_chip(0x00, chipIndex);
+    write_reg_chip(0x90, 0x00, chipIndex);
 
-    write_melody_cmd_chip(0x98, chipIndex); write_melody_cmd_chip(0x00, chipIndex);
-    write_melody_cmd_chip(0x99, chipIndex); write_melody_cmd_chip(0x0D, chipIndex);
-    write_melody_cmd_chip(0x9C, chipIndex); write_melody_cmd_chip(0x04, chipIndex);
-    write_melody_cmd_chip(0x9D, chipIndex); write_melody_cmd_chip(0x04, chipIndex);
+    write_reg_chip(0x98, 0x00, chipIndex);
+    write_reg_chip(0x99, 0x0D, chipIndex);
+    write_reg_chip(0x9C, 0x04, chipIndex);
+    write_reg_chip(0x9D, 0x04, chipIndex);
 
     log_command(chipIndex == 0 ? "YM2163 Slot0 initialized" : "YM2163 Slot1 initialized");
 }
 
+// Takes the engine lock around the register writes only, not the settle delay
 void ym2163_init() {
-    uint8_t reset_cmd[4] = {0, 0, 0xFE, 0};
-    DWORD written;
-    FT_Write(g_ftHandle, reset_cmd, 4, &written);
-    FT_Purge(g_ftHandle, FT_PURGE_TX);
+    {
+        std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+        uint8_t reset_cmd[4] = {0, 0, 0xFE, 0};
+        spfm_queue_packet(reset_cmd, 4);
+        spfm_flush();
+        invalidate_all_register_shadows();
+    }
+    spfm_wait_sent();  // Reset must reach the SPFM before the settle delay
     Sleep(200);
 
+    std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
     log_command("=== YM2163 Initialization ===");
 
     // Always initialize Slot0
@@ -449,6 +1054,8 @@ void ym2163_init() {
     if (g_enableThirdYM2163) totalChannels += 4;
     if (g_enableFourthYM2163) totalChannels += 4;
     log_command("YM2163 mode: %d chips, %d channels", totalChannels / 4, totalChannels);
+
+    spfm_flush();
 }
 
 // ===== Logging =====
@@ -460,6 +1067,7 @@ void log_command(const char* format, ...) {
     vsnprintf(temp, sizeof(temp), format, args);
     va_end(args);
 
+    std::lock_guard<std::mutex> lock(g_logMutex);
     g_logBuffer += temp;
     g_logBuffer += "\n";
 
@@ -610,6 +1218,7 @@ void LoadFrequenciesFromINI() {
 // Save current instrument settings to config file
 void SaveInstrumentConfig(int instrument) {
     if (instrument < 0 || instrument > 127) return;
+    std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
 
     char section[32];
     sprintf(section, "Instrument_%d", instrument);
@@ -627,12 +1236,16 @@ void SaveInstrumentConfig(int instrument) {
         g_instrumentConfigs[instrument].wave = g_currentTimbre;
     }
 
+    // Loaded song picks up the change from its next note-on
+    ResolveMIDIInstruments();
+
     log_command("Saved Instrument %d: %s, %s", instrument, waveStr, envelopeStr);
 }
 
 // Load instrument settings from config to UI
 void LoadInstrumentConfigToUI(int instrument) {
     if (instrument < 0 || instrument > 127) return;
+    std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
 
     if (g_instrumentConfigs.count(instrument) > 0) {
         InstrumentConfig& config = g_instrumentConfigs[instrument];
@@ -695,30 +1308,26 @@ void AnalyzeVelocityDistribution() {
     // Reset analysis
     g_velocityAnalysis = VelocityAnalysis();
 
-    if (!g_midiPlayer.midiFile.status()) {
+    if (g_midiPlayer.currentFileName.empty()) {
         log_command("No MIDI file loaded for velocity analysis");
         return;
     }
 
-    // Scan all note-on events in the MIDI file
-    for (int track = 0; track < g_midiPlayer.midiFile.getTrackCount(); track++) {
-        for (int event = 0; event < g_midiPlayer.midiFile[track].getEventCount(); event++) {
-            MidiEvent& midiEvent = g_midiPlayer.midiFile[track][event];
+    // Note-on velocities were counted per track while the file was read
+    // (velocity 0 counts as note-off)
+    const MidiTrackStats& stats = g_midiPlayer.stats;
+    for (int velocity = 0; velocity < 128; velocity++) {
+        int count = stats.velocity[velocity];
+        if (count == 0) continue;
 
-            if (midiEvent.isNoteOn()) {
-                int velocity = midiEvent.getVelocity();
-                if (velocity > 0) {  // Ignore note-off (velocity 0)
-                    g_velocityAnalysis.velocityHistogram[velocity]++;
-                    g_velocityAnalysis.totalNotes++;
+        g_velocityAnalysis.velocityHistogram[velocity] = count;
+        g_velocityAnalysis.totalNotes += count;
 
-                    if (velocity < g_velocityAnalysis.minVelocity) {
-                        g_velocityAnalysis.minVelocity = velocity;
-                    }
-                    if (velocity > g_velocityAnalysis.maxVelocity) {
-                        g_velocityAnalysis.maxVelocity = velocity;
-                    }
-                }
-            }
+        if (velocity < g_velocityAnalysis.minVelocity) {
+            g_velocityAnalysis.minVelocity = velocity;
+        }
+        if (velocity > g_velocityAnalysis.maxVelocity) {
+            g_velocityAnalysis.maxVelocity = velocity;
         }
     }
 
@@ -820,151 +1429,468 @@ void AnalyzeVelocityDistribution() {
     log_command("  Mute: < %d", g_velocityAnalysis.threshold_mute);
 }
 
+// ===== Voice Allocator =====
+// Idle voices sit in one list per chip ordered by release time (never-used
+// voices first, then the one released longest ago), so a released voice is
+// appended at its chip's tail in O(1): releases happen in time order. A free
+// voice is the list head of the chip with the fewest sounding voices, which
+// spreads notes (and their register writes) over all enabled slots. When the
+// caller passes the note's timbre/envelope/volume, idle voices whose timbre and
+// volume registers already hold those values are preferred (walking the idle
+// lists, at most 16 voices), so play_note()'s 0x88/0x8C writes are elided.
+// Sounding voices sit in a steal heap keyed on (out of range first, then notes
+// that have sounded for their envelope's minimum time, then lowest pitch). A
+// second heap orders not-yet-stealable voices by the time they become
+// stealable; due ones are re-keyed right before a steal, so note-on/note-off
+// are O(log n) and never scan the channels.
+//
+// With look-ahead stealing (g_lookAheadSteal) song notes carry the time of
+// their note-off, paired at load. In-range notes are then stolen by earliest
+// end instead of age and pitch: the victim loses the least of its remaining
+// sound. Notes without a known end (keyboard, re-sounded after a seek) go last.
+//
+// play_note()/stop_note() keep this in sync; bulk changes to g_channels (channel
+// init, compile restore, chip count change, steal mode) call voice_alloc_rebuild().
+
 // Minimum note duration before it can be replaced (in milliseconds)
 static const int MIN_NOTE_DURATION_MS = 50;
 
-int find_free_channel() {
-    // Determine max channels based on second chip enable status
-    int maxChannels = 4 + (g_enableSecondYM2163 ? 4 : 0) + (g_enableThirdYM2163 ? 4 : 0) + (g_enableFourthYM2163 ? 4 : 0);
+static int voice_min_duration_ms(int envelope) {
+    switch (envelope) {
+        case 0: return 1000;  // Decay envelope: ~1 second release
+        case 1: return 500;   // Fast envelope
+        case 2: return 2000;  // Medium envelope
+        case 3: return 3000;  // Slow envelope
+    }
+    return MIN_NOTE_DURATION_MS;
+}
 
-    // Strategy 1: Find completely unused channels (never been used before)
-    for (int i = 0; i < maxChannels; i++) {
-        if (!g_channels[i].active && !g_channels[i].hasBeenUsed) {
-            g_channels[i].hasBeenUsed = true;
-            return i;
+// Binary min-heap of voice indices with position lookup, so any voice can be
+// removed or re-keyed in O(log n)
+struct VoiceHeap {
+    int items[YM_MAX_VOICES];
+    int pos[YM_MAX_VOICES];   // Index into items, -1 if not in the heap
+    int size;
+    bool (*less)(int a, int b);
+
+    void clear() {
+        size = 0;
+        for (int i = 0; i < YM_MAX_VOICES; i++) pos[i] = -1;
+    }
+    bool contains(int v) const { return pos[v] >= 0; }
+    int top() const { return size > 0 ? items[0] : -1; }
+
+    void swapAt(int i, int j) {
+        int t = items[i];
+        items[i] = items[j];
+        items[j] = t;
+        pos[items[i]] = i;
+        pos[items[j]] = j;
+    }
+    void siftUp(int i) {
+        while (i > 0) {
+            int parent = (i - 1) / 2;
+            if (!less(items[i], items[parent])) break;
+            swapAt(i, parent);
+            i = parent;
         }
     }
-
-    // Strategy 2: Find free channels (released but previously used)
-    // Prefer channels that were released longest ago (envelope has more time to complete)
-    int bestFreeChannel = -1;
-    auto oldestReleaseTime = std::chrono::steady_clock::now();
-
-    for (int i = 0; i < maxChannels; i++) {
-        if (!g_channels[i].active && g_channels[i].hasBeenUsed) {
-            // This channel is free and has been used before
-            if (bestFreeChannel < 0 || g_channels[i].releaseTime < oldestReleaseTime) {
-                bestFreeChannel = i;
-                oldestReleaseTime = g_channels[i].releaseTime;
-            }
+    void siftDown(int i) {
+        while (true) {
+            int l = 2 * i + 1, r = l + 1, m = i;
+            if (l < size && less(items[l], items[m])) m = l;
+            if (r < size && less(items[r], items[m])) m = r;
+            if (m == i) break;
+            swapAt(i, m);
+            i = m;
         }
     }
-
-    if (bestFreeChannel >= 0) {
-        return bestFreeChannel;
+    void push(int v) {
+        items[size] = v;
+        pos[v] = size;
+        siftUp(size++);
+    }
+    void update(int v) {
+        siftUp(pos[v]);
+        siftDown(pos[v]);
     }
+    void remove(int v) {
+        int i = pos[v];
+        if (i < 0) return;
+        pos[v] = -1;
+        if (i == --size) return;
+        items[i] = items[size];
+        pos[items[i]] = i;
+        update(items[i]);
+    }
+};
 
-    // Strategy 3: No free channels - use intelligent strategy to choose which channel to replace
-    // Priority:
-    // 1. Replace out-of-range notes first
-    // 2. Among valid-range notes, prefer replacing lower-pitched notes (high pitch priority)
-    // 3. Prefer notes that have played for at least MIN_NOTE_DURATION_MS
+// Steal rank: 0 = out of range, stealable; 1 = out of range, too young;
+// 2 = in range, stealable; 3 = in range, too young. Lowest rank, then pitch.
+#define VOICE_RANK_YOUNG     1
+#define VOICE_RANK_IN_RANGE  2
 
-    auto now = std::chrono::steady_clock::now();
+struct VoiceAllocator {
+    int voiceCount;                     // 0 until the first rebuild
 
-    int channelToReplace = -1;
-    int lowestOutOfRangePitch = INT_MAX;
-    int lowestInRangePitch = INT_MAX;
-    bool hasOutOfRange = false;
+    int idleHead[YM_MAX_CHIPS];         // Idle list per chip, -1 terminated
+    int idleTail[YM_MAX_CHIPS];
+    int idlePrev[YM_MAX_VOICES];
+    int idleNext[YM_MAX_VOICES];
+    bool idle[YM_MAX_VOICES];
 
-    // Track which channels have played long enough
-    bool canReplace[8] = {false};
-    for (int i = 0; i < maxChannels; i++) {
-        if (g_channels[i].active) {
-            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(now - g_channels[i].startTime);
+    int stealRank[YM_MAX_VOICES];
+    int stealPitch[YM_MAX_VOICES];
+    std::chrono::steady_clock::time_point stealableAt[YM_MAX_VOICES];
+    uint64_t noteEndUs[YM_MAX_VOICES];  // Song time of the note-off, UINT64_MAX if unknown
+    VoiceHeap steal;                    // Sounding voices, best victim on top
+    VoiceHeap young;                    // Too-young voices, earliest stealableAt on top
 
-            // Adjust minimum duration based on envelope type
-            int minDuration = MIN_NOTE_DURATION_MS;
-            if (g_channels[i].envelope == 0) {  // Decay envelope: ~1 second release
-                minDuration = 1000;  // 1 second to allow full envelope release
-            } else if (g_channels[i].envelope == 1) {  // Fast envelope
-                minDuration = 500;   // 500ms
-            } else if (g_channels[i].envelope == 2) {  // Medium envelope
-                minDuration = 2000;  // 2 seconds
-            } else if (g_channels[i].envelope == 3) {  // Slow envelope
-                minDuration = 3000;  // 3 seconds
-            }
+    int chipActive[YM_MAX_CHIPS];       // Sounding voices per chip
 
-            canReplace[i] = (duration.count() >= minDuration);
-        }
+    uint64_t steals;
+    uint64_t writesSaved;               // Timbre/volume writes avoided by affinity (per song)
+};
+
+static VoiceAllocator g_voiceAlloc;
+
+static bool voice_steal_less(int a, int b) {
+    const VoiceAllocator& va = g_voiceAlloc;
+    if (g_lookAheadSteal) {
+        int rangeA = va.stealRank[a] & VOICE_RANK_IN_RANGE;
+        int rangeB = va.stealRank[b] & VOICE_RANK_IN_RANGE;
+        if (rangeA != rangeB) return rangeA < rangeB;
+        if (va.noteEndUs[a] != va.noteEndUs[b]) return va.noteEndUs[a] < va.noteEndUs[b];
+    } else if (va.stealRank[a] != va.stealRank[b]) {
+        return va.stealRank[a] < va.stealRank[b];
     }
+    if (va.stealPitch[a] != va.stealPitch[b]) return va.stealPitch[a] < va.stealPitch[b];
+    return a < b;
+}
 
-    for (int i = 0; i < maxChannels; i++) {
-        if (!g_channels[i].active) continue;
-
-        int pitch = get_absolute_pitch(g_channels[i].note, g_channels[i].octave);
-        bool inRange = is_in_valid_range(g_channels[i].note, g_channels[i].octave);
-
-        if (!inRange) {
-            // Out of range note found
-            hasOutOfRange = true;
-            // Prefer out-of-range notes that have played long enough
-            if (canReplace[i] && pitch < lowestOutOfRangePitch) {
-                lowestOutOfRangePitch = pitch;
-                channelToReplace = i;
-            } else if (!canReplace[i] && channelToReplace < 0) {
-                // If no replaceable out-of-range notes found yet, use this as fallback
-                lowestOutOfRangePitch = pitch;
-                channelToReplace = i;
-            }
-        } else {
-            // Valid range note
-            if (canReplace[i] && pitch < lowestInRangePitch) {
-                lowestInRangePitch = pitch;
-            }
+static bool voice_young_less(int a, int b) {
+    return g_voiceAlloc.stealableAt[a] < g_voiceAlloc.stealableAt[b];
+}
+
+static void voice_idle_remove(int v) {
+    VoiceAllocator& va = g_voiceAlloc;
+    if (!va.idle[v]) return;
+    int chip = g_channels[v].chipIndex;
+    if (va.idlePrev[v] >= 0) va.idleNext[va.idlePrev[v]] = va.idleNext[v]; else va.idleHead[chip] = va.idleNext[v];
+    if (va.idleNext[v] >= 0) va.idlePrev[va.idleNext[v]] = va.idlePrev[v]; else va.idleTail[chip] = va.idlePrev[v];
+    va.idle[v] = false;
+}
+
+static void voice_idle_append(int v) {
+    VoiceAllocator& va = g_voiceAlloc;
+    voice_idle_remove(v);
+    int chip = g_channels[v].chipIndex;
+    va.idlePrev[v] = va.idleTail[chip];
+    va.idleNext[v] = -1;
+    if (va.idleTail[chip] >= 0) va.idleNext[va.idleTail[chip]] = v; else va.idleHead[chip] = v;
+    va.idleTail[chip] = v;
+    va.idle[v] = true;
+}
+
+// Voice v started (or retriggered) a note; called by play_note()
+static void voice_alloc_on_start(int v, std::chrono::steady_clock::time_point now) {
+    VoiceAllocator& va = g_voiceAlloc;
+    if (v >= va.voiceCount) return;
+
+    voice_idle_remove(v);
+    va.stealPitch[v] = get_absolute_pitch(g_channels[v].note, g_channels[v].octave);
+    va.stealRank[v] = (is_in_valid_range(g_channels[v].note, g_channels[v].octave) ? VOICE_RANK_IN_RANGE : 0) |
+                      VOICE_RANK_YOUNG;
+    va.stealableAt[v] = g_channels[v].startTime +
+                        std::chrono::milliseconds(voice_min_duration_ms(g_channels[v].envelope));
+    if (va.stealableAt[v] <= now) va.stealRank[v] &= ~VOICE_RANK_YOUNG;
+
+    if (va.steal.contains(v)) {
+        va.steal.update(v);
+    } else {
+        va.steal.push(v);
+        va.chipActive[g_channels[v].chipIndex]++;
+    }
+    if (va.stealRank[v] & VOICE_RANK_YOUNG) {
+        if (va.young.contains(v)) va.young.update(v); else va.young.push(v);
+    } else {
+        va.young.remove(v);
+    }
+}
+
+// Voice v was released; called by stop_note()
+static void voice_alloc_on_release(int v) {
+    VoiceAllocator& va = g_voiceAlloc;
+    if (v >= va.voiceCount) return;
+
+    if (va.steal.contains(v)) va.chipActive[g_channels[v].chipIndex]--;
+    va.steal.remove(v);
+    va.young.remove(v);
+    va.noteEndUs[v] = UINT64_MAX;
+    voice_idle_append(v);
+}
+
+// Recompute the allocator from g_channels (and the current chip count)
+void voice_alloc_rebuild() {
+    VoiceAllocator& va = g_voiceAlloc;
+    va.voiceCount = get_voice_count();
+    for (int c = 0; c < YM_MAX_CHIPS; c++) {
+        va.idleHead[c] = va.idleTail[c] = -1;
+        va.chipActive[c] = 0;
+    }
+    for (int i = 0; i < YM_MAX_VOICES; i++) va.idle[i] = false;
+    va.steal.less = voice_steal_less;
+    va.young.less = voice_young_less;
+    va.steal.clear();
+    va.young.clear();
+
+    // Idle order: never used (by index), then by release time
+    int order[YM_MAX_VOICES];
+    int idleCount = 0;
+    for (int i = 0; i < va.voiceCount; i++) {
+        if (!g_channels[i].active) {
+            va.noteEndUs[i] = UINT64_MAX;
+            order[idleCount++] = i;
         }
     }
+    std::stable_sort(order, order + idleCount, [](int a, int b) {
+        if (g_channels[a].hasBeenUsed != g_channels[b].hasBeenUsed) return !g_channels[a].hasBeenUsed;
+        if (!g_channels[a].hasBeenUsed) return false;
+        return g_channels[a].releaseTime < g_channels[b].releaseTime;
+    });
+    for (int i = 0; i < idleCount; i++) voice_idle_append(order[i]);
 
-    // If we found out-of-range notes, replace one
-    if (hasOutOfRange && channelToReplace >= 0) {
-        stop_note(channelToReplace);
-        return channelToReplace;
+    auto now = ym_now();
+    for (int i = 0; i < va.voiceCount; i++) {
+        if (g_channels[i].active) voice_alloc_on_start(i, now);
     }
+}
 
-    // All notes are in valid range - replace the lowest pitch note that has played long enough
-    for (int i = 0; i < maxChannels; i++) {
-        if (!g_channels[i].active) continue;
+// Pick up a chip count change before using the allocator
+static inline void voice_alloc_sync() {
+    if (g_voiceAlloc.voiceCount != get_voice_count()) voice_alloc_rebuild();
+}
 
-        int pitch = get_absolute_pitch(g_channels[i].note, g_channels[i].octave);
+// True if idle voice a has waited longer than idle voice b (never used first)
+static inline bool voice_idle_older(int a, int b) {
+    if (g_channels[a].hasBeenUsed != g_channels[b].hasBeenUsed) return !g_channels[a].hasBeenUsed;
+    if (!g_channels[a].hasBeenUsed) return a < b;
+    return g_channels[a].releaseTime < g_channels[b].releaseTime;
+}
 
-        // Find the lowest pitch note that can be replaced
-        if (canReplace[i] && pitch == lowestInRangePitch) {
-            channelToReplace = i;
-            break;
-        }
+// Free voice a is a better pick than b: less busy chip, then waited longer
+static inline bool voice_free_better(int a, int b) {
+    int loadA = g_voiceAlloc.chipActive[g_channels[a].chipIndex];
+    int loadB = g_voiceAlloc.chipActive[g_channels[b].chipIndex];
+    if (loadA != loadB) return loadA < loadB;
+    return voice_idle_older(a, b);
+}
+
+// Timbre/volume register writes play_note() would issue on voice v (0-2)
+static inline int voice_config_writes(int v, int timbre, int envelope, int volume) {
+    int chip = g_channels[v].chipIndex;
+    int local = v % YM_VOICES_PER_CHIP;
+    return (register_shadow_holds(chip, 0x88 + local, ym2163_timbre_value(timbre, envelope)) ? 0 : 1) +
+           (register_shadow_holds(chip, 0x8C + local, ym2163_volume_value(volume)) ? 0 : 1);
+}
+
+// True if a voice is free, i.e. find_free_channel() would not steal
+static bool voice_alloc_has_free() {
+    voice_alloc_sync();
+    for (int chip = 0; chip < g_voiceAlloc.voiceCount / YM_VOICES_PER_CHIP; chip++) {
+        if (g_voiceAlloc.idleHead[chip] >= 0) return true;
     }
+    return false;
+}
 
-    // If no long-enough notes found, replace any lowest pitch note as last resort
-    if (channelToReplace < 0) {
-        int lowestValidPitch = INT_MAX;
-        for (int i = 0; i < maxChannels; i++) {
-            if (!g_channels[i].active) continue;
-            int pitch = get_absolute_pitch(g_channels[i].note, g_channels[i].octave);
-            if (pitch < lowestValidPitch) {
-                lowestValidPitch = pitch;
-                channelToReplace = i;
+// timbre/envelope/volume: settings of the note about to play, -1 if unknown
+int find_free_channel(int timbre = -1, int envelope = -1, int volume = -1) {
+    VoiceAllocator& va = g_voiceAlloc;
+    voice_alloc_sync();
+
+    // Free voice on the least busy chip; on a tie never used first, otherwise
+    // the one released longest ago (its envelope has had the most time to complete)
+    int freeVoice = -1;
+    for (int chip = 0; chip < va.voiceCount / YM_VOICES_PER_CHIP; chip++) {
+        int v = va.idleHead[chip];
+        if (v >= 0 && (freeVoice < 0 || voice_free_better(v, freeVoice))) freeVoice = v;
+    }
+
+    // Timbre affinity: fewest timbre/volume rewrites first, then the order above
+    if (freeVoice >= 0 && timbre >= 0) {
+        int plainWrites = voice_config_writes(freeVoice, timbre, envelope, volume);
+        int bestWrites = plainWrites;
+        for (int chip = 0; chip < va.voiceCount / YM_VOICES_PER_CHIP && bestWrites > 0; chip++) {
+            for (int v = va.idleHead[chip]; v >= 0; v = va.idleNext[v]) {
+                int writes = voice_config_writes(v, timbre, envelope, volume);
+                if (writes < bestWrites || (writes == bestWrites && voice_free_better(v, freeVoice))) {
+                    freeVoice = v;
+                    bestWrites = writes;
+                }
             }
         }
+        va.writesSaved += plainWrites - bestWrites;
     }
 
-    // Force stop the note on this channel
-    if (channelToReplace >= 0 && g_channels[channelToReplace].active) {
-        stop_note(channelToReplace);
+    if (freeVoice >= 0) {
+        g_channels[freeVoice].hasBeenUsed = true;
+        return freeVoice;
     }
 
-    return channelToReplace >= 0 ? channelToReplace : 0;  // Fallback to channel 0
+    // No free voice: voices that have now sounded long enough become stealable
+    auto now = ym_now();
+    while (va.young.size > 0 && va.stealableAt[va.young.top()] <= now) {
+        int v = va.young.top();
+        va.young.remove(v);
+        va.stealRank[v] &= ~VOICE_RANK_YOUNG;
+        va.steal.update(v);
+    }
+
+    // Out-of-range notes first, then notes that played long enough, lowest pitch
+    // (look-ahead: then the note that ends soonest)
+    int channelToReplace = va.steal.top();
+    if (channelToReplace < 0) return 0;  // Fallback to channel 0
+
+    // Force stop the note on this channel
+    stop_note(channelToReplace);
+    va.steals++;
+    return channelToReplace;
 }
 
+// ===== Note Table =====
+// Which voices play which key: a fixed [MIDI channel][key] table of voice
+// lists (oldest first), with a reverse pointer from each voice to its key.
+// The same key can be stacked several times; each note-off releases the oldest
+// instance. stop_note() unlinks the voice, so a stolen voice can never be
+// released by the note-off of its previous owner. Row 16 holds computer
+// keyboard notes keyed by absolute pitch.
+
+#define NOTE_TABLE_KEYBOARD  16
+#define NOTE_TABLE_ROWS      17
+
+struct NoteTable {
+    int8_t head[NOTE_TABLE_ROWS][128];  // Oldest voice on the key, -1 if none
+    int8_t tail[NOTE_TABLE_ROWS][128];  // Newest voice on the key
+    int8_t row[YM_MAX_VOICES];          // Reverse pointer: owning row, -1 if none
+    int8_t key[YM_MAX_VOICES];
+    int8_t prev[YM_MAX_VOICES];         // Older/newer voice on the same key
+    int8_t next[YM_MAX_VOICES];
+
+    NoteTable() { clear(); }
+
+    void clear() {
+        memset(head, -1, sizeof(head));
+        memset(tail, -1, sizeof(tail));
+        memset(row, -1, sizeof(row));
+    }
+
+    int oldest(int r, int k) const { return head[r][k]; }
+
+    void link(int r, int k, int v) {
+        unlink(v);
+        row[v] = (int8_t)r;
+        key[v] = (int8_t)k;
+        prev[v] = tail[r][k];
+        next[v] = -1;
+        if (tail[r][k] >= 0) next[tail[r][k]] = (int8_t)v; else head[r][k] = (int8_t)v;
+        tail[r][k] = (int8_t)v;
+    }
+
+    void unlink(int v) {
+        int r = row[v];
+        if (r < 0) return;
+        int k = key[v];
+        if (prev[v] >= 0) next[prev[v]] = next[v]; else head[r][k] = next[v];
+        if (next[v] >= 0) prev[next[v]] = prev[v]; else tail[r][k] = prev[v];
+        row[v] = -1;
+    }
+};
+
+static NoteTable g_noteTable;
+
+// Voice holding a computer keyboard note, -1 if none
 int find_channel_playing(int note, int octave) {
-    int maxChannels = 4 + (g_enableSecondYM2163 ? 4 : 0) + (g_enableThirdYM2163 ? 4 : 0) + (g_enableFourthYM2163 ? 4 : 0);
-    for (int i = 0; i < maxChannels; i++) {
-        if (g_channels[i].active &&
-            g_channels[i].note == note &&
-            g_channels[i].octave == octave) {
-            return i;
-        }
+    return g_noteTable.oldest(NOTE_TABLE_KEYBOARD, get_absolute_pitch(note, octave));
+}
+
+// F-number and hardware block of a note; false if the YM2163 can't play it
+static bool ym2163_pitch(int note, int octave, uint16_t* fnum, uint8_t* hw_octave) {
+    if (octave == 0 && note == 11) {
+        *fnum = g_fnum_b2;
+        *hw_octave = 0;
+    } else if (octave >= 1 && octave <= 4) {
+        *fnum = g_fnums[note];
+        *hw_octave = (octave - 1) & 0x03;
+    } else if (octave == 5) {
+        *fnum = g_fnums_c7[note];
+        *hw_octave = 3;
+    } else {
+        return false;
     }
-    return -1;
+    return true;
+}
+
+// ===== Arpeggio Multiplexing =====
+// Optional chiptune-style polyphony: when every voice is busy, a new song note
+// joins a sounding voice (preferably one playing the same MIDI channel)
+// instead of stealing it. Each shared voice cycles through its notes at
+// g_arp.rateHz by rewriting only its F-number (0x80) and block (0x84, key-on
+// bit kept), so nothing is retriggered. Rotation runs on the sequencer thread
+// (and in the compiler, on the song clock). A token bucket limits rotation to
+// g_arp.writeBudget register writes per second; voices that don't fit wait for
+// the next step, in round-robin order.
+//
+// A released extra note just leaves the cycle; when the voice's own note is
+// released, the oldest extra note takes the voice over. stop_note() for any
+// other reason (steal, stop all, seek) drops the voice's extra notes.
+
+#define ARP_MAX_EXTRA  3  // Extra notes per voice: up to 4 notes per voice, 16 per chip
+
+struct ArpNote {
+    uint8_t midiChannel;  // Owner, for note-off
+    uint8_t key;
+    int8_t note;          // YM2163 pitch
+    int8_t octave;
+};
+
+struct ArpVoice {
+    ArpNote extra[ARP_MAX_EXTRA];  // Oldest first
+    int count;
+    int phase;                     // Note sounding now: 0 = the voice's own, n = extra[n - 1]
+};
+
+struct ArpeggioState {
+    bool enabled;
+    float rateHz;                  // Rotation steps per second
+    int writeBudget;               // Register writes per second available to rotation
+
+    ArpVoice voices[YM_MAX_VOICES];
+    int sharedVoices;              // Voices with extra notes
+    uint64_t nextStepUs;           // 0 = schedule on the next update
+    uint64_t lastRefillUs;
+    double tokens;
+    int nextVoice;                 // Round-robin start for budget-limited steps
+
+    // Statistics (since last reset)
+    uint64_t notesShared;
+    uint64_t steps;
+    uint64_t writes;
+    uint64_t skipped;              // Voice updates deferred by the write budget
+
+    ArpeggioState() : enabled(false), rateHz(50.0f), writeBudget(2000), sharedVoices(0),
+                      nextStepUs(0), lastRefillUs(0), tokens(0.0), nextVoice(0),
+                      notesShared(0), steps(0), writes(0), skipped(0) {
+        memset(voices, 0, sizeof(voices));
+    }
+};
+
+static ArpeggioState g_arp;
+
+// Forget voice v's extra notes
+static void arp_drop_voice(int v) {
+    if (g_arp.voices[v].count > 0) g_arp.sharedVoices--;
+    g_arp.voices[v].count = 0;
+    g_arp.voices[v].phase = 0;
 }
 
 void play_note(int channel, int note, int octave, int timbre = -1, int envelope = -1, int volume = -1) {
@@ -976,28 +1902,17 @@ void play_note(int channel, int note, int octave, int timbre = -1, int envelope
 
     uint16_t fnum;
     uint8_t hw_octave;
-
-    if (octave == 0 && note == 11) {
-        fnum = g_fnum_b2;
-        hw_octave = 0;
-    } else if (octave >= 1 && octave <= 4) {
-        fnum = g_fnums[note];
-        hw_octave = (octave - 1) & 0x03;
-    } else if (octave == 5) {
-        fnum = g_fnums_c7[note];
-        hw_octave = 3;
-    } else {
-        return;
-    }
+    if (!ym2163_pitch(note, octave, &fnum, &hw_octave)) return;
 
     uint8_t fnum_low = fnum & 0x7F;
     uint8_t fnum_high = (fnum >> 7) & 0x07;
 
+    auto now = ym_now();
     g_channels[channel].note = note;
     g_channels[channel].octave = octave;
     g_channels[channel].fnum = fnum;
     g_channels[channel].active = true;
-    g_channels[channel].startTime = std::chrono::steady_clock::now();  // Record start time
+    g_channels[channel].startTime = now;  // Record start time
 
     // Use provided timbre/envelope or fall back to current settings
     int useTimbre = (timbre >= 0) ? timbre : g_currentTimbre;
@@ -1008,26 +1923,25 @@ void play_note(int channel, int note, int octave, int timbre = -1, int envelope
     g_channels[channel].timbre = useTimbre;
     g_channels[channel].envelope = useEnvelope;
     g_channels[channel].volume = useVolume;
+    voice_alloc_on_start(channel, now);
 
-    write_melody_cmd_chip(0x88 + localChannel, chipIndex);
-    uint8_t timbre_val = (useTimbre & 0x07) | ((useEnvelope & 0x03) << 4);
-    write_melody_cmd_chip(timbre_val, chipIndex);
+    // Writes matching the register shadow (same timbre/volume/F-number as the
+    // voice already holds) are dropped inside write_reg_chip()
+    write_reg_chip(0x88 + localChannel, ym2163_timbre_value(useTimbre, useEnvelope), chipIndex);
 
-    write_melody_cmd_chip(0x8C + localChannel, chipIndex);
-    write_melody_cmd_chip(0x0F | ((useVolume & 0x03) << 4), chipIndex);
+    write_reg_chip(0x8C + localChannel, ym2163_volume_value(useVolume), chipIndex);
 
-    write_melody_cmd_chip(0x84 + localChannel, chipIndex);
-    write_melody_cmd_chip((hw_octave << 3) | fnum_high, chipIndex);
+    write_reg_chip(0x84 + localChannel, (hw_octave << 3) | fnum_high, chipIndex);
 
-    write_melody_cmd_chip(0x80 + localChannel, chipIndex);
-    write_melody_cmd_chip(fnum_low, chipIndex);
+    write_reg_chip(0x80 + localChannel, fnum_low, chipIndex);
 
-    write_melody_cmd_chip(0x84 + localChannel, chipIndex);
-    write_melody_cmd_chip(0x40 | (hw_octave << 3) | fnum_high, chipIndex);
+    write_reg_chip(0x84 + localChannel, 0x40 | (hw_octave << 3) | fnum_high, chipIndex);
 }
 
 void stop_note(int channel) {
     if (channel < 0 || channel >= 16) return;
+    g_noteTable.unlink(channel);
+    arp_drop_voice(channel);
 
     // Determine chip and local channel
     int chipIndex = g_channels[channel].chipIndex;
@@ -1051,11 +1965,10 @@ void stop_note(int channel) {
     uint8_t fnum_low = fnum & 0x7F;
     uint8_t fnum_high = (fnum >> 7) & 0x07;
 
-    write_melody_cmd_chip(0x80 + localChannel, chipIndex);
-    write_melody_cmd_chip(fnum_low, chipIndex);
+    // Only the key-on bit changes; the F-number low write is normally elided
+    write_reg_chip(0x80 + localChannel, fnum_low, chipIndex);
 
-    write_melody_cmd_chip(0x84 + localChannel, chipIndex);
-    write_melody_cmd_chip((hw_octave << 3) | fnum_high, chipIndex);
+    write_reg_chip(0x84 + localChannel, (hw_octave << 3) | fnum_high, chipIndex);
 
     // Clear piano key visual
     int keyIdx = get_key_index(octave, note);
@@ -1064,14 +1977,21 @@ void stop_note(int channel) {
     }
 
     // Record release time for intelligent channel allocation
-    g_channels[channel].releaseTime = std::chrono::steady_clock::now();
+    g_channels[channel].releaseTime = ym_now();
     g_channels[channel].active = false;
     g_channels[channel].midiChannel = -1;
+    voice_alloc_on_release(channel);
 }
 
 void stop_all_notes() {
-    int maxChannels = 4 + (g_enableSecondYM2163 ? 4 : 0) + (g_enableThirdYM2163 ? 4 : 0) + (g_enableFourthYM2163 ? 4 : 0);
-    for (int i = 0; i < maxChannels; i++) {
+    // Sounding voices are exactly the ones in the allocator's steal heap
+    voice_alloc_sync();
+    int voices[YM_MAX_VOICES];
+    int count = g_voiceAlloc.steal.size;
+    memcpy(voices, g_voiceAlloc.steal.items, count * sizeof(int));
+
+    for (int v = 0; v < count; v++) {
+        int i = voices[v];
         if (g_channels[i].active) {
             stop_note(i);
 
@@ -1083,72 +2003,213 @@ void stop_all_notes() {
     }
 }
 
-// Reset all piano key UI states (call when switching songs to clear residual pressed keys)
-void ResetPianoKeyStates() {
-    for (int i = 0; i < 61; i++) {
-        g_pianoKeyPressed[i] = false;
-        g_pianoKeyVelocity[i] = 0;
-        g_pianoKeyFromKeyboard[i] = false;
-    }
+// Drop every extra note (mode switched off, compile)
+void ArpeggioReset() {
+    for (int v = 0; v < YM_MAX_VOICES; v++) arp_drop_voice(v);
+    g_arp.nextStepUs = 0;
 }
 
-// Reset YM2163 chip to eliminate residual sound/notes
+// Add a song note to the sounding voice with the fewest extra notes, preferring
+// voices of the same MIDI channel (same instrument). False if all are full.
+bool ArpeggioAddNote(int midiChannel, int key, int note, int octave) {
+    int best = -1;
+    for (int v = 0; v < g_voiceAlloc.voiceCount; v++) {
+        if (!g_channels[v].active || g_arp.voices[v].count >= ARP_MAX_EXTRA) continue;
+        if (best < 0) {
+            best = v;
+            continue;
+        }
+        bool same = g_channels[v].midiChannel == midiChannel;
+        bool bestSame = g_channels[best].midiChannel == midiChannel;
+        if (same != bestSame ? same : g_arp.voices[v].count < g_arp.voices[best].count) best = v;
+    }
+    if (best < 0) return false;
+
+    ArpVoice& voice = g_arp.voices[best];
+    ArpNote& extra = voice.extra[voice.count];
+    extra.midiChannel = (uint8_t)midiChannel;
+    extra.key = (uint8_t)key;
+    extra.note = (int8_t)note;
+    extra.octave = (int8_t)octave;
+    if (voice.count++ == 0) g_arp.sharedVoices++;
+    g_arp.notesShared++;
+    return true;
+}
+
+// Note-off for a note held as an extra note; false if none matches
+bool ArpeggioRelease(int midiChannel, int key) {
+    for (int v = 0; v < g_voiceAlloc.voiceCount; v++) {
+        ArpVoice& voice = g_arp.voices[v];
+        for (int i = 0; i < voice.count; i++) {
+            if (voice.extra[i].midiChannel != midiChannel || voice.extra[i].key != key) continue;
+            memmove(&voice.extra[i], &voice.extra[i + 1], (voice.count - i - 1) * sizeof(ArpNote));
+            voice.count--;
+            if (voice.phase > i) voice.phase--;
+            if (voice.count == 0) g_arp.sharedVoices--;
+            return true;
+        }
+    }
+    return false;
+}
+
+// The voice's own note was released: its oldest extra note takes the voice
+// over. False if the voice has no extra notes (caller stops it).
+bool ArpeggioHandOver(int v) {
+    ArpVoice& voice = g_arp.voices[v];
+    if (voice.count == 0) return false;
+
+    ArpNote next = voice.extra[0];
+    memmove(&voice.extra[0], &voice.extra[1], (voice.count - 1) * sizeof(ArpNote));
+    voice.count--;
+    voice.phase = 0;
+    if (voice.count == 0) g_arp.sharedVoices--;
+
+    g_noteTable.unlink(v);
+    g_voiceAlloc.noteEndUs[v] = UINT64_MAX;
+    play_note(v, next.note, next.octave, g_channels[v].timbre, g_channels[v].envelope, g_channels[v].volume);
+    g_channels[v].midiChannel = next.midiChannel;
+    g_noteTable.link(next.midiChannel, next.key, v);
+    return true;
+}
+
+// Time of the next rotation step (same clock as ArpeggioUpdate), UINT64_MAX if none
+uint64_t ArpeggioNextStepUs() {
+    if (!g_arp.enabled || g_arp.sharedVoices == 0) return UINT64_MAX;
+    return g_arp.nextStepUs;
+}
+
+// Run the rotation step due at nowUs, if any
+void ArpeggioUpdate(uint64_t nowUs) {
+    if (!g_arp.enabled || g_arp.sharedVoices == 0) return;
+
+    uint64_t periodUs = (uint64_t)(1000000.0 / g_arp.rateHz);
+    if (g_arp.nextStepUs == 0) {
+        // First shared voice: start the clock and the budget
+        g_arp.nextStepUs = nowUs + periodUs;
+        g_arp.lastRefillUs = nowUs;
+        g_arp.tokens = g_arp.writeBudget / g_arp.rateHz;
+        return;
+    }
+    if (nowUs < g_arp.nextStepUs) return;
+
+    // Refill the write budget; at most two steps' worth can be saved up
+    double maxTokens = 2.0 * g_arp.writeBudget / g_arp.rateHz;
+    g_arp.tokens += (double)(nowUs - g_arp.lastRefillUs) * g_arp.writeBudget / 1000000.0;
+    if (g_arp.tokens > maxTokens) g_arp.tokens = maxTokens;
+    g_arp.lastRefillUs = nowUs;
+
+    int voiceCount = g_voiceAlloc.voiceCount;
+    for (int n = 0; n < voiceCount; n++) {
+        int v = (g_arp.nextVoice + n) % voiceCount;
+        ArpVoice& voice = g_arp.voices[v];
+        if (voice.count == 0 || !g_channels[v].active) continue;
+        if (g_arp.tokens < 2.0) {
+            g_arp.skipped++;
+            continue;
+        }
+
+        voice.phase = (voice.phase + 1) % (voice.count + 1);
+        int note = voice.phase == 0 ? g_channels[v].note : voice.extra[voice.phase - 1].note;
+        int octave = voice.phase == 0 ? g_channels[v].octave : voice.extra[voice.phase - 1].octave;
+        uint16_t fnum;
+        uint8_t hw_octave;
+        if (!ym2163_pitch(note, octave, &fnum, &hw_octave)) continue;
+
+        int chipIndex = g_channels[v].chipIndex;
+        int localChannel = v % YM_VOICES_PER_CHIP;
+        write_reg_chip(0x80 + localChannel, fnum & 0x7F, chipIndex);
+        write_reg_chip(0x84 + localChannel, 0x40 | (hw_octave << 3) | ((fnum >> 7) & 0x07), chipIndex);
+        g_arp.tokens -= 2.0;
+        g_arp.writes += 2;
+    }
+    g_arp.nextVoice = (g_arp.nextVoice + 1) % voiceCount;
+    g_arp.steps++;
+
+    g_arp.nextStepUs += periodUs;
+    if (g_arp.nextStepUs <= nowUs) g_arp.nextStepUs = nowUs + periodUs;  // Fell behind: don't burst
+    spfm_flush();
+}
+
+// Reset all piano key UI states (call when switching songs to clear residual pressed keys)
+void ResetPianoKeyStates() {
+    for (int i = 0; i < 61; i++) {
+        g_pianoKeyPressed[i] = false;
+        g_pianoKeyVelocity[i] = 0;
+        g_pianoKeyFromKeyboard[i] = false;
+    }
+}
+
+// Reset YM2163 chip to eliminate residual sound/notes
 void ResetYM2163Chip(int chipIndex) {
-    if (!g_ftHandle) return;
+    if (!g_transport) return;
 
     log_command("Resetting YM2163 Chip %d...", chipIndex);
 
+    // Force every reset write out regardless of what the shadow holds
+    invalidate_register_shadow(chipIndex);
+
     // Send all note-off commands for all 4 channels on this chip
     for (int ch = 0; ch < 4; ch++) {
         // Send note-off (key off) command: 0x88 + channel
-        write_melody_cmd_chip(0x88 + ch, chipIndex);
-        write_melody_cmd_chip(0x00, chipIndex);  // Key off
+        write_reg_chip(0x88 + ch, 0x00, chipIndex);  // Key off
     }
 
     // Reset all volume to mute (volume = 3)
     for (int ch = 0; ch < 4; ch++) {
-        write_melody_cmd_chip(0x8C + ch, chipIndex);
-        write_melody_cmd_chip(0x03, chipIndex);  // Mute
+        write_reg_chip(0x8C + ch, 0x03, chipIndex);  // Mute
     }
 
     // Reset all envelope to decay
     for (int ch = 0; ch < 4; ch++) {
-        write_melody_cmd_chip(0x84 + ch, chipIndex);
-        write_melody_cmd_chip(0x00, chipIndex);  // Decay envelope
+        write_reg_chip(0x84 + ch, 0x00, chipIndex);  // Decay envelope
     }
 
     // Reset all wave/timbre to 0
     for (int ch = 0; ch < 4; ch++) {
-        write_melody_cmd_chip(0x80 + ch, chipIndex);
-        write_melody_cmd_chip(0x00, chipIndex);  // Timbre 0
+        write_reg_chip(0x80 + ch, 0x00, chipIndex);  // Timbre 0
     }
 
     // Reset rhythm section
-    write_melody_cmd_chip(0x90, chipIndex);
-    write_melody_cmd_chip(0x00, chipIndex);  // All rhythm off
+    write_reg_chip(0x90, 0x00, chipIndex);  // All rhythm off
 
     log_command("YM2163 Chip %d reset complete", chipIndex);
 }
 
-// Reset all YM2163 chips to eliminate residual sound
+// Reset all YM2163 chips to eliminate residual sound. Takes the engine lock
+// around the register writes only, not the settle delay.
 void ResetAllYM2163Chips() {
-    log_command("=== Resetting all YM2163 chips ===");
+    {
+        std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+        log_command("=== Resetting all YM2163 chips ===");
 
-    // Reset Slot0 (always present)
-    ResetYM2163Chip(0);
+        // Reset Slot0 (always present)
+        ResetYM2163Chip(0);
 
-    // Reset Slot1 if enabled
-    if (g_enableSecondYM2163) {
-        ResetYM2163Chip(1);
-    }
+        // Reset Slot1 if enabled
+        if (g_enableSecondYM2163) {
+            ResetYM2163Chip(1);
+        }
+
+        // Reset Slot2 if enabled
+        if (g_enableThirdYM2163) {
+            ResetYM2163Chip(2);
+        }
+
+        // Reset Slot3 if enabled
+        if (g_enableFourthYM2163) {
+            ResetYM2163Chip(3);
+        }
 
+        spfm_flush();
+    }
+    spfm_wait_sent();
     Sleep(50);  // Wait for chip to settle
 }
 
 // Initialize all channels to clean state (eliminate residual sound)
 void InitializeAllChannels() {
-    int maxChannels = 4 + (g_enableSecondYM2163 ? 4 : 0) + (g_enableThirdYM2163 ? 4 : 0) + (g_enableFourthYM2163 ? 4 : 0);
-    auto now = std::chrono::steady_clock::now();
+    int maxChannels = get_voice_count();
+    auto now = ym_now();
 
     for (int i = 0; i < maxChannels; i++) {
         g_channels[i].active = false;
@@ -1170,8 +2231,11 @@ void InitializeAllChannels() {
         }
     }
 
-    // Reset drum states for both chips
-    for (int chip = 0; chip < 2; chip++) {
+    voice_alloc_rebuild();
+    g_noteTable.clear();
+
+    // Reset drum states for all chips
+    for (int chip = 0; chip < 4; chip++) {
         for (int i = 0; i < 5; i++) {
             g_drumActive[chip][i] = false;
         }
@@ -1180,23 +2244,18 @@ void InitializeAllChannels() {
 
 // Clean up channels in Release phase that have exceeded timeout
 void play_drum(uint8_t rhythm_bit) {
-    // Dynamic chip allocation when second chip is enabled
-    int chipIndex = 0;
-    if (g_enableSecondYM2163) {
-        chipIndex = g_currentDrumChip;
-        // Alternate between chips for next drum hit
-        g_currentDrumChip = 1 - g_currentDrumChip;
-        log_command("Drum triggered on Chip %d (next will use Chip %d)", chipIndex, g_currentDrumChip);
-    }
+    // Rotate drum hits over all enabled chips
+    int chips = get_chip_count();
+    int chipIndex = g_currentDrumChip % chips;
+    g_currentDrumChip = (chipIndex + 1) % chips;
 
-    write_melody_cmd_chip(0x90, chipIndex);
-    write_melody_cmd_chip(rhythm_bit, chipIndex);
+    write_reg_chip(YM2163_REG_RHYTHM, rhythm_bit, chipIndex);
 
     // Track which drums were triggered on this specific chip
     for (int i = 0; i < 5; i++) {
         if (rhythm_bit & g_drumBits[i]) {
             g_drumActive[chipIndex][i] = true;
-            g_drumTriggerTime[chipIndex][i] = std::chrono::steady_clock::now();
+            g_drumTriggerTime[chipIndex][i] = ym_now();
         }
     }
 }
@@ -1220,7 +2279,7 @@ void CleanupStuckChannels() {
     // Force-release channels that have been active for more than 10 seconds
     // This prevents "stuck" channels from permanently occupying slots
     auto now = std::chrono::steady_clock::now();
-    int maxChannels = 4 + (g_enableSecondYM2163 ? 4 : 0) + (g_enableThirdYM2163 ? 4 : 0) + (g_enableFourthYM2163 ? 4 : 0);
+    int maxChannels = get_voice_count();
 
     for (int i = 0; i < maxChannels; i++) {
         if (g_channels[i].active) {
@@ -1291,7 +2350,7 @@ float CalculateEnvelopeLevel(int envelope, bool active,
 
 void UpdateChannelLevels() {
     // Update envelope levels for all channels
-    int maxChannels = 4 + (g_enableSecondYM2163 ? 4 : 0) + (g_enableThirdYM2163 ? 4 : 0) + (g_enableFourthYM2163 ? 4 : 0);
+    int maxChannels = get_voice_count();
 
     for (int i = 0; i < maxChannels; i++) {
         if (g_channels[i].active || g_channels[i].hasBeenUsed) {
@@ -1716,27 +2775,24 @@ void UnregisterGlobalMediaKeys() {
 
 // ===== Auto-Skip Silence Function =====
 
+// Song time of an event in microseconds (tempo map applied at load)
+inline double GetMIDIEventMicros(int index) {
+    return (double)g_midiPlayer.events.timeUs[index];
+}
+
 // Find the first note-on event (excluding drum channel)
-// Returns the event index, and sets the tick value via parameter
-int FindFirstNoteEvent(int& outTick) {
-    outTick = 0;
+// Returns the event index
+int FindFirstNoteEvent() {
     if (g_midiPlayer.currentFileName.empty()) return 0;
-    if (g_midiPlayer.midiFile.getEventCount(0) == 0) return 0;
 
-    MidiEventList& track = g_midiPlayer.midiFile[0];
+    const PlaybackEvents& events = g_midiPlayer.events;
+    for (int i = 0; i < events.size(); i++) {
+        const PlaybackEvent& event = events.message[i];
 
-    for (int i = 0; i < (int)track.size(); i++) {
-        MidiEvent& event = track[i];
-
-        // Look for note-on events (not drum channel)
-        if (event.isNoteOn() && event.getVelocity() > 0) {
-            int channel = event.getChannel();
-            // Skip drum channel (MIDI channel 10 = index 9)
-            if (channel != 9) {
-                outTick = event.tick;
-                log_command("First note found at event index: %d, tick: %d", i, event.tick);
-                return i;  // Return event index
-            }
+        // Look for note-on events, skipping drum channel (MIDI channel 10 = index 9)
+        if (event.type == PEV_NOTE_ON && event.channel != 9) {
+            log_command("First note found at event index: %d, time: %.2f ms", i, GetMIDIEventMicros(i) / 1000.0);
+            return i;  // Return event index
         }
     }
 
@@ -1744,20 +2800,13 @@ int FindFirstNoteEvent(int& outTick) {
     return 0;
 }
 
-// Calculate total MIDI duration in microseconds
-double GetMIDITotalDuration() {
-    if (g_midiPlayer.currentFileName.empty()) return 0.0;
-    if (g_midiPlayer.midiFile.getEventCount(0) == 0) return 0.0;
-
-    MidiEventList& track = g_midiPlayer.midiFile[0];
-    if (track.size() == 0) return 0.0;
-
-    // Get the last event's tick
-    int lastTick = track[track.size() - 1].tick;
+// Microseconds per quarter note of a PEV_TEMPO event
+inline double GetPlaybackEventTempo(const PlaybackEvent& event) {
+    return (double)((event.channel << 16) | (event.data1 << 8) | event.data2);
+}
 
-    // Convert MIDI tick to microseconds
-    double microsPerTick = g_midiPlayer.tempo / (double)g_midiPlayer.ticksPerQuarterNote;
-    return (double)lastTick * microsPerTick;
+inline double GetMIDITempoAt(int index) {
+    return GetPlaybackEventTempo(g_midiPlayer.events.message[index]);
 }
 
 // Format time in microseconds to MM:SS format
@@ -1771,12 +2820,1050 @@ std::string FormatTime(double microseconds) {
     return std::string(buffer);
 }
 
+// ===== Seek Checkpoint Index =====
+// Built once per file (or as the streaming loader appends events): every
+// SEEK_CHECKPOINT_US of song time a snapshot of the
+// playback state (sounding notes with their velocities, sustain, tempo, program
+// per channel) is stored together with the index of the next event. A seek
+// binary-searches the last checkpoint before the target and replays at most
+// SEEK_CHECKPOINT_US worth of events from there.
+
+#define SEEK_CHECKPOINT_US 1000000.0  // Snapshot interval (song time)
+
+struct SeekNote {
+    uint8_t channel;
+    uint8_t note;
+    uint8_t velocity;
+};
+
+struct SeekCheckpoint {
+    int eventIndex;          // First event not covered by this snapshot
+    double tempo;            // Microseconds per quarter note
+    bool sustain;            // CC64 >= 64 (raw, before pedal mode)
+    uint8_t program[16];
+    int firstNote;           // Sounding notes: g_seekIndex.notes[firstNote .. +noteCount)
+    int noteCount;
+};
+
+struct SeekIndex {
+    std::vector<SeekCheckpoint> checkpoints;
+    std::vector<SeekNote> notes;  // Pool shared by all checkpoints
+};
+
+static SeekIndex g_seekIndex;
+
+// Playback state while scanning events (index build and replay)
+struct SeekScanState {
+    uint8_t velocity[16][128];  // 0 = not sounding
+    double tempo;
+    bool sustain;
+    uint8_t program[16];
+
+    SeekScanState() : tempo(500000.0), sustain(false) {
+        memset(velocity, 0, sizeof(velocity));
+        memset(program, 0, sizeof(program));
+    }
+
+    void apply(const PlaybackEvent& event) {
+        switch (event.type) {
+            case PEV_NOTE_ON:
+                if (event.channel == 9) return;  // Drums are one-shot, nothing to restore
+                velocity[event.channel][event.data1] = event.data2;
+                break;
+            case PEV_NOTE_OFF:
+                velocity[event.channel][event.data1] = 0;
+                break;
+            case PEV_CONTROLLER:
+                if (event.data1 == 64) sustain = (event.data2 >= 64);
+                break;
+            case PEV_PROGRAM:
+                program[event.channel] = event.data1;
+                break;
+            case PEV_TEMPO:
+                tempo = GetPlaybackEventTempo(event);
+                break;
+        }
+    }
+};
+
+static void AddSeekCheckpoint(int eventIndex, const SeekScanState& state) {
+    SeekCheckpoint cp;
+    cp.eventIndex = eventIndex;
+    cp.tempo = state.tempo;
+    cp.sustain = state.sustain;
+    memcpy(cp.program, state.program, sizeof(cp.program));
+    cp.firstNote = (int)g_seekIndex.notes.size();
+    for (int ch = 0; ch < 16; ch++) {
+        for (int note = 0; note < 128; note++) {
+            if (state.velocity[ch][note] == 0) continue;
+            SeekNote sn = { (uint8_t)ch, (uint8_t)note, state.velocity[ch][note] };
+            g_seekIndex.notes.push_back(sn);
+        }
+    }
+    cp.noteCount = (int)g_seekIndex.notes.size() - cp.firstNote;
+    g_seekIndex.checkpoints.push_back(cp);
+}
+
+// State after the events indexed so far
+static SeekScanState g_seekBuildState;
+static double g_seekNextCheckpointUs = SEEK_CHECKPOINT_US;
+static int g_seekIndexedEvents = 0;
+
+// Start the index with the state at event 0
+static void BeginSeekIndex(const SeekScanState& state) {
+    g_seekIndex.checkpoints.clear();
+    g_seekIndex.notes.clear();
+
+    g_seekBuildState = state;
+    AddSeekCheckpoint(0, g_seekBuildState);
+    g_seekNextCheckpointUs = SEEK_CHECKPOINT_US;
+    g_seekIndexedEvents = 0;
+}
+
+// Index the events appended since the last call
+static void ExtendSeekIndex() {
+    for (int i = g_seekIndexedEvents; i < g_midiPlayer.events.size(); i++) {
+        if (GetMIDIEventMicros(i) >= g_seekNextCheckpointUs) {
+            AddSeekCheckpoint(i, g_seekBuildState);
+            while (g_seekNextCheckpointUs <= GetMIDIEventMicros(i)) g_seekNextCheckpointUs += SEEK_CHECKPOINT_US;
+        }
+        g_seekBuildState.apply(g_midiPlayer.events.message[i]);
+    }
+    g_seekIndexedEvents = g_midiPlayer.events.size();
+}
+
+void BuildSeekIndex() {
+    SeekScanState state;
+    state.tempo = g_midiPlayer.tempoMap.getTempoMicrosecondsAtTick(0);
+    BeginSeekIndex(state);
+    ExtendSeekIndex();
+}
+
+// Restore the playback state in effect just before event targetIndex: nearest
+// checkpoint, forward replay to the target, then re-sound held notes through
+// the normal note-on path (instrument, velocity and pedal mapping apply)
+void RebuildActiveNotesAfterSeek(int targetIndex) {
+    if (g_midiPlayer.currentFileName.empty()) return;
+    if (g_seekIndex.checkpoints.empty()) return;
+
+    // Last checkpoint at or before the target
+    int lo = 0, hi = (int)g_seekIndex.checkpoints.size();
+    while (hi - lo > 1) {
+        int mid = (lo + hi) / 2;
+        if (g_seekIndex.checkpoints[mid].eventIndex <= targetIndex) lo = mid; else hi = mid;
+    }
+    const SeekCheckpoint& cp = g_seekIndex.checkpoints[lo];
+
+    SeekScanState state;
+    state.tempo = cp.tempo;
+    state.sustain = cp.sustain;
+    memcpy(state.program, cp.program, sizeof(state.program));
+    for (int i = 0; i < cp.noteCount; i++) {
+        const SeekNote& sn = g_seekIndex.notes[cp.firstNote + i];
+        state.velocity[sn.channel][sn.note] = sn.velocity;
+    }
+
+    for (int i = cp.eventIndex; i < targetIndex && i < g_midiPlayer.events.size(); i++) {
+        state.apply(g_midiPlayer.events.message[i]);
+    }
+
+    g_midiPlayer.tempo = state.tempo;
+    g_sustainPedalActive = state.sustain && g_pedalMode > 0;
+    for (int ch = 0; ch < 16; ch++) {
+        g_midiPlayer.channelProgram[ch] = state.program[ch];
+    }
+
+    for (int ch = 0; ch < 16; ch++) {
+        for (int note = 0; note < 128; note++) {
+            if (state.velocity[ch][note] == 0) continue;
+            PlaybackEvent noteOn = { PEV_NOTE_ON, (uint8_t)ch, (uint8_t)note, state.velocity[ch][note] };
+            ProcessMIDIEvent(noteOn);
+        }
+    }
+}
+
+// ===== Instrument Resolution =====
+
+// Instrument of each program as of the last resolution (one lookup per program
+// instead of one per note); the streaming loader resolves the notes it appends
+static ResolvedInstrument g_programInstrument[128];
+
+static void ResolveProgramInstruments() {
+    for (int program = 0; program < 128; program++) {
+        g_programInstrument[program] = ResolveInstrument(program);
+    }
+}
+
+// Resolve every note-on of the loaded song to its instrument, following program
+// changes per channel in event order. Run at load and whenever an instrument
+// config is saved; the sequencer then only indexes g_midiPlayer.events.instrument.
+void ResolveMIDIInstruments() {
+    ResolveProgramInstruments();
+
+    // While streaming, only notes appended from now on use the new table; the
+    // voice planner may be reading the rest, which is redone once loading ends
+    if (g_midiPlayer.loading) {
+        g_midiPlayer.resolvePending = true;
+        return;
+    }
+    g_midiPlayer.resolvePending = false;
+
+    PlaybackEvents& events = g_midiPlayer.events;
+    events.instrument.resize(events.size());
+    const ResolvedInstrument* byProgram = g_programInstrument;
+
+    int program[16];
+    memcpy(program, g_midiPlayer.firstProgram, sizeof(program));
+    int programsUsed = 0;
+    bool used[128] = {false};
+    for (int i = 0; i < events.size(); i++) {
+        const PlaybackEvent& event = events.message[i];
+        if (event.type == PEV_PROGRAM) {
+            program[event.channel] = event.data1;
+        } else if (event.type == PEV_NOTE_ON) {
+            int p = program[event.channel];
+            events.instrument[i] = byProgram[p];
+            if (!used[p] && event.channel != 9) {
+                used[p] = true;
+                programsUsed++;
+            }
+        }
+    }
+
+    log_command("Instruments resolved: %d programs used", programsUsed);
+}
+
+// ===== Voice Plan =====
+// Load-time pass that plays the song against 1-4 chips with the look-ahead
+// rules of the runtime allocator (free voice: least busy chip, then never used,
+// else released longest ago; no free voice: cut the note that ends soonest,
+// which loses the least note time, lowest key on a tie) and stores the voice of
+// every note-on for each chip count, 4 bits per count. It is a greedy
+// simulation with known note ends, not an optimal assignment. Song notes are
+// folded into the chip's range, so the runtime's out-of-range-first steal key
+// never applies; with look-ahead stealing off, voices are allocated while
+// playing instead. During playback a note-on only looks its voice up, so
+// allocation is off the real-time path. The same simulation gives the per-song
+// report used to decide how many chips a song needs.
+
+struct VoicePlanReport {
+    int peakPolyphony;                       // Melody notes held at once, unlimited voices
+    int steals[YM_MAX_CHIPS];                // Notes cut short, per chip count 1-4
+    double truncatedSeconds[YM_MAX_CHIPS];   // Note time lost to those cuts
+    int writesSaved[YM_MAX_CHIPS];           // Timbre writes avoided by timbre affinity
+    int chipsNeeded;                         // Fewest chips without cuts, 0 if even 4 cut notes
+};
+
+static VoicePlanReport g_voicePlanReport;
+
+// Simulate one chip count; fills bits 4*(chips-1) of plan (one entry per event)
+static void PlanVoices(const PlaybackEvents& events, int chips, std::vector<uint16_t>& plan,
+                       VoicePlanReport& report) {
+    int voiceCount = chips * YM_VOICES_PER_CHIP;
+    int shift = 4 * (chips - 1);
+    uint64_t songEndUs = events.size() > 0 ? events.timeUs.back() : 0;
+
+    bool busy[YM_MAX_VOICES] = {};
+    bool used[YM_MAX_VOICES] = {};
+    uint64_t releaseOrder[YM_MAX_VOICES] = {};  // Idle list position: release sequence number
+    uint64_t endUs[YM_MAX_VOICES] = {};
+    uint8_t pitch[YM_MAX_VOICES] = {};
+    int timbreValue[YM_MAX_VOICES];             // Last 0x88 value per voice, -1 = unknown
+    int chipActive[YM_MAX_CHIPS] = {};
+    uint64_t releases = 0;
+    for (int c = 0; c < YM_MAX_VOICES; c++) timbreValue[c] = -1;
+    NoteTable table;
+
+    // Free voice c is a better pick than v (same order as find_free_channel())
+    auto freeBetter = [&](int c, int v) {
+        int load = chipActive[c / YM_VOICES_PER_CHIP];
+        int bestLoad = chipActive[v / YM_VOICES_PER_CHIP];
+        if (load != bestLoad) return load < bestLoad;
+        if (used[c] != used[v]) return !used[c];
+        return used[c] && releaseOrder[c] < releaseOrder[v];
+    };
+
+    int steals = 0;
+    int writesSaved = 0;
+    uint64_t truncatedUs = 0;
+    for (int i = 0; i < events.size(); i++) {
+        const PlaybackEvent& event = events.message[i];
+        if (event.channel == 9) continue;  // Drums don't use voices
+
+        if (event.type == PEV_NOTE_ON) {
+            // Timbre affinity on the instrument's timbre register (volume and
+            // pedal mode are only known while playing)
+            int timbre = ym2163_timbre_value(events.instrument[i].wave, events.instrument[i].envelope);
+            int v = -1, plain = -1;
+            for (int c = 0; c < voiceCount; c++) {
+                if (busy[c]) continue;
+                if (plain < 0 || freeBetter(c, plain)) plain = c;
+                if (v < 0 || ((timbreValue[c] == timbre) != (timbreValue[v] == timbre) ?
+                              timbreValue[c] == timbre : freeBetter(c, v))) v = c;
+            }
+            if (v >= 0 && timbreValue[v] == timbre && timbreValue[plain] != timbre) writesSaved++;
+            if (v < 0) {
+                for (int c = 0; c < voiceCount; c++) {
+                    if (v < 0 || endUs[c] < endUs[v] || (endUs[c] == endUs[v] && pitch[c] < pitch[v])) v = c;
+                }
+                uint64_t lostUntil = endUs[v] < songEndUs ? endUs[v] : songEndUs;
+                if (lostUntil > events.timeUs[i]) truncatedUs += lostUntil - events.timeUs[i];
+                steals++;
+            } else {
+                chipActive[v / YM_VOICES_PER_CHIP]++;
+            }
+            busy[v] = used[v] = true;
+            timbreValue[v] = timbre;
+            endUs[v] = events.noteEndUs[i];
+            pitch[v] = event.data1;
+            table.link(event.channel, event.data1, v);
+            plan[i] |= (uint16_t)(v << shift);
+        } else if (event.type == PEV_NOTE_OFF) {
+            int v = table.oldest(event.channel, event.data1);
+            if (v < 0) continue;
+            table.unlink(v);
+            busy[v] = false;
+            chipActive[v / YM_VOICES_PER_CHIP]--;
+            releaseOrder[v] = ++releases;
+        }
+    }
+
+    report.steals[chips - 1] = steals;
+    report.truncatedSeconds[chips - 1] = truncatedUs / 1000000.0;
+    report.writesSaved[chips - 1] = writesSaved;
+}
+
+// Plan the voices of events into plan and report. Touches no shared state, so the
+// streaming loader runs it outside the engine lock; returns false if cancel was set
+// (checked between chip counts).
+static bool BuildVoicePlan(const PlaybackEvents& events, std::vector<uint16_t>& plan,
+                           VoicePlanReport& report, const std::atomic<bool>* cancel = NULL) {
+    plan.assign(events.size(), 0);
+
+    // Peak polyphony with unlimited voices, paired as NoteTable pairs notes
+    uint16_t held[16][128] = {};
+    int sounding = 0;
+    report.peakPolyphony = 0;
+    for (int i = 0; i < events.size(); i++) {
+        const PlaybackEvent& event = events.message[i];
+        if (event.channel == 9) continue;
+        if (event.type == PEV_NOTE_ON) {
+            held[event.channel][event.data1]++;
+            if (++sounding > report.peakPolyphony) report.peakPolyphony = sounding;
+        } else if (event.type == PEV_NOTE_OFF && held[event.channel][event.data1] > 0) {
+            held[event.channel][event.data1]--;
+            sounding--;
+        }
+    }
+
+    report.chipsNeeded = 0;
+    for (int chips = 1; chips <= YM_MAX_CHIPS; chips++) {
+        if (cancel && *cancel) return false;
+        PlanVoices(events, chips, plan, report);
+        if (report.chipsNeeded == 0 && report.steals[chips - 1] == 0) {
+            report.chipsNeeded = chips;
+        }
+    }
+    return true;
+}
+
+static void LogVoicePlan() {
+    const VoicePlanReport& r = g_voicePlanReport;
+    log_command("Voice plan: peak polyphony %d, chips needed: %s", r.peakPolyphony,
+                r.chipsNeeded > 0 ? std::to_string(r.chipsNeeded).c_str() : "more than 4");
+    for (int chips = 1; chips <= YM_MAX_CHIPS; chips++) {
+        log_command("  %d chip%s (%2d voices): %d steals, %.1f s truncated, %d timbre writes saved",
+                    chips, chips > 1 ? "s" : " ", chips * YM_VOICES_PER_CHIP, r.steals[chips - 1],
+                    r.truncatedSeconds[chips - 1], r.writesSaved[chips - 1]);
+    }
+}
+
+// Voice planned for note-on event index with the enabled chips; whatever the
+// voice still plays (the planned victim) is cut. Notes the plan does not know
+// about (restored by a seek, started before the plan was ready, played on the
+// keyboard) can hold the planned voice while another is free: then the note
+// takes a free voice as find_free_channel() picks it, with the same timbre
+// affinity, instead of cutting one.
+static int TakePlannedVoice(int index, int timbre, int envelope, int volume) {
+    voice_alloc_sync();
+    int chips = get_chip_count();
+    int v = (g_midiPlayer.events.voicePlan[index] >> (4 * (chips - 1))) & 0x0F;
+    if (g_channels[v].active && voice_alloc_has_free()) {
+        return find_free_channel(timbre, envelope, volume);
+    }
+    if (g_channels[v].active) {
+        stop_note(v);
+        g_voiceAlloc.steals++;
+    }
+    g_channels[v].hasBeenUsed = true;
+    return v;
+}
+
 // ===== MIDI Player Functions =====
 
-bool LoadMIDIFile(const char* filename) {
-    g_midiPlayer.midiFile.clear();
+// Playback form of a MIDI message; false for messages playback does not use
+static bool ToPlaybackEvent(const MidiEvent& event, PlaybackEvent& pev) {
+    pev.channel = (uint8_t)event.getChannelNibble();
+    pev.data1 = (uint8_t)(event.getP1() & 0x7F);
+    pev.data2 = (uint8_t)(event.getP2() & 0x7F);
+
+    if (event.isNoteOn()) {
+        pev.type = PEV_NOTE_ON;
+    } else if (event.isNoteOff()) {
+        pev.type = PEV_NOTE_OFF;  // Also note-on with velocity 0
+    } else if (event.isController()) {
+        pev.type = PEV_CONTROLLER;
+    } else if (event.isPatchChange()) {
+        pev.type = PEV_PROGRAM;
+    } else if (event.isTempo()) {
+        int tempo = event.getTempoMicroseconds();
+        pev.type = PEV_TEMPO;
+        pev.channel = (uint8_t)(tempo >> 16);
+        pev.data1 = (uint8_t)(tempo >> 8);
+        pev.data2 = (uint8_t)tempo;
+    } else {
+        return false;
+    }
+    return true;
+}
 
-    // Convert UTF-8 path to wide string for Unicode support
+// Pairs note-offs with note-ons the way NoteTable releases them (same channel
+// and key, oldest note-on first) and stores each note's end in noteEndUs for
+// look-ahead stealing. Notes never released keep UINT64_MAX.
+struct NotePairing {
+    int pendingHead[16][128];
+    int pendingTail[16][128];
+    std::vector<int> nextPending;  // Per event: next unreleased note-on of the same key
+
+    void reset() {
+        memset(pendingHead, -1, sizeof(pendingHead));
+        memset(pendingTail, -1, sizeof(pendingTail));
+        std::vector<int>().swap(nextPending);
+    }
+
+    // Pair events [first, events.size()); their noteEndUs entries must exist
+    void add(PlaybackEvents& events, int first) {
+        int eventCount = events.size();
+        nextPending.resize(eventCount, -1);
+        for (int i = first; i < eventCount; i++) {
+            const PlaybackEvent& pev = events.message[i];
+            if (pev.type != PEV_NOTE_ON && pev.type != PEV_NOTE_OFF) continue;
+            int& head = pendingHead[pev.channel][pev.data1];
+            int& tail = pendingTail[pev.channel][pev.data1];
+            if (pev.type == PEV_NOTE_ON) {
+                if (tail >= 0) nextPending[tail] = i; else head = i;
+                tail = i;
+            } else if (head >= 0) {
+                events.noteEndUs[head] = events.timeUs[i];
+                head = nextPending[head];
+                if (head < 0) tail = -1;
+            }
+        }
+    }
+};
+
+static NotePairing g_notePairing;
+
+// Convert the joined, time-analyzed track into g_midiPlayer.events
+static void BuildPlaybackEvents(MidiEventList& track) {
+    PlaybackEvents& events = g_midiPlayer.events;
+    events.clear();
+    events.timeUs.reserve(track.size());
+    events.message.reserve(track.size());
+
+    for (int i = 0; i < track.size(); i++) {
+        MidiEvent& event = track[i];
+        PlaybackEvent pev;
+        if (!ToPlaybackEvent(event, pev)) continue;  // Not used by playback
+
+        events.timeUs.push_back((uint64_t)(event.seconds * 1000000.0 + 0.5));
+        events.message.push_back(pev);
+    }
+
+    events.noteEndUs.assign(events.size(), UINT64_MAX);
+    g_notePairing.reset();
+    g_notePairing.add(events, 0);
+    g_notePairing.reset();  // Release the links
+}
+
+// Player state for a newly loaded file (either load path)
+static void ResetPlayerForLoad(const char* filename, int ticksPerQuarterNote) {
+    std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+    g_midiPlayer.currentFileName = filename;
+    g_midiPlayer.currentTick = 0;
+    g_midiPlayer.isPlaying = false;
+    g_midiPlayer.isPaused = false;
+    g_midiPlayer.ticksPerQuarterNote = ticksPerQuarterNote;
+    g_midiPlayer.tempo = 500000.0;  // Default tempo
+    g_noteTable.clear();
+    g_voiceAlloc.steals = 0;  // Allocator statistics are per song
+    g_voiceAlloc.writesSaved = 0;
+    memset(g_midiPlayer.channelProgram, 0, sizeof(g_midiPlayer.channelProgram));
+    memset(g_midiPlayer.channelBank, 0, sizeof(g_midiPlayer.channelBank));
+    memset(g_midiPlayer.firstProgram, 0, sizeof(g_midiPlayer.firstProgram));
+    ResetPianoKeyStates();
+
+    // Reset sustain pedal state when loading new file
+    g_sustainPedalActive = false;
+}
+
+static void LogLoadedEvents(int midiEvents, int numTracks) {
+    log_command("Events: %d (%d used for playback, %d KB)", midiEvents, g_midiPlayer.events.size(),
+                (int)(g_midiPlayer.events.size() *
+                      (2 * sizeof(uint64_t) + sizeof(PlaybackEvent) + sizeof(ResolvedInstrument) +
+                       sizeof(uint16_t)) / 1024));
+    log_command("Tracks: %d  Notes: %d  Channels used: %04X", numTracks,
+                g_midiPlayer.stats.noteOns, g_midiPlayer.stats.channelMask);
+}
+
+// ===== Streaming Loader =====
+// With streaming load on, LoadMIDIFile() decodes only the start of the file, up
+// to STREAM_LOOKAHEAD_US past the first melody note, so playback can begin after
+// the same short work whatever the file size. MidiStreamReader merges the tracks
+// while decoding them, in joinTracks() order and with the same event times. A
+// background thread then decodes the rest in batches without the engine lock and
+// appends each batch under it (note-off pairing, instruments, seek checkpoints).
+// It runs below normal priority, raised to normal while less than
+// STREAM_LOOKAHEAD_US is decoded ahead of the play position; if playback still
+// catches up, song time waits for the loader instead of skipping events. The
+// voice plan, velocity analysis and file statistics are finished once the end
+// of the file is reached; until then note-ons allocate voices while playing.
+//
+// Bounded memory playback: a file whose events would take more than
+// g_memoryLimitMB is always streamed, through a window of windowEvents events.
+// When a batch does not fit, the loader waits for playback to pass the start of
+// the window and drops the events already played, so memory stays the same
+// however long the song is. Notes that cannot be heard are not kept: note-ons
+// the dynamic velocity mapping mutes, notes released at the tick they start,
+// and drum note-offs (drums are one-shot). The song length, which the window
+// cannot give, comes from a scan of the file by the loader thread. Restarting
+// and seeking decode the file again from the start on the loader thread, while
+// song time waits at the target (RestreamMIDIFile); the voice plan and
+// compiling need the whole song and are not available.
+
+#define STREAM_LOOKAHEAD_US 3000000.0  // Song decoded ahead of the play position
+#define STREAM_BATCH_US      250000.0  // Song time decoded per batch
+#define STREAM_BATCH_EVENTS     16384  // Most events decoded per batch
+#define STREAM_WAIT_MS             10  // Poll interval while the window is full
+#define STREAM_NOTE_DROPPED        -1  // Note queue entry of a filtered note-on
+
+// Memory per playback event, without and with the voice plan
+#define STREAM_EVENT_BYTES (2 * sizeof(uint64_t) + sizeof(PlaybackEvent) + sizeof(ResolvedInstrument))
+#define STREAM_PLANNED_EVENT_BYTES (STREAM_EVENT_BYTES + sizeof(uint16_t))
+
+// Note-ons of one channel and key not yet released, oldest first (the order
+// NoteTable releases them in): absolute event number, STREAM_NOTE_DROPPED, or
+// -2 - batch position while the tick of the note-on is being filtered
+struct StreamNoteQueue {
+    std::vector<int64_t> items;
+    size_t head;
+
+    StreamNoteQueue() : head(0) {}
+
+    bool empty() const { return head == items.size(); }
+
+    void push(int64_t item) {
+        if (head > 0 && head * 2 >= items.size()) {  // Reuse the space of released notes
+            items.erase(items.begin(), items.begin() + head);
+            head = 0;
+        }
+        items.push_back(item);
+    }
+
+    int64_t pop() { return items[head++]; }
+
+    void clear() {
+        std::vector<int64_t>().swap(items);
+        head = 0;
+    }
+};
+
+struct StreamLoaderState {
+    std::thread thread;
+    std::atomic<bool> cancel;
+    MidiStreamReader reader;       // Used by the loader thread only once it runs
+    std::chrono::steady_clock::time_point startTime;
+    bool reloaded;                 // Opened again by RestreamMIDIFile()
+
+    // Bounded memory playback; kept for the song when it is restreamed
+    bool windowed;
+    int windowEvents;              // Most events in g_midiPlayer.events
+    bool velocityAnalyzed;         // g_velocityAnalysis is of this song (set under the engine lock)
+
+    // Engine lock
+    int program[16];               // Program per channel after the appended events
+    int midiEvents;                // MIDI events read, including ones playback drops
+    int percent;                   // Track data decoded
+    int64_t base;                  // Absolute event number of events[0]
+    double songUs;                 // Song length when windowed, -1 until the loader has scanned the file
+    double firstNoteUs;            // First melody note, where a restart skipping silence starts
+    size_t statsBytes;             // Track data g_midiPlayer.stats counts (kept across restreams)
+    bool countedAll;               // End of the file reached once: the stats count every note
+
+    // Loader (the UI thread before the loader thread starts)
+    double skipUs;                 // Restream target: events before it are not kept, -1 for none
+    int muteBelow;                 // Note-on velocities filtered out, 0 for none
+    int filteredQuiet;             // Note-ons (with their note-offs) filtered by velocity
+    int filteredShort;             // Notes released at the tick they start
+    int64_t nextEvent;             // Absolute event number of the next kept event
+    StreamNoteQueue notes[16][128];
+    int tickPushes[16][128];       // Note-ons queued in the tick being filtered
+    std::vector<int> tickKeys;     // channel << 7 | key of the queues pushed to
+    std::vector<uint8_t> tickDrop;
+    std::vector<int> tickPos;      // Batch position after filtering
+    std::vector<std::pair<int, uint64_t>> tickEnds;        // Same-tick note ends (batch position)
+    std::vector<std::pair<int64_t, uint64_t>> noteEnds;    // Ends of note-ons before the batch
+
+    // Decoded batch, and arrays grown for it, prepared without the lock
+    int64_t batchFirst;            // Absolute event number of the batch start
+    std::vector<uint64_t> batchTimeUs;
+    std::vector<PlaybackEvent> batchMessage;
+    std::vector<uint64_t> batchNoteEndUs;
+    PlaybackEvents grown;
+    int grownDrop;                 // Played events left out of the grown arrays
+    int grownProgram[16];          // firstProgram after them
+
+    StreamLoaderState() : cancel(false), reloaded(false), windowed(false), windowEvents(0),
+                          velocityAnalyzed(false), midiEvents(0), percent(0), base(0), songUs(-1.0),
+                          firstNoteUs(0.0), statsBytes(0), countedAll(false), skipUs(-1.0), muteBelow(0),
+                          filteredQuiet(0), filteredShort(0), nextEvent(0), batchFirst(0), grownDrop(0) {
+        memset(program, 0, sizeof(program));
+        memset(tickPushes, 0, sizeof(tickPushes));
+        memset(grownProgram, 0, sizeof(grownProgram));
+    }
+};
+
+static StreamLoaderState g_streamLoader;
+
+// Calculate total MIDI duration in microseconds; -1 while bounded memory
+// playback has not scanned the song yet
+double GetMIDITotalDuration() {
+    if (g_midiPlayer.currentFileName.empty()) return 0.0;
+    if (g_streamLoader.windowed) return g_streamLoader.songUs;  // The window holds only part of the song
+    if (g_midiPlayer.events.size() == 0) return 0.0;
+
+    // Time of the last event (every tempo segment counted)
+    return GetMIDIEventMicros(g_midiPlayer.events.size() - 1);
+}
+
+// Take the engine lock unless cancelled; polled so that StopStreamLoader() can
+// join the loader while holding the lock
+static bool StreamLock(std::unique_lock<std::recursive_mutex>& lock) {
+    while (!lock.try_lock()) {
+        if (g_streamLoader.cancel) return false;
+        Sleep(1);
+    }
+    return true;
+}
+
+// Note-on velocity below which the velocity mapping mutes a note; 0 (filter
+// nothing) outside bounded memory playback or before the song is analyzed
+static int StreamMuteThreshold() {
+    const StreamLoaderState& sl = g_streamLoader;
+    if (!sl.windowed || !sl.velocityAnalyzed) return 0;
+    if (!g_enableVelocityMapping || !g_enableDynamicVelocityMapping) return 0;
+    return g_velocityAnalysis.threshold_mute;
+}
+
+// Note counts (velocity analysis, channels) of everything decoded from the file
+// start, notes the window drops included. A restream reads the file again from
+// the start; the counts of the pass that read furthest are kept.
+static void StreamUpdateStats() {
+    StreamLoaderState& sl = g_streamLoader;
+    size_t read = sl.reader.getBytesRead();
+    if (read <= sl.statsBytes) return;
+    g_midiPlayer.stats = sl.reader.getTotalStats();
+    sl.statsBytes = read;
+}
+
+// Pair and filter the events of one tick, batch positions [first, end). A tick
+// is handled as a whole so that a note released at the tick it starts is seen
+// with its note-on.
+static void StreamFilterTick(int first) {
+    StreamLoaderState& sl = g_streamLoader;
+    int end = (int)sl.batchMessage.size();
+    sl.tickDrop.assign(end - first, 0);
+    sl.tickEnds.clear();
+
+    for (int i = first; i < end; i++) {
+        const PlaybackEvent& pev = sl.batchMessage[i];
+        if (pev.type != PEV_NOTE_ON && pev.type != PEV_NOTE_OFF) continue;
+        if (pev.channel == 9) {
+            // Drum note-ons take no voice, so their note-offs release nothing
+            if (sl.windowed && pev.type == PEV_NOTE_OFF) sl.tickDrop[i - first] = 1;
+            continue;
+        }
+
+        StreamNoteQueue& queue = sl.notes[pev.channel][pev.data1];
+        if (pev.type == PEV_NOTE_ON) {
+            if (pev.data2 < sl.muteBelow) {
+                sl.tickDrop[i - first] = 1;
+                sl.filteredQuiet++;
+                queue.push(STREAM_NOTE_DROPPED);
+            } else {
+                queue.push(-2 - (int64_t)i);
+            }
+            if (sl.tickPushes[pev.channel][pev.data1]++ == 0) {
+                sl.tickKeys.push_back(pev.channel << 7 | pev.data1);
+            }
+            continue;
+        }
+
+        if (queue.empty()) continue;  // Releases nothing; kept as read
+        int64_t on = queue.pop();
+        if (on == STREAM_NOTE_DROPPED) {
+            sl.tickDrop[i - first] = 1;
+        } else if (on <= -2) {
+            int onPos = (int)(-2 - on);
+            if (sl.windowed) {
+                sl.tickDrop[onPos - first] = 1;
+                sl.tickDrop[i - first] = 1;
+                sl.filteredShort++;
+            } else {
+                sl.tickEnds.push_back(std::make_pair(onPos, sl.batchTimeUs[i]));
+            }
+        } else if (on >= sl.batchFirst) {
+            sl.batchNoteEndUs[(size_t)(on - sl.batchFirst)] = sl.batchTimeUs[i];
+        } else {
+            sl.noteEnds.push_back(std::make_pair(on, sl.batchTimeUs[i]));
+        }
+    }
+
+    // Remove the dropped events
+    sl.tickPos.resize(end - first);
+    int kept = first;
+    for (int i = first; i < end; i++) {
+        if (sl.tickDrop[i - first]) continue;
+        sl.tickPos[i - first] = kept;
+        sl.batchTimeUs[kept] = sl.batchTimeUs[i];
+        sl.batchMessage[kept] = sl.batchMessage[i];
+        kept++;
+    }
+    sl.batchTimeUs.resize(kept);
+    sl.batchMessage.resize(kept);
+    sl.batchNoteEndUs.resize(kept, UINT64_MAX);
+    for (const auto& tickEnd : sl.tickEnds) {
+        sl.batchNoteEndUs[sl.tickPos[tickEnd.first - first]] = tickEnd.second;
+    }
+
+    // Note-ons still queued get their absolute event numbers; they are among the
+    // last tickPushes entries of their queue
+    for (int k : sl.tickKeys) {
+        int& pushes = sl.tickPushes[k >> 7][k & 127];
+        StreamNoteQueue& queue = sl.notes[k >> 7][k & 127];
+        for (size_t j = queue.items.size(); pushes > 0 && j > queue.head; pushes--) {
+            int64_t& item = queue.items[--j];
+            if (item <= -2) item = sl.batchFirst + sl.tickPos[(int)(-2 - item) - first];
+        }
+        pushes = 0;
+    }
+    sl.tickKeys.clear();
+}
+
+// Decode whole ticks into the batch until one at or after untilUs, or until the
+// batch holds STREAM_BATCH_EVENTS events; false once the file is exhausted or
+// at a data error
+static bool StreamDecodeBatch(double untilUs) {
+    StreamLoaderState& sl = g_streamLoader;
+    sl.batchTimeUs.clear();
+    sl.batchMessage.clear();
+    sl.batchNoteEndUs.clear();
+    sl.noteEnds.clear();
+    sl.batchFirst = sl.nextEvent;
+
+    MidiEvent event;
+    int tick;
+    while ((tick = sl.reader.getNextTick()) >= 0 && (int)sl.batchMessage.size() < STREAM_BATCH_EVENTS) {
+        int first = (int)sl.batchMessage.size();
+        double tickUs = 0.0;
+        while (sl.reader.getNextTick() == tick && sl.reader.readEvent(event)) {
+            sl.midiEvents++;
+            tickUs = event.seconds * 1000000.0;
+            PlaybackEvent pev;
+            if (ToPlaybackEvent(event, pev)) {
+                sl.batchTimeUs.push_back((uint64_t)(tickUs + 0.5));
+                sl.batchMessage.push_back(pev);
+            }
+        }
+        StreamFilterTick(first);
+        if (tickUs >= untilUs) break;
+    }
+    sl.nextEvent = sl.batchFirst + (int64_t)sl.batchMessage.size();
+    return sl.reader.getNextTick() >= 0;
+}
+
+// Copy live into a larger array when the batch would not fit, so appending under
+// the engine lock never reallocates (only the loader writes the arrays meanwhile)
+template <typename T>
+static void StreamPrepareGrow(const std::vector<T>& live, std::vector<T>& grown, size_t needed) {
+    if (needed <= live.capacity()) return;
+    grown.reserve(std::max(needed, live.capacity() * 2));
+    grown.assign(live.begin(), live.end());
+}
+
+// Copy live without its first drop events
+template <typename T>
+static void StreamPrepareCompact(const std::vector<T>& live, std::vector<T>& grown, size_t drop,
+                                 size_t capacity) {
+    grown.reserve(capacity);
+    grown.assign(live.begin() + drop, live.end());
+}
+
+template <typename T>
+static void StreamSwapGrown(std::vector<T>& live, std::vector<T>& grown) {
+    if (grown.capacity() > 0) live.swap(grown);
+}
+
+// Make room for the batch. In bounded memory playback a full window is copied
+// without the events already played, after waiting for playback to pass at
+// least a quarter of the window (or all of it for a batch that would not fit
+// otherwise). False if cancelled while waiting.
+static bool StreamPrepareBatch() {
+    StreamLoaderState& sl = g_streamLoader;
+    const PlaybackEvents& events = g_midiPlayer.events;
+    size_t needed = events.timeUs.size() + sl.batchTimeUs.size();
+    sl.grownDrop = 0;
+    if (!sl.windowed) {
+        StreamPrepareGrow(events.timeUs, sl.grown.timeUs, needed);
+        StreamPrepareGrow(events.message, sl.grown.message, needed);
+        StreamPrepareGrow(events.instrument, sl.grown.instrument, needed);
+        StreamPrepareGrow(events.noteEndUs, sl.grown.noteEndUs, needed);
+        return true;
+    }
+
+    size_t window = (size_t)sl.windowEvents;
+    if (needed <= window) return true;
+    size_t drop = std::min(std::max(needed - window, window / 4), events.timeUs.size());
+    for (;;) {
+        std::unique_lock<std::recursive_mutex> lock(g_engineMutex, std::defer_lock);
+        if (!StreamLock(lock)) return false;
+        size_t played = (size_t)g_midiPlayer.currentTick;
+        lock.unlock();
+        if (played >= drop) break;
+        Sleep(STREAM_WAIT_MS);
+    }
+
+    size_t capacity = std::max(window, needed - drop);
+    StreamPrepareCompact(events.timeUs, sl.grown.timeUs, drop, capacity);
+    StreamPrepareCompact(events.message, sl.grown.message, drop, capacity);
+    StreamPrepareCompact(events.instrument, sl.grown.instrument, drop, capacity);
+    StreamPrepareCompact(events.noteEndUs, sl.grown.noteEndUs, drop, capacity);
+    memcpy(sl.grownProgram, g_midiPlayer.firstProgram, sizeof(sl.grownProgram));
+    for (size_t i = 0; i < drop; i++) {
+        const PlaybackEvent& event = events.message[i];
+        if (event.type == PEV_PROGRAM) sl.grownProgram[event.channel] = event.data1;
+    }
+    sl.grownDrop = (int)drop;
+    return true;
+}
+
+// Append the batch from position from on to g_midiPlayer.events (engine lock held)
+static void StreamAppendBatch(int from) {
+    StreamLoaderState& sl = g_streamLoader;
+    PlaybackEvents& events = g_midiPlayer.events;
+    StreamSwapGrown(events.timeUs, sl.grown.timeUs);
+    StreamSwapGrown(events.message, sl.grown.message);
+    StreamSwapGrown(events.instrument, sl.grown.instrument);
+    StreamSwapGrown(events.noteEndUs, sl.grown.noteEndUs);
+    if (sl.grownDrop > 0) {
+        // Window moved past played events: indices shift down
+        g_midiPlayer.currentTick = std::max(0, g_midiPlayer.currentTick - sl.grownDrop);
+        memcpy(g_midiPlayer.firstProgram, sl.grownProgram, sizeof(g_midiPlayer.firstProgram));
+        sl.base += sl.grownDrop;
+        sl.grownDrop = 0;
+    }
+
+    int first = events.size();
+    events.timeUs.insert(events.timeUs.end(), sl.batchTimeUs.begin() + from, sl.batchTimeUs.end());
+    events.message.insert(events.message.end(), sl.batchMessage.begin() + from, sl.batchMessage.end());
+    events.noteEndUs.insert(events.noteEndUs.end(), sl.batchNoteEndUs.begin() + from, sl.batchNoteEndUs.end());
+    events.instrument.resize(events.size());
+    for (const auto& noteEnd : sl.noteEnds) {
+        int64_t index = noteEnd.first - sl.base;  // Negative once dropped
+        if (index >= 0) events.noteEndUs[(size_t)index] = noteEnd.second;
+    }
+    for (int i = first; i < events.size(); i++) {
+        const PlaybackEvent& event = events.message[i];
+        if (event.type == PEV_PROGRAM) {
+            sl.program[event.channel] = event.data1;
+        } else if (event.type == PEV_NOTE_ON) {
+            events.instrument[i] = g_programInstrument[sl.program[event.channel]];
+        }
+    }
+    if (!sl.windowed) {
+        ExtendSeekIndex();  // Bounded memory playback seeks by restreaming
+    }
+
+    StreamUpdateStats();
+    size_t total = sl.reader.getTrackBytes();
+    sl.percent = total > 0 ? (int)(sl.reader.getBytesRead() * 100 / total) : 100;
+    sl.muteBelow = StreamMuteThreshold();
+}
+
+// Seek target of a restream: batch events before skipUs only update state and
+// the programs; returns the batch position appending starts from
+static int StreamSkipEvents(double skipUs, SeekScanState& state) {
+    StreamLoaderState& sl = g_streamLoader;
+    int from = 0;
+    int count = (int)sl.batchTimeUs.size();
+    while (from < count && (double)sl.batchTimeUs[from] < skipUs) {
+        const PlaybackEvent& event = sl.batchMessage[from];
+        state.apply(event);
+        if (event.type == PEV_PROGRAM) sl.program[event.channel] = event.data1;
+        from++;
+    }
+    if (g_midiPlayer.events.size() == 0) {
+        sl.base = sl.batchFirst + from;
+        for (int ch = 0; ch < 16; ch++) g_midiPlayer.firstProgram[ch] = sl.program[ch];
+    }
+    return from;
+}
+
+// Load report once the whole file has been decoded (engine lock held)
+static void LogStreamLoaded() {
+    StreamLoaderState& sl = g_streamLoader;
+    double loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - sl.startTime).count();
+    log_command("=== MIDI File Loaded ===");
+    log_command("File: %s", g_midiPlayer.currentFileName.c_str());
+    if (!sl.reader.getStatus()) {
+        log_command("ERROR: Invalid MIDI data after %s; the rest of the file is skipped",
+                    FormatTime(sl.reader.getSeconds() * 1000000.0).c_str());
+    }
+    LogLoadedEvents(sl.midiEvents, sl.reader.getTrackCount());
+    log_command("Duration: %s  (decoded in %.2f s)",
+                FormatTime(GetMIDITotalDuration()).c_str(), loadSeconds);
+    if (sl.windowed) {
+        log_command("Bounded memory: %lld events kept, %d notes filtered as muted, %d as zero-length",
+                    (long long)sl.nextEvent, sl.filteredQuiet, sl.filteredShort);
+        log_command("Voice plan: not built in bounded memory playback");
+    } else {
+        log_command("Seek index: %d checkpoints, %d held notes",
+                    (int)g_seekIndex.checkpoints.size(), (int)g_seekIndex.notes.size());
+        LogVoicePlan();
+    }
+}
+
+// End of the file: plan the voices (without the lock; nothing else writes the
+// arrays while loading), then publish the plan and the final statistics
+static void StreamFinish() {
+    StreamLoaderState& sl = g_streamLoader;
+    std::vector<uint16_t> plan;
+    VoicePlanReport report = VoicePlanReport();  // None in bounded memory playback
+    if (!sl.windowed && !BuildVoicePlan(g_midiPlayer.events, plan, report, &sl.cancel)) return;
+
+    std::unique_lock<std::recursive_mutex> lock(g_engineMutex, std::defer_lock);
+    if (!StreamLock(lock)) return;
+
+    g_midiPlayer.events.voicePlan.swap(plan);
+    g_voicePlanReport = report;
+    if (sl.windowed && sl.songUs < 0.0 && g_midiPlayer.events.size() > 0) {
+        sl.songUs = GetMIDIEventMicros(g_midiPlayer.events.size() - 1);  // Decoded before the scan ran
+    }
+    StreamUpdateStats();
+    g_midiPlayer.loading = false;
+    for (int ch = 0; ch < 16; ch++) {
+        for (int key = 0; key < 128; key++) sl.notes[ch][key].clear();
+    }
+
+    // Instrument configs saved while loading
+    if (g_midiPlayer.resolvePending) {
+        ResolveMIDIInstruments();
+    }
+    if (!sl.reloaded) {  // A restreamed song was reported when first loaded
+        LogStreamLoaded();
+    }
+
+    // Redone with the counts of the whole file, the first time its end is
+    // reached (a restream started before then reads it to the end as well)
+    if (!sl.countedAll) {
+        sl.countedAll = true;
+        if (g_enableDynamicVelocityMapping) {
+            AnalyzeVelocityDistribution();
+            sl.velocityAnalyzed = true;
+        }
+    }
+}
+
+// First batch of a restream kept (engine lock held): the seek index starts with
+// the state at the target, and the notes held there sound again
+static void StreamPublishRestream(const SeekScanState& state) {
+    StreamLoaderState& sl = g_streamLoader;
+    BeginSeekIndex(state);  // Only checkpoint: the window start
+    g_midiPlayer.currentTick = 0;
+    RebuildActiveNotesAfterSeek(0);
+    sequencer_wake();
+
+    double readyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sl.startTime).count();
+    log_command("Decoded again up to %s in %.1f ms (bounded memory)", FormatTime(sl.skipUs).c_str(), readyMs);
+}
+
+static void StreamLoaderThread() {
+    StreamLoaderState& sl = g_streamLoader;
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+    bool boosted = false;
+
+    // The window never holds the whole song: its length comes from a scan of
+    // the file (delta times and tempo changes only), once per song
+    if (sl.windowed && sl.songUs < 0.0) {
+        double songUs = sl.reader.scanEndSeconds(&sl.cancel) * 1000000.0;
+        std::unique_lock<std::recursive_mutex> lock(g_engineMutex, std::defer_lock);
+        if (!StreamLock(lock)) return;
+        sl.songUs = songUs;
+    }
+
+    // Restream: the batches before the target only update the playback state
+    SeekScanState skipState;
+    bool skipping = sl.skipUs >= 0.0;
+
+    bool more = true;
+    while (more) {
+        if (sl.cancel) return;
+        double untilUs = sl.reader.getSeconds() * 1000000.0 + STREAM_BATCH_US;
+        more = StreamDecodeBatch(skipping ? std::max(untilUs, sl.skipUs) : untilUs);
+        if (!StreamPrepareBatch()) return;
+
+        std::unique_lock<std::recursive_mutex> lock(g_engineMutex, std::defer_lock);
+        if (!StreamLock(lock)) return;
+        StreamAppendBatch(skipping ? StreamSkipEvents(sl.skipUs, skipState) : 0);
+        if (skipping && (g_midiPlayer.events.size() > 0 || !more)) {
+            StreamPublishRestream(skipState);
+            skipping = false;
+        }
+        double leadUs = sl.reader.getSeconds() * 1000000.0 - g_midiPlayer.accumulatedTime;
+        bool behind = g_midiPlayer.isPlaying && leadUs < STREAM_LOOKAHEAD_US;
+        lock.unlock();
+
+        sl.grown.clear();  // Arrays replaced by the grown copies
+        if (behind != boosted) {
+            SetThreadPriority(GetCurrentThread(), behind ? THREAD_PRIORITY_NORMAL : THREAD_PRIORITY_BELOW_NORMAL);
+            boosted = behind;
+        }
+    }
+    StreamFinish();
+}
+
+// Stop a load still in progress (engine lock may be held)
+void StopStreamLoader() {
+    StreamLoaderState& sl = g_streamLoader;
+    if (sl.thread.joinable()) {
+        sl.cancel = true;
+        sl.thread.join();
+    }
+    sl.cancel = false;
+    sl.reader.close();
+    std::vector<uint64_t>().swap(sl.batchTimeUs);
+    std::vector<PlaybackEvent>().swap(sl.batchMessage);
+    std::vector<uint64_t>().swap(sl.batchNoteEndUs);
+    std::vector<std::pair<int64_t, uint64_t>>().swap(sl.noteEnds);
+    sl.grown.clear();
+    for (int ch = 0; ch < 16; ch++) {
+        for (int key = 0; key < 128; key++) sl.notes[ch][key].clear();
+    }
+    g_midiPlayer.loading = false;
+}
+
+// UTF-8 path as a wide string for Unicode paths on Windows
+static std::wstring MIDIFileWidePath(const char* filename) {
     std::wstring wFilename = UTF8ToWide(filename);
 
 #ifdef _WIN32
@@ -1787,9 +3874,181 @@ bool LoadMIDIFile(const char* filename) {
             wFilename = L"\\\\?\\" + wFilename;
         }
     }
+#endif
+    return wFilename;
+}
+
+// Decode the start of the file and leave the rest to the loader thread. False if
+// the file cannot be streamed (LoadMIDIFile() then reads it whole, and reports
+// the error if it is not readable either). skipToUs >= 0 reopens the loaded song
+// in bounded memory playback, keeping only the events from skipToUs on; all of
+// its decoding is left to the loader thread.
+static bool LoadMIDIFileStreaming(const char* filename, const std::wstring& wFilename, double skipToUs = -1.0) {
+    StreamLoaderState& sl = g_streamLoader;
+    sl.startTime = std::chrono::steady_clock::now();
+#ifdef _WIN32
+    bool opened = sl.reader.open(wFilename);
+#else
+    (void)wFilename;
+    bool opened = sl.reader.open(std::string(filename));
+#endif
+    if (!opened || !sl.reader.getStatus()) {
+        sl.reader.close();
+        return false;
+    }
+
+    // Window when the events (at most one per 3 bytes of track data, the size
+    // of a note with running status) could take more than the limit
+    sl.reloaded = skipToUs >= 0.0;
+    if (!sl.reloaded) {
+        double limitBytes = g_memoryLimitMB * 1024.0 * 1024.0;
+        double eventBytes = (double)(sl.reader.getTrackBytes() / 3) * STREAM_PLANNED_EVENT_BYTES;
+        sl.windowed = g_boundedMemory && eventBytes > limitBytes;
+        // Half the limit: compacting copies the window
+        sl.windowEvents = sl.windowed ? (int)(limitBytes / (2 * STREAM_EVENT_BYTES)) : 0;
+        sl.velocityAnalyzed = false;
+        sl.songUs = -1.0;
+        sl.firstNoteUs = 0.0;
+        sl.statsBytes = 0;
+        sl.countedAll = false;
+        g_midiPlayer.stats.clear();
+        if (!sl.windowed && !g_streamingLoad) {
+            sl.reader.close();
+            return false;
+        }
+    }
 
+    g_midiPlayer.events.clear();
+    g_midiPlayer.tempoMap.clear();  // Times come from the reader
+    ResetPlayerForLoad(filename, sl.reader.getTicksPerQuarterNote());
+    g_midiPlayer.loading = true;
+    g_midiPlayer.resolvePending = false;
+    sl.midiEvents = 0;
+    sl.percent = 0;
+    sl.base = 0;
+    sl.nextEvent = 0;
+    sl.filteredQuiet = 0;
+    sl.filteredShort = 0;
+    sl.muteBelow = StreamMuteThreshold();
+    memset(sl.program, 0, sizeof(sl.program));
+    ResolveProgramInstruments();
+    if (sl.windowed) {
+        PlaybackEvents& events = g_midiPlayer.events;
+        events.timeUs.reserve(sl.windowEvents);
+        events.message.reserve(sl.windowEvents);
+        events.instrument.reserve(sl.windowEvents);
+        events.noteEndUs.reserve(sl.windowEvents);
+    }
+
+    // State at the first kept event; without a window, the seek index grows
+    // with every batch
+    SeekScanState skipState;
+    if (!sl.windowed) BeginSeekIndex(skipState);
+
+    // Decoding up to a restream target can take as long as the whole file: the
+    // loader thread does it and publishes the window (StreamPublishRestream)
+    sl.skipUs = skipToUs;
+    if (sl.reloaded) {
+        sl.thread = std::thread(StreamLoaderThread);
+        return true;
+    }
+
+    // Up to the look-ahead past the first melody note (the first note
+    // auto-skip silence jumps to), and at most half the window
+    double readyUs = -1.0;
+    bool more = true;
+    while (more) {
+        double untilUs = readyUs < 0.0 ? sl.reader.getSeconds() * 1000000.0 + STREAM_BATCH_US : readyUs;
+        more = StreamDecodeBatch(untilUs);
+        int first = g_midiPlayer.events.size();
+        StreamAppendBatch(0);
+        for (int i = first; readyUs < 0.0 && i < g_midiPlayer.events.size(); i++) {
+            const PlaybackEvent& event = g_midiPlayer.events.message[i];
+            if (event.type == PEV_NOTE_ON && event.channel != 9) {
+                sl.firstNoteUs = GetMIDIEventMicros(i);
+                readyUs = sl.firstNoteUs + STREAM_LOOKAHEAD_US;
+            }
+        }
+        if (readyUs >= 0.0 && sl.reader.getSeconds() * 1000000.0 >= readyUs) break;
+        if (sl.windowed && g_midiPlayer.events.size() >= sl.windowEvents / 2) break;
+    }
+    if (sl.windowed) BeginSeekIndex(skipState);  // Only checkpoint: the window start
+
+    double readyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sl.startTime).count();
+    log_command("=== MIDI File Loading ===");
+    log_command("File: %s", filename);
+    log_command("Tracks: %d  TPQ: %d", sl.reader.getTrackCount(), g_midiPlayer.ticksPerQuarterNote);
+    int decoded = g_midiPlayer.events.size();
+    log_command("Ready to play after %.1f ms: %d events (%s of song, %d%% of the file) decoded",
+                readyMs, decoded, FormatTime(decoded > 0 ? GetMIDIEventMicros(decoded - 1) : 0.0).c_str(),
+                sl.percent);
+    if (sl.windowed) {
+        log_command("Bounded memory playback: window of %d events (%d MB limit)",
+                    sl.windowEvents, g_memoryLimitMB);
+    }
+
+    if (!more) {
+        StreamFinish();  // Whole file already decoded
+        return true;
+    }
+
+    // Dynamic velocity mapping from the notes decoded so far; redone with every
+    // note of the file once loading reaches its end (StreamFinish)
+    if (g_enableDynamicVelocityMapping) {
+        AnalyzeVelocityDistribution();
+        sl.velocityAnalyzed = true;
+    }
+
+    sl.thread = std::thread(StreamLoaderThread);
+    return true;
+}
+
+// Bounded memory playback holds no events before the window: restarting or
+// seeking decodes the song again from the start, keeping the events from
+// targetUs on. The loader thread decodes it and restores the playback state at
+// the target when it publishes the window; until then song time waits at the
+// target. The play state is kept. Engine lock held.
+static bool RestreamMIDIFile(double targetUs) {
+    bool isPlaying = g_midiPlayer.isPlaying;
+    bool isPaused = g_midiPlayer.isPaused;
+    std::string filename = g_midiPlayer.currentFileName;
+    StopStreamLoader();
+    if (!LoadMIDIFileStreaming(filename.c_str(), MIDIFileWidePath(filename.c_str()), targetUs)) {
+        log_command("ERROR: Failed to reopen MIDI file: %s", filename.c_str());
+        return false;
+    }
+    g_midiPlayer.isPlaying = isPlaying;
+    g_midiPlayer.isPaused = isPaused;
+    return true;
+}
+
+// Replace the loaded song. Playback must be stopped: the sequencer leaves the
+// player data alone then, so this runs without the engine lock (the streaming
+// loader thread takes it for each batch).
+bool LoadMIDIFile(const char* filename) {
+    // A previous file may still be streaming in
+    StopStreamLoader();
+    g_streamLoader.windowed = false;
+
+    // Only needed while loading; playback uses the flat event arrays
+    MidiFile midiFile;
+    midiFile.setArenaMode(true);
+    midiFile.setReadThreads(0);  // Tracks are decoded on all cores
+    g_midiPlayer.events.clear();
+    g_midiPlayer.stats.clear();
+
+    // Convert UTF-8 path to wide string for Unicode support
+    std::wstring wFilename = MIDIFileWidePath(filename);
+
+    // Play as soon as the start of the file is decoded, and stream large files
+    // through a fixed window (Streaming Loader)
+    if ((g_streamingLoad || g_boundedMemory) && LoadMIDIFileStreaming(filename, wFilename)) {
+        return true;
+    }
+
+#ifdef _WIN32
     // Use wide string version for proper Unicode path support on Windows
-    if (!g_midiPlayer.midiFile.read(wFilename)) {
+    if (!midiFile.read(wFilename)) {
         // Try to provide more helpful error message
         DWORD error = GetLastError();
         if (error == ERROR_FILE_NOT_FOUND) {
@@ -1808,33 +4067,45 @@ bool LoadMIDIFile(const char* filename) {
     }
 #else
     // On non-Windows platforms, use standard read method
-    if (!g_midiPlayer.midiFile.read(filename)) {
+    if (!midiFile.read(filename)) {
         log_command("ERROR: Failed to load MIDI file: %s", filename);
         return false;
     }
 #endif
 
-    g_midiPlayer.currentFileName = filename;
-    g_midiPlayer.currentTick = 0;
-    g_midiPlayer.isPlaying = false;
-    g_midiPlayer.isPaused = false;
-    g_midiPlayer.ticksPerQuarterNote = g_midiPlayer.midiFile.getTicksPerQuarterNote();
-    g_midiPlayer.tempo = 500000.0;  // Default tempo
-    g_midiPlayer.activeNotes.clear();
-    ResetPianoKeyStates();
-
-    // Reset sustain pedal state when loading new file
-    g_sustainPedalActive = false;
+    ResetPlayerForLoad(filename, midiFile.getTicksPerQuarterNote());
+    g_midiPlayer.stats = midiFile.getTotalStats();
+    int numTracks = midiFile.getTrackCount();
 
     // Make sure ticks are absolute
-    g_midiPlayer.midiFile.makeAbsoluteTicks();
-    g_midiPlayer.midiFile.joinTracks();  // Merge all tracks for easier playback
+    midiFile.makeAbsoluteTicks();
+    midiFile.joinTracks();  // Merge all tracks for easier playback
+
+    // Tempo map built once: every event gets its absolute time, and tick<->time
+    // lookups are a binary search over the tempo segments
+    midiFile.doTimeAnalysis();
+    g_midiPlayer.tempoMap = midiFile.getTempoMap();
+    const MidiTempoMap& tempoMap = g_midiPlayer.tempoMap;
+    g_midiPlayer.tempo = tempoMap.getTempoMicrosecondsAtTick(0);
+
+    int numEvents = midiFile.getEventCount(0);
+    BuildPlaybackEvents(midiFile[0]);
+    midiFile.clear();
 
-    int numEvents = g_midiPlayer.midiFile.getEventCount(0);
     log_command("=== MIDI File Loaded ===");
     log_command("File: %s", filename);
-    log_command("Events: %d", numEvents);
+    LogLoadedEvents(numEvents, numTracks);
     log_command("TPQ: %d", g_midiPlayer.ticksPerQuarterNote);
+    log_command("Tempo segments: %d  Duration: %s", tempoMap.getSegmentCount(),
+                FormatTime(GetMIDITotalDuration()).c_str());
+
+    BuildSeekIndex();
+    log_command("Seek index: %d checkpoints, %d held notes",
+                (int)g_seekIndex.checkpoints.size(), (int)g_seekIndex.notes.size());
+
+    ResolveMIDIInstruments();
+    BuildVoicePlan(g_midiPlayer.events, g_midiPlayer.events.voicePlan, g_voicePlanReport);
+    LogVoicePlan();
 
     // Analyze velocity distribution for dynamic mapping
     if (g_enableDynamicVelocityMapping) {
@@ -1936,56 +4207,64 @@ int GetPreviousMIDIFileIndex() {
     }
 }
 
-void PlayNextMIDI() {
-    int nextIndex = GetNextMIDIFileIndex();
-    if (nextIndex >= 0 && nextIndex < (int)g_fileList.size()) {
-        g_currentPlayingIndex = nextIndex;
-        g_selectedFileIndex = nextIndex;
+// Stop playback, reset the chips and play a file from the list (UI thread). The
+// engine lock is taken only around the state changes: once playback is stopped
+// the sequencer leaves the player data alone, so the chips settle and the file
+// is read while it keeps running.
+void PlayMIDIFileAt(int index) {
+    std::string path = g_fileList[index].fullPath;
+    g_currentPlayingIndex = index;
+    g_currentPlayingFilePath = path;
 
-        // Reset YM2163 chips to eliminate residual sound
-        ResetAllYM2163Chips();
+    StopRegisterStream();
+    {
+        std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+        StopStreamLoader();
+        g_midiPlayer.isPlaying = false;
+        g_midiPlayer.isPaused = false;
+        g_midiPlayer.trackFinished = false;
+        stop_all_notes();
+        g_noteTable.clear();
+        ResetPianoKeyStates();
+    }
 
+    // Reset YM2163 chips to eliminate residual sound
+    ResetAllYM2163Chips();
+    {
         // Initialize all channels to eliminate residual sound
+        std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
         InitializeAllChannels();
-        stop_all_notes();
-        g_midiPlayer.activeNotes.clear();
-        ResetPianoKeyStates();
+    }
 
-        if (LoadMIDIFile(g_fileList[nextIndex].fullPath.c_str())) {
-            // Ensure progress bar is reset to 0
-            g_midiPlayer.currentTick = 0;
-            g_midiPlayer.pausedDuration = std::chrono::milliseconds(0);
-            PlayMIDI();
-        }
+    if (LoadMIDIFile(path.c_str())) {
+        std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+        // Ensure progress bar is reset to 0
+        g_midiPlayer.currentTick = 0;
+        g_midiPlayer.pausedDuration = std::chrono::milliseconds(0);
+        PlayMIDI();
+    }
+}
+
+void PlayNextMIDI() {
+    int nextIndex = GetNextMIDIFileIndex();
+    if (nextIndex >= 0 && nextIndex < (int)g_fileList.size()) {
+        g_selectedFileIndex = nextIndex;
+        PlayMIDIFileAt(nextIndex);
     }
 }
 
 void PlayPreviousMIDI() {
     int prevIndex = GetPreviousMIDIFileIndex();
     if (prevIndex >= 0 && prevIndex < (int)g_fileList.size()) {
-        g_currentPlayingIndex = prevIndex;
         g_selectedFileIndex = prevIndex;
-
-        // Reset YM2163 chips to eliminate residual sound
-        ResetAllYM2163Chips();
-
-        // Initialize all channels to eliminate residual sound
-        InitializeAllChannels();
-        stop_all_notes();
-        g_midiPlayer.activeNotes.clear();
-        ResetPianoKeyStates();
-
-        if (LoadMIDIFile(g_fileList[prevIndex].fullPath.c_str())) {
-            // Ensure progress bar is reset to 0
-            g_midiPlayer.currentTick = 0;
-            g_midiPlayer.pausedDuration = std::chrono::milliseconds(0);
-            PlayMIDI();
-        }
+        PlayMIDIFileAt(prevIndex);
     }
 }
 
 void PlayMIDI() {
     if (g_midiPlayer.currentFileName.empty()) return;
+    StopRegisterStream();  // Resets the chips before the engine lock is taken
+    std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
 
     if (g_midiPlayer.isPaused) {
         // Resume from pause
@@ -1994,40 +4273,50 @@ void PlayMIDI() {
         g_midiPlayer.pausedDuration += std::chrono::duration_cast<std::chrono::milliseconds>(now - g_midiPlayer.pauseTime);
         log_command("MIDI playback resumed");
     } else {
+        // Bounded memory playback dropped the start of the song from its window:
+        // the loader decodes it again, from the first note if silence is skipped
+        bool restreamed = g_streamLoader.windowed && g_streamLoader.base > 0 &&
+                          RestreamMIDIFile(g_enableAutoSkipSilence ? g_streamLoader.firstNoteUs : 0.0);
+
         // Start from beginning
         g_midiPlayer.currentTick = 0;
+        g_midiPlayer.tempo = g_midiPlayer.tempoMap.getTempoMicrosecondsAtTick(0);
+        memset(g_midiPlayer.channelProgram, 0, sizeof(g_midiPlayer.channelProgram));
+        memset(g_midiPlayer.channelBank, 0, sizeof(g_midiPlayer.channelBank));
         g_midiPlayer.isPlaying = true;
         g_midiPlayer.playStartTime = std::chrono::steady_clock::now();
         g_midiPlayer.pausedDuration = std::chrono::milliseconds(0);
         stop_all_notes();
-        g_midiPlayer.activeNotes.clear();
+        g_noteTable.clear();
         ResetPianoKeyStates();
         // Reset sustain pedal state when starting new playback
         g_sustainPedalActive = false;
 
         // Auto-skip silence at the beginning if enabled
-        if (g_enableAutoSkipSilence) {
-            int firstNoteTick = 0;
-            int firstNoteIndex = FindFirstNoteEvent(firstNoteTick);
+        if (restreamed) {
+            // Song time waits at the restream target for the window
+            g_midiPlayer.accumulatedTime = g_streamLoader.skipUs;
+        } else if (g_enableAutoSkipSilence) {
+            int firstNoteIndex = FindFirstNoteEvent();
 
             // If there's silence before the first note (firstNoteIndex > 0), skip it
             if (firstNoteIndex > 0) {
                 // Pre-process all control events before the first note
                 // This ensures tempo and other control changes are applied correctly
-                MidiEventList& track = g_midiPlayer.midiFile[0];
-
                 for (int i = 0; i < firstNoteIndex; i++) {
-                    MidiEvent& event = track[i];
+                    const PlaybackEvent& event = g_midiPlayer.events.message[i];
 
                     // Process control events (tempo, program change, etc.)
-                    if (event.isTempo()) {
-                        g_midiPlayer.tempo = event.getTempoMicroseconds();
-                    } else if (event.isController()) {
-                        int controller = event[1];
-                        int value = event[2];
+                    if (event.type == PEV_TEMPO) {
+                        g_midiPlayer.tempo = GetMIDITempoAt(i);
+                    } else if (event.type == PEV_CONTROLLER) {
+                        int controller = event.data1;
+                        int value = event.data2;
                         if (controller == 64 && g_enableSustainPedal) {
                             g_sustainPedalActive = (value >= 64);
                         }
+                    } else if (event.type == PEV_PROGRAM) {
+                        g_midiPlayer.channelProgram[event.channel] = event.data1;
                     }
                     // Skip note events - we don't want to play them
                 }
@@ -2035,13 +4324,12 @@ void PlayMIDI() {
                 // Set the current tick to first note INDEX (not tick value)
                 g_midiPlayer.currentTick = firstNoteIndex;
 
-                // Set accumulated time to match the first note's MIDI tick
+                // Set accumulated time to the first note's song time
                 // This ensures the timing is correct when UpdateMIDIPlayback starts
-                double microsPerTick = g_midiPlayer.tempo / (double)g_midiPlayer.ticksPerQuarterNote;
-                g_midiPlayer.accumulatedTime = (double)firstNoteTick * microsPerTick;
+                g_midiPlayer.accumulatedTime = GetMIDIEventMicros(firstNoteIndex);
 
-                log_command("Auto-skipped to event %d (MIDI tick: %d, time: %.2f ms)",
-                           firstNoteIndex, firstNoteTick, g_midiPlayer.accumulatedTime / 1000.0);
+                log_command("Auto-skipped to event %d (time: %.2f ms)",
+                           firstNoteIndex, g_midiPlayer.accumulatedTime / 1000.0);
             } else {
                 // No silence to skip, start from beginning
                 g_midiPlayer.accumulatedTime = 0.0;
@@ -2058,10 +4346,13 @@ void PlayMIDI() {
         log_command("MIDI playback started");
     }
 
+    g_midiPlayer.trackFinished = false;
     g_midiPlayer.isPlaying = true;
+    sequencer_wake();
 }
 
 void PauseMIDI() {
+    std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
     if (!g_midiPlayer.isPlaying || g_midiPlayer.isPaused) return;
 
     g_midiPlayer.isPaused = true;
@@ -2070,313 +4361,775 @@ void PauseMIDI() {
     log_command("MIDI playback paused");
 }
 
-void StopMIDI() {
-    g_midiPlayer.isPlaying = false;
-    g_midiPlayer.isPaused = false;
-    g_midiPlayer.currentTick = 0;
+// Move playback to song time targetMicros, keeping the play/pause state
+void SeekMIDI(double targetMicros) {
+    std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+    // Bounded memory playback keeps no events before its window: the loader
+    // refills it from the target and restores the state there itself
+    bool restreamed = g_streamLoader.windowed && RestreamMIDIFile(targetMicros);
+
+    // First event at or after the target time (event times are sorted)
+    const PlaybackEvents& events = g_midiPlayer.events;
+    int targetEventIndex = (int)(std::lower_bound(events.timeUs.begin(), events.timeUs.end(),
+                                                  (uint64_t)targetMicros) - events.timeUs.begin());
+    if (targetEventIndex >= events.size()) targetEventIndex = 0;
+
+    g_midiPlayer.currentTick = targetEventIndex;
+
+    // Remember if we were playing before seek
+    bool wasPlaying = g_midiPlayer.isPlaying && !g_midiPlayer.isPaused;
+
+    // Stop all currently playing notes before seek
     stop_all_notes();
-    g_midiPlayer.activeNotes.clear();
+    g_noteTable.clear();
     ResetPianoKeyStates();
-    // Reset sustain pedal state when stopping playback
-    g_sustainPedalActive = false;
+
+    // Reset high-precision timer and accumulated time
+    QueryPerformanceCounter(&g_midiPlayer.lastPerfCounter);
+
+    // Song position at the target
+    g_midiPlayer.accumulatedTime = targetMicros;
+
+    // Recalculate timing based on actual MIDI tick value
+    auto now = std::chrono::steady_clock::now();
+    if (wasPlaying) {
+        // If playing, adjust playStartTime to maintain playing state
+        g_midiPlayer.playStartTime = now - std::chrono::microseconds((int64_t)targetMicros);
+        g_midiPlayer.pausedDuration = std::chrono::milliseconds(0);
+    } else if (g_midiPlayer.isPaused) {
+        // If paused, update pauseTime to new position
+        g_midiPlayer.playStartTime = now - std::chrono::microseconds((int64_t)targetMicros);
+        g_midiPlayer.pauseTime = now;
+        g_midiPlayer.pausedDuration = std::chrono::milliseconds(0);
+    }
+
+    // Restore held notes, sustain, tempo and programs from the checkpoint index
+    if (!restreamed) {
+        RebuildActiveNotesAfterSeek(targetEventIndex);
+    }
+
+    sequencer_wake();
+}
+
+void StopMIDI() {
+    {
+        std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+        g_midiPlayer.isPlaying = false;
+        g_midiPlayer.isPaused = false;
+        g_midiPlayer.trackFinished = false;
+        g_midiPlayer.currentTick = 0;
+        stop_all_notes();
+        g_noteTable.clear();
+        ResetPianoKeyStates();
+        // Reset sustain pedal state when stopping playback
+        g_sustainPedalActive = false;
+    }
     // Reset and initialize all YM2163 chips to eliminate residual sound
     ResetAllYM2163Chips();
+    std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
     InitializeAllChannels();
     log_command("MIDI playback stopped");
+    LogSpfmQueueStats();
+    LogRegisterShadowStats();
+}
+
+// Map a MIDI key to YM2163 note/octave (降低一个八度), folded into B2-B7
+static void midi_key_to_ym2163(int key, int* ymNote, int* ymOctave) {
+    *ymNote = key % 12;
+    *ymOctave = (key / 12) - 2;  // MIDI octave starts at C-1, 降低一个八度
+
+    // Auto-adjust octave if out of range (B2-B7)
+    while (*ymOctave < 0 || (*ymOctave == 0 && *ymNote < 11)) {
+        (*ymOctave)++;  // Move up one octave
+    }
+    while (*ymOctave > 5 || (*ymOctave == 5 && *ymNote > 11)) {
+        (*ymOctave)--;  // Move down one octave
+    }
+}
+
+// Apply one note or controller event: voice allocation, instrument lookup,
+// velocity/pedal mapping and register writes. Shared by live playback and the
+// register stream compiler; tempo events are handled by the caller.
+// index: position of event in g_midiPlayer.events (instrument, note end and
+// planned voice come from there), -1 for synthesized events
+void ProcessMIDIEvent(const PlaybackEvent& event, int index) {
+    if (event.type == PEV_NOTE_ON) {
+        int channel = event.channel;
+        int note = event.data1;
+        int velocity = event.data2;
+
+        // Check if this is a drum channel (MIDI channel 10 = index 9)
+        if (channel == 9) {
+            // Drum event - map MIDI drum note to YM2163 drum
+            if (g_drumConfigs.count(note) > 0) {
+                DrumConfig& drumConfig = g_drumConfigs[note];
+                // Trigger all mapped drums
+                uint8_t drumBits = 0;
+                for (uint8_t bit : drumConfig.drumBits) {
+                    drumBits |= bit;
+                }
+                play_drum(drumBits);
+            }
+        } else {
+            // Note on - melody channel
+            const PlaybackEvents& events = g_midiPlayer.events;
+            uint64_t noteEndUs = index >= 0 ? events.noteEndUs[index] : UINT64_MAX;
+
+            int ymNote, ymOctave;
+            midi_key_to_ym2163(note, &ymNote, &ymOctave);
+
+            // Choose instrument settings based on mode
+            int useWave, useEnvelope, useVolume;
+            int usePedalMode = g_pedalMode;  // Default to global pedal mode
+
+            if (g_useLiveControl) {
+                // Live Control Mode: use UI settings
+                useWave = g_currentTimbre;
+                useEnvelope = g_currentEnvelope;
+                useVolume = g_currentVolume;
+            } else {
+                // Config Mode: instrument of the channel's program, precomputed
+                // per event at load; synthesized events (seek) resolve here
+                ResolvedInstrument resolved = index >= 0 ? events.instrument[index] :
+                    ResolveInstrument(g_midiPlayer.channelProgram[channel]);
+                useWave = resolved.wave;
+                useEnvelope = resolved.envelope;
+                // Use per-instrument pedal mode if specified (non-zero), otherwise use global
+                if (resolved.pedalMode != 0) {
+                    usePedalMode = resolved.pedalMode;
+                }
+                useVolume = g_currentVolume;
+            }
+
+            // Map velocity to volume if enabled
+            if (g_enableVelocityMapping) {
+                useVolume = map_velocity_to_volume(velocity);
+            }
+
+            // Map pedal mode to envelope if enabled
+            if (usePedalMode == 1) {
+                // Piano Pedal: Fast when pedal down, Decay when pedal up
+                if (g_sustainPedalActive) {
+                    useEnvelope = 1;  // Fast envelope when pedal is down
+                } else {
+                    useEnvelope = 0;  // Decay envelope when pedal is up
+                }
+            } else if (usePedalMode == 2) {
+                // Organ Pedal: Slow when pedal down, Medium when pedal up
+                if (g_sustainPedalActive) {
+                    useEnvelope = 3;  // Slow envelope when pedal is down
+                } else {
+                    useEnvelope = 2;  // Medium envelope when pedal is up
+                }
+            }
+
+            // Arpeggio mode: with every voice busy, share one instead of stealing.
+            // Allocation is then decided while playing (the plan assumes steals).
+            if (g_arp.enabled && !voice_alloc_has_free() && ArpeggioAddNote(channel, note, ymNote, ymOctave)) {
+                int keyIdx = get_key_index(ymOctave, ymNote);
+                if (keyIdx >= 0 && keyIdx < 61) {
+                    g_pianoKeyPressed[keyIdx] = true;
+                    g_pianoKeyVelocity[keyIdx] = velocity;
+                    g_pianoKeyFromKeyboard[keyIdx] = false;
+                }
+                return;
+            }
+
+            // No plan yet while the streaming loader is still decoding the file
+            bool planned = index >= 0 && index < (int)events.voicePlan.size();
+            int ymChannel = (planned && g_useVoicePlan && g_lookAheadSteal && !g_arp.enabled) ?
+                            TakePlannedVoice(index, useWave, useEnvelope, useVolume) :
+                            find_free_channel(useWave, useEnvelope, useVolume);
+            g_channels[ymChannel].midiChannel = channel;
+            g_voiceAlloc.noteEndUs[ymChannel] = noteEndUs;  // Steal key, set before play_note
+            play_note(ymChannel, ymNote, ymOctave, useWave, useEnvelope, useVolume);
+
+            // Update piano key visual with velocity info
+            int keyIdx = get_key_index(ymOctave, ymNote);
+            if (keyIdx >= 0 && keyIdx < 61) {
+                g_pianoKeyPressed[keyIdx] = true;
+                g_pianoKeyVelocity[keyIdx] = velocity;  // Store velocity
+                g_pianoKeyFromKeyboard[keyIdx] = false;  // MIDI source, not keyboard
+            }
+
+            g_noteTable.link(channel, note, ymChannel);
+        }  // End of melody channel handling
+    } else if (event.type == PEV_NOTE_OFF) {
+        // Note off (including note-on with velocity 0)
+        int channel = event.channel;
+        int note = event.data1;
+
+        int ymChannel = g_noteTable.oldest(channel, note);
+        if (ymChannel >= 0) {
+
+            // Clear piano key visual
+            if (g_channels[ymChannel].active) {
+                int keyIdx = get_key_index(g_channels[ymChannel].octave, g_channels[ymChannel].note);
+                if (keyIdx >= 0 && keyIdx < 61) {
+                    g_pianoKeyPressed[keyIdx] = false;
+                    g_pianoKeyVelocity[keyIdx] = 0;  // Clear velocity
+                }
+            }
+
+            // A shared voice passes to its next note instead of stopping
+            if (!ArpeggioHandOver(ymChannel)) {
+                stop_note(ymChannel);  // Also unlinks it from the note table
+            }
+        } else if (ArpeggioRelease(channel, note)) {
+            int ymNote, ymOctave;
+            midi_key_to_ym2163(note, &ymNote, &ymOctave);
+            int keyIdx = get_key_index(ymOctave, ymNote);
+            if (keyIdx >= 0 && keyIdx < 61) {
+                g_pianoKeyPressed[keyIdx] = false;
+                g_pianoKeyVelocity[keyIdx] = 0;
+            }
+        }
+    } else if (event.type == PEV_CONTROLLER) {
+        // Handle MIDI Control Change messages
+        int controller = event.data1;
+        int value = event.data2;
+
+        // CC64: Sustain Pedal
+        if (controller == 64 && g_pedalMode > 0) {
+            g_sustainPedalActive = (value >= 64);
+        }
+
+        // CC0/CC32: Bank Select MSB/LSB
+        int channel = event.channel;
+        if (controller == 0) {
+            g_midiPlayer.channelBank[channel] = (value << 7) | (g_midiPlayer.channelBank[channel] & 0x7F);
+        } else if (controller == 32) {
+            g_midiPlayer.channelBank[channel] = (g_midiPlayer.channelBank[channel] & ~0x7F) | value;
+        }
+    } else if (event.type == PEV_PROGRAM) {
+        g_midiPlayer.channelProgram[event.channel] = event.data1;
+    }
 }
 
-// Rebuild active notes state after seeking
-void RebuildActiveNotesAfterSeek(int targetTick) {
+void UpdateMIDIPlayback() {
+    if (!g_midiPlayer.isPlaying || g_midiPlayer.isPaused || g_midiPlayer.trackFinished) return;
     if (g_midiPlayer.currentFileName.empty()) return;
-    if (g_midiPlayer.midiFile.getEventCount(0) == 0) return;
 
-    // Track which notes are on at the target tick by scanning backwards
-    std::map<int, std::map<int, bool>> notesOn;  // channel -> note -> isOn
+    // High-precision timer (yasp-style optimization)
+    // Use QueryPerformanceCounter for more accurate timing than chrono
+    LARGE_INTEGER currentCounter;
+    QueryPerformanceCounter(&currentCounter);
 
-    MidiEventList& track = g_midiPlayer.midiFile[0];
+    double deltaTime = (double)(currentCounter.QuadPart - g_midiPlayer.lastPerfCounter.QuadPart) /
+                       (double)g_midiPlayer.perfCounterFreq.QuadPart * 1000000.0;  // Convert to microseconds
+    g_midiPlayer.lastPerfCounter = currentCounter;
 
-    // Scan all events up to targetTick to find which notes should be playing
-    for (int i = 0; i < track.size() && i < targetTick; i++) {
-        MidiEvent& event = track[i];
+    // Song position; event times already include every tempo change
+    g_midiPlayer.accumulatedTime += deltaTime;
+
+    // Process all events due by now
+    PlaybackEvents& events = g_midiPlayer.events;
+    int eventCount = events.size();
+
+    while (g_midiPlayer.currentTick < eventCount) {
+        int index = g_midiPlayer.currentTick;
+        if ((double)events.timeUs[index] > g_midiPlayer.accumulatedTime) {
+            break;  // Haven't reached this event yet
+        }
 
-        if (event.isNoteOn()) {
-            int channel = event.getChannel();
-            int note = event.getKeyNumber();
-            int velocity = event.getVelocity();
+        // Process this event
+        if (events.message[index].type == PEV_TEMPO) {
+            // Timing comes from the tempo map; keep the current tempo for display
+            g_midiPlayer.tempo = GetMIDITempoAt(index);
+        } else {
+            ProcessMIDIEvent(events.message[index], index);
+        }
 
-            if (channel == 9) continue;  // Skip drum channel
+        g_midiPlayer.currentTick++;
+    }
 
-            if (velocity > 0) {
-                notesOn[channel][note] = true;
-            } else {
-                notesOn[channel][note] = false;
+    // Send every register write produced by this tick in one transfer
+    spfm_flush();
+
+    // Check if playback finished; chip reset and loading the next file happen on
+    // the UI thread (HandlePlaybackFinished), not in the sequencer
+    if (g_midiPlayer.currentTick >= eventCount) {
+        if (!g_midiPlayer.loading) {
+            g_midiPlayer.trackFinished = true;
+        } else {
+            // Caught up with the streaming loader: song time waits at the last
+            // decoded event (at the target while a restream has published
+            // nothing) so the next batch is not played all at once
+            double waitUs = eventCount > 0 ? GetMIDIEventMicros(eventCount - 1) :
+                                             std::max(g_streamLoader.skipUs, 0.0);
+            if (g_midiPlayer.accumulatedTime > waitUs) g_midiPlayer.accumulatedTime = waitUs;
+        }
+    }
+}
+
+// Microseconds until the next MIDI event is due (SEQ_IDLE_US when nothing is playing)
+double GetMIDIMicrosUntilNextEvent() {
+    if (!g_midiPlayer.isPlaying || g_midiPlayer.isPaused || g_midiPlayer.trackFinished) return SEQ_IDLE_US;
+    if (g_midiPlayer.currentFileName.empty()) return SEQ_IDLE_US;
+
+    if (g_midiPlayer.currentTick >= g_midiPlayer.events.size()) {
+        return g_midiPlayer.loading ? SEQ_IDLE_US : 0.0;  // Waiting for the streaming loader
+    }
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    double sinceUpdateUs = (double)(now.QuadPart - g_midiPlayer.lastPerfCounter.QuadPart) /
+                           (double)g_midiPlayer.perfCounterFreq.QuadPart * 1000000.0;
+    double dueUs = GetMIDIEventMicros(g_midiPlayer.currentTick);
+    return dueUs - (g_midiPlayer.accumulatedTime + sinceUpdateUs);
+}
+
+// ===== Register Stream Compiler / Player =====
+// CompileMIDIToRegisterStream() runs the loaded song through ProcessMIDIEvent()
+// on a virtual clock and saves every register write with its time. Playing the
+// compiled file is then just memory-mapped records sent to the SPFM queue when
+// due: no octave folding, instrument lookup, velocity mapping or voice
+// allocation at play time, and the same file always produces the same writes.
+
+// "song.mid" -> "song.ym2163s"
+std::string GetRegisterStreamPath(const std::string& midiPath) {
+    size_t slash = midiPath.find_last_of("\\/");
+    size_t dot = midiPath.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return midiPath + ".ym2163s";
+    }
+    return midiPath.substr(0, dot) + ".ym2163s";
+}
+
+// Run the song through the live allocator and register shadow into capture. The
+// engine state is borrowed, so this holds the engine lock throughout; playback
+// is stopped, so no event waits for it.
+static bool CaptureRegisterStream(RegStreamCapture& capture) {
+    std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+    if (g_midiPlayer.currentFileName.empty() || g_midiPlayer.events.size() == 0) {
+        log_command("ERROR: No MIDI file loaded to compile");
+        return false;
+    }
+    if (g_midiPlayer.isPlaying) {
+        log_command("ERROR: Stop playback before compiling");
+        return false;
+    }
+    if (g_midiPlayer.loading) {
+        log_command("ERROR: MIDI file is still loading");
+        return false;
+    }
+    if (g_streamLoader.windowed) {
+        log_command("ERROR: Bounded memory playback does not keep the whole song to compile");
+        return false;
+    }
+
+    PlaybackEvents& events = g_midiPlayer.events;  // Times set at load (tempo map)
+
+    // The compile drives the real allocator and register shadow; keep the live state
+    ChannelState savedChannels[16];
+    memcpy(savedChannels, g_channels, sizeof(g_channels));
+    RegisterShadow savedShadow = g_regShadow;
+    int savedDrumChip = g_currentDrumChip;
+    bool savedSustain = g_sustainPedalActive;
+    bool savedKeyPressed[61];
+    int savedKeyVelocity[61];
+    bool savedKeyFromKeyboard[61];
+    memcpy(savedKeyPressed, g_pianoKeyPressed, sizeof(savedKeyPressed));
+    memcpy(savedKeyVelocity, g_pianoKeyVelocity, sizeof(savedKeyVelocity));
+    memcpy(savedKeyFromKeyboard, g_pianoKeyFromKeyboard, sizeof(savedKeyFromKeyboard));
+    bool savedDrumActive[4][5];
+    std::chrono::steady_clock::time_point savedDrumTriggerTime[4][5];
+    memcpy(savedDrumActive, g_drumActive, sizeof(savedDrumActive));
+    std::copy(&g_drumTriggerTime[0][0], &g_drumTriggerTime[0][0] + 4 * 5, &savedDrumTriggerTime[0][0]);
+
+    capture.records.reserve(events.size() * 4);
+    capture.nowUs = 0;
+    capture.lastUs = 0;
+
+    auto clockBase = std::chrono::steady_clock::now();
+    g_virtualClockActive = true;
+    g_virtualClockNow = clockBase;
+    g_regStreamCapture = &capture;
+
+    // Same starting point as PlayMIDI() after a chip reset
+    invalidate_all_register_shadows();
+    InitializeAllChannels();
+    g_noteTable.clear();
+    g_sustainPedalActive = false;
+    g_currentDrumChip = 0;
+    ArpeggioReset();
+
+    int startIndex = 0;
+    uint64_t originUs = 0;
+    if (g_enableAutoSkipSilence) {
+        int firstNoteIndex = FindFirstNoteEvent();
+        if (firstNoteIndex > 0) {
+            // Controllers and programs before the first note still apply; notes are
+            // skipped, as in PlayMIDI()
+            for (int i = 0; i < firstNoteIndex; i++) {
+                int type = events.message[i].type;
+                if (type == PEV_CONTROLLER || type == PEV_PROGRAM) ProcessMIDIEvent(events.message[i]);
             }
-        } else if (event.isNoteOff()) {
-            int channel = event.getChannel();
-            int note = event.getKeyNumber();
-            notesOn[channel][note] = false;
-        }
-    }
-
-    // Now replay all notes that should be active at this point
-    for (auto& channelPair : notesOn) {
-        int channel = channelPair.first;
-        for (auto& notePair : channelPair.second) {
-            int note = notePair.first;
-            bool isOn = notePair.second;
-
-            if (isOn) {
-                // This note should be playing - start it
-                int ymChannel = find_free_channel();
-                if (ymChannel >= 0) {
-                    // Map MIDI note to YM2163 note/octave
-                    int ymNote = note % 12;
-                    int ymOctave = (note / 12) - 2;
-
-                    // Auto-adjust octave if out of range
-                    while (ymOctave < 0 || (ymOctave == 0 && ymNote < 11)) {
-                        ymOctave++;
-                    }
-                    while (ymOctave > 5 || (ymOctave == 5 && ymNote > 11)) {
-                        ymOctave--;
-                    }
+            startIndex = firstNoteIndex;
+            originUs = events.timeUs[firstNoteIndex];
+        }
+    }
 
-                    // Choose instrument settings based on mode
-                    int useWave, useEnvelope, useVolume;
-                    if (g_useLiveControl) {
-                        useWave = g_currentTimbre;
-                        useEnvelope = g_currentEnvelope;
-                        useVolume = g_currentVolume;
-                    } else {
-                        int program = 0;
-                        if (g_instrumentConfigs.count(program) > 0) {
-                            InstrumentConfig& config = g_instrumentConfigs[program];
-                            useWave = config.wave;
-                            useEnvelope = config.envelope;
-                        } else {
-                            useWave = 4;
-                            useEnvelope = 0;
-                        }
-                        useVolume = g_currentVolume;
-                    }
+    for (int i = startIndex; i < events.size(); i++) {
+        if (events.message[i].type == PEV_TEMPO) continue;  // Already folded into event times
+
+        // Arpeggio rotation steps due before this event, on the song clock
+        uint64_t eventUs = events.timeUs[i] - originUs;
+        for (uint64_t stepUs = ArpeggioNextStepUs(); stepUs < eventUs; stepUs = ArpeggioNextStepUs()) {
+            capture.nowUs = std::max(stepUs, capture.nowUs);
+            g_virtualClockNow = clockBase + std::chrono::microseconds(capture.nowUs);
+            ArpeggioUpdate(capture.nowUs);
+        }
+
+        capture.nowUs = eventUs;
+        g_virtualClockNow = clockBase + std::chrono::microseconds(capture.nowUs);
+        ProcessMIDIEvent(events.message[i], i);
+    }
+    // End silent, as StopMIDI() would
+    stop_all_notes();
+
+    g_regStreamCapture = nullptr;
+    g_virtualClockActive = false;
+    ArpeggioReset();  // Next update restarts the rotation on the real clock
+
+    memcpy(g_channels, savedChannels, sizeof(g_channels));
+    voice_alloc_rebuild();
+    g_regShadow = savedShadow;
+    g_currentDrumChip = savedDrumChip;
+    g_sustainPedalActive = savedSustain;
+    memcpy(g_pianoKeyPressed, savedKeyPressed, sizeof(savedKeyPressed));
+    memcpy(g_pianoKeyVelocity, savedKeyVelocity, sizeof(savedKeyVelocity));
+    memcpy(g_pianoKeyFromKeyboard, savedKeyFromKeyboard, sizeof(savedKeyFromKeyboard));
+    memcpy(g_drumActive, savedDrumActive, sizeof(savedDrumActive));
+    std::copy(&savedDrumTriggerTime[0][0], &savedDrumTriggerTime[0][0] + 4 * 5, &g_drumTriggerTime[0][0]);
+    g_noteTable.clear();
+    return true;
+}
+
+// Compile the loaded song; the file is written after the engine lock is released
+bool CompileMIDIToRegisterStream(const char* outPath) {
+    RegStreamCapture capture;
+    if (!CaptureRegisterStream(capture)) return false;
+    uint64_t durationUs = capture.nowUs;
+
+    if (durationUs > 0xFFFFFFFFULL) {
+        // A single delta can never exceed the whole song, but keep the format honest
+        log_command("ERROR: Song too long for register stream (%.0f s)", durationUs / 1000000.0);
+        return false;
+    }
+
+    RegStreamHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, REG_STREAM_MAGIC, 8);
+    header.version = REG_STREAM_VERSION;
+    header.recordCount = (uint32_t)capture.records.size();
+    header.durationUs = durationUs;
+    header.chipMask = 0x01 | (g_enableSecondYM2163 ? 0x02 : 0) |
+                      (g_enableThirdYM2163 ? 0x04 : 0) | (g_enableFourthYM2163 ? 0x08 : 0);
+
+    FILE* file = _wfopen(UTF8ToWide(outPath).c_str(), L"wb");
+    if (!file) {
+        log_command("ERROR: Cannot create %s", outPath);
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if (ok && !capture.records.empty()) {
+        ok = fwrite(capture.records.data(), sizeof(RegStreamRecord), capture.records.size(), file) ==
+             capture.records.size();
+    }
+    ok = (fclose(file) == 0) && ok;
+    if (!ok) {
+        log_command("ERROR: Failed writing %s", outPath);
+        return false;
+    }
+
+    log_command("=== Register Stream Compiled ===");
+    log_command("File: %s", outPath);
+    log_command("Register writes: %u  Duration: %s  Size: %.1f KB",
+                header.recordCount, FormatTime((double)durationUs).c_str(),
+                (sizeof(header) + capture.records.size() * sizeof(RegStreamRecord)) / 1024.0);
+    return true;
+}
 
-                    // Use default velocity for seek (no velocity mapping)
-                    int defaultVelocity = 96;  // Default velocity for seek
-                    if (g_enableVelocityMapping) {
-                        useVolume = map_velocity_to_volume(defaultVelocity);
-                    }
+struct RegStreamPlayer {
+    bool active;
+    std::string path;
+    HANDLE file;
+    HANDLE mapping;
+    const uint8_t* view;
+    size_t viewSize;
+    const RegStreamHeader* header;
+    const RegStreamRecord* records;
+    uint32_t count;
+    uint32_t index;          // Next record to send
+    uint64_t nextUs;         // Absolute time of records[index]
+    LARGE_INTEGER startCounter;
+    bool finished;           // Last record sent; StopRegisterStream() runs on the UI thread
+
+    RegStreamPlayer() : active(false), file(INVALID_HANDLE_VALUE), mapping(NULL),
+                        view(nullptr), viewSize(0), header(nullptr), records(nullptr),
+                        count(0), index(0), nextUs(0), finished(false) {}
+};
 
-                    g_channels[ymChannel].midiChannel = channel;
-                    play_note(ymChannel, ymNote, ymOctave, useWave, useEnvelope, useVolume);
+static RegStreamPlayer g_regStreamPlayer;
+
+static void UnmapRegisterStream() {
+    if (g_regStreamPlayer.view) UnmapViewOfFile(g_regStreamPlayer.view);
+    if (g_regStreamPlayer.mapping) CloseHandle(g_regStreamPlayer.mapping);
+    if (g_regStreamPlayer.file != INVALID_HANDLE_VALUE) CloseHandle(g_regStreamPlayer.file);
+    g_regStreamPlayer.mapping = NULL;
+    g_regStreamPlayer.file = INVALID_HANDLE_VALUE;
+    g_regStreamPlayer.view = nullptr;
+    g_regStreamPlayer.viewSize = 0;
+    g_regStreamPlayer.header = nullptr;
+    g_regStreamPlayer.records = nullptr;
+}
 
-                    // Update piano key visual with velocity info
-                    int keyIdx = get_key_index(ymOctave, ymNote);
-                    if (keyIdx >= 0 && keyIdx < 61) {
-                        g_pianoKeyPressed[keyIdx] = true;
-                        g_pianoKeyVelocity[keyIdx] = defaultVelocity;  // Store default velocity for seek
-                    }
+static bool MapRegisterStream(const char* path) {
+    g_regStreamPlayer.file = CreateFileW(UTF8ToWide(path).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                                         OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (g_regStreamPlayer.file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(g_regStreamPlayer.file, &size) || size.QuadPart == 0) return false;
+    g_regStreamPlayer.mapping = CreateFileMappingW(g_regStreamPlayer.file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!g_regStreamPlayer.mapping) return false;
+    g_regStreamPlayer.view = (const uint8_t*)MapViewOfFile(g_regStreamPlayer.mapping, FILE_MAP_READ, 0, 0, 0);
+    g_regStreamPlayer.viewSize = (size_t)size.QuadPart;
+    return g_regStreamPlayer.view != nullptr;
+}
 
-                    g_midiPlayer.activeNotes[channel][note] = ymChannel;
-                }
-            }
-        }
+void StopRegisterStream() {
+    {
+        std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+        if (!g_regStreamPlayer.active) return;
+        g_regStreamPlayer.active = false;
+
+        // The stream bypassed the register shadow, so it no longer matches the chips
+        invalidate_all_register_shadows();
     }
+    UnmapRegisterStream();  // The sequencer only reads records while active
+
+    ResetAllYM2163Chips();
+    std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+    InitializeAllChannels();
+    log_command("Register stream stopped");
 }
 
-void UpdateMIDIPlayback() {
-    if (!g_midiPlayer.isPlaying || g_midiPlayer.isPaused) return;
-    if (g_midiPlayer.currentFileName.empty()) return;
+// UI thread; the file is mapped and checked before the sequencer sees it, so the
+// engine lock is only needed to start playing
+bool PlayRegisterStream(const char* path) {
+    StopRegisterStream();
+    if (g_midiPlayer.isPlaying) StopMIDI();  // Only the UI thread starts and stops playback
 
-    // High-precision timer (yasp-style optimization)
-    // Use QueryPerformanceCounter for more accurate timing than chrono
-    LARGE_INTEGER currentCounter;
-    QueryPerformanceCounter(&currentCounter);
+    if (!MapRegisterStream(path)) {
+        log_command("ERROR: Cannot map register stream %s", path);
+        UnmapRegisterStream();
+        return false;
+    }
 
-    double deltaTime = (double)(currentCounter.QuadPart - g_midiPlayer.lastPerfCounter.QuadPart) /
-                       (double)g_midiPlayer.perfCounterFreq.QuadPart * 1000000.0;  // Convert to microseconds
-    g_midiPlayer.lastPerfCounter = currentCounter;
+    const RegStreamHeader* header = (const RegStreamHeader*)g_regStreamPlayer.view;
+    if (g_regStreamPlayer.viewSize < sizeof(RegStreamHeader) ||
+        memcmp(header->magic, REG_STREAM_MAGIC, 8) != 0 ||
+        header->version != REG_STREAM_VERSION ||
+        (g_regStreamPlayer.viewSize - sizeof(RegStreamHeader)) / sizeof(RegStreamRecord) < header->recordCount) {
+        log_command("ERROR: %s is not a valid register stream", path);
+        UnmapRegisterStream();
+        return false;
+    }
 
-    // Accumulate time for precise tick calculation
-    g_midiPlayer.accumulatedTime += deltaTime;
+    uint32_t enabledMask = 0x01 | (g_enableSecondYM2163 ? 0x02 : 0) |
+                           (g_enableThirdYM2163 ? 0x04 : 0) | (g_enableFourthYM2163 ? 0x08 : 0);
+    if (header->chipMask & ~enabledMask) {
+        log_command("WARNING: Stream was compiled for slot mask 0x%X, enabled slots are 0x%X",
+                    header->chipMask, enabledMask);
+    }
 
-    // Calculate current tick based on accumulated time
-    double ticksPerMicrosecond = (double)g_midiPlayer.ticksPerQuarterNote / g_midiPlayer.tempo;
-    int targetTick = (int)(g_midiPlayer.accumulatedTime * ticksPerMicrosecond);
+    g_regStreamPlayer.path = path;
+    g_regStreamPlayer.header = header;
+    g_regStreamPlayer.records = (const RegStreamRecord*)(g_regStreamPlayer.view + sizeof(RegStreamHeader));
+    g_regStreamPlayer.count = header->recordCount;
+    g_regStreamPlayer.index = 0;
+    g_regStreamPlayer.nextUs = g_regStreamPlayer.count > 0 ? g_regStreamPlayer.records[0].deltaUs : 0;
 
-    // Process all events up to current tick
-    MidiEventList& track = g_midiPlayer.midiFile[0];
+    // Stream assumes freshly reset chips, same as the compile
+    ResetAllYM2163Chips();
+    std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+    InitializeAllChannels();
 
-    while (g_midiPlayer.currentTick < track.size()) {
-        MidiEvent& event = track[g_midiPlayer.currentTick];
+    QueryPerformanceCounter(&g_regStreamPlayer.startCounter);
+    g_regStreamPlayer.finished = false;
+    g_regStreamPlayer.active = true;
+    sequencer_wake();
+    log_command("Playing register stream: %s (%u writes, %s)", path, g_regStreamPlayer.count,
+                FormatTime((double)header->durationUs).c_str());
+    return true;
+}
 
-        if (event.tick > targetTick) {
-            break;  // Haven't reached this event yet
-        }
+void UpdateRegisterStreamPlayback() {
+    if (!g_regStreamPlayer.active || g_regStreamPlayer.finished) return;
 
-        // Process this event
-        if (event.isNoteOn()) {
-            int channel = event.getChannel();
-            int note = event.getKeyNumber();
-            int velocity = event.getVelocity();
-
-            if (velocity > 0) {
-                // Check if this is a drum channel (MIDI channel 10 = index 9)
-                if (channel == 9) {
-                    // Drum event - map MIDI drum note to YM2163 drum
-                    if (g_drumConfigs.count(note) > 0) {
-                        DrumConfig& drumConfig = g_drumConfigs[note];
-                        // Trigger all mapped drums
-                        uint8_t drumBits = 0;
-                        for (uint8_t bit : drumConfig.drumBits) {
-                            drumBits |= bit;
-                        }
-                        play_drum(drumBits);
-                    }
-                } else {
-                    // Note on - melody channel
-                    int ymChannel = find_free_channel();
-                    if (ymChannel >= 0) {
-                    // Map MIDI note to YM2163 note/octave (降低一个八度)
-                    int ymNote = note % 12;
-                    int ymOctave = (note / 12) - 2;  // MIDI octave starts at C-1, 降低一个八度
-
-                    // Auto-adjust octave if out of range (B2-B7)
-                    while (ymOctave < 0 || (ymOctave == 0 && ymNote < 11)) {
-                        ymOctave++;  // Move up one octave
-                    }
-                    while (ymOctave > 5 || (ymOctave == 5 && ymNote > 11)) {
-                        ymOctave--;  // Move down one octave
-                    }
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    uint64_t elapsedUs = (uint64_t)((now.QuadPart - g_regStreamPlayer.startCounter.QuadPart) * 1000000 /
+                                    g_midiPlayer.perfCounterFreq.QuadPart);
 
-                    // Choose instrument settings based on mode
-                    int useWave, useEnvelope, useVolume;
-                    int usePedalMode = g_pedalMode;  // Default to global pedal mode
+    const RegStreamRecord* records = g_regStreamPlayer.records;
+    uint32_t index = g_regStreamPlayer.index;
+    uint64_t nextUs = g_regStreamPlayer.nextUs;
+    while (index < g_regStreamPlayer.count && nextUs <= elapsedUs) {
+        write_melody_cmd_chip(records[index].reg, records[index].slot);
+        write_melody_cmd_chip(records[index].data, records[index].slot);
+        index++;
+        if (index < g_regStreamPlayer.count) nextUs += records[index].deltaUs;
+    }
+    g_regStreamPlayer.index = index;
+    g_regStreamPlayer.nextUs = nextUs;
+    spfm_flush();
 
-                    if (g_useLiveControl) {
-                        // Live Control Mode: use UI settings
-                        useWave = g_currentTimbre;
-                        useEnvelope = g_currentEnvelope;
-                        useVolume = g_currentVolume;
-                    } else {
-                        // Config Mode: use instrument config from MIDI program
-                        int program = 0;  // TODO: Track program changes per channel
-                        if (g_instrumentConfigs.count(program) > 0) {
-                            InstrumentConfig& config = g_instrumentConfigs[program];
-                            useWave = config.wave;
-                            useEnvelope = config.envelope;
-                            // Use per-instrument pedal mode if specified (non-zero), otherwise use global
-                            if (config.pedalMode != 0) {
-                                usePedalMode = config.pedalMode;
-                            }
-                        } else {
-                            // Fallback to default (Piano with Decay)
-                            useWave = 4;
-                            useEnvelope = 0;
-                        }
-                        useVolume = g_currentVolume;
-                    }
+    if (index >= g_regStreamPlayer.count) {
+        g_regStreamPlayer.finished = true;
+    }
+}
 
-                    // Map velocity to volume if enabled
-                    if (g_enableVelocityMapping) {
-                        useVolume = map_velocity_to_volume(velocity);
-                    }
+// Microseconds until the next stream record is due (SEQ_IDLE_US when idle)
+double GetStreamMicrosUntilNextRecord() {
+    if (!g_regStreamPlayer.active || g_regStreamPlayer.finished) return SEQ_IDLE_US;
 
-                    // Map pedal mode to envelope if enabled
-                    if (usePedalMode == 1) {
-                        // Piano Pedal: Fast when pedal down, Decay when pedal up
-                        if (g_sustainPedalActive) {
-                            useEnvelope = 1;  // Fast envelope when pedal is down
-                        } else {
-                            useEnvelope = 0;  // Decay envelope when pedal is up
-                        }
-                    } else if (usePedalMode == 2) {
-                        // Organ Pedal: Slow when pedal down, Medium when pedal up
-                        if (g_sustainPedalActive) {
-                            useEnvelope = 3;  // Slow envelope when pedal is down
-                        } else {
-                            useEnvelope = 2;  // Medium envelope when pedal is up
-                        }
-                    }
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    double elapsedUs = (double)(now.QuadPart - g_regStreamPlayer.startCounter.QuadPart) * 1000000.0 /
+                       (double)g_midiPlayer.perfCounterFreq.QuadPart;
+    return (double)g_regStreamPlayer.nextUs - elapsedUs;
+}
 
-                    g_channels[ymChannel].midiChannel = channel;
-                    play_note(ymChannel, ymNote, ymOctave, useWave, useEnvelope, useVolume);
+// UI thread: finish whatever the sequencer reported as done
+void HandlePlaybackFinished() {
+    bool trackFinished, streamFinished;
+    {
+        std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+        trackFinished = g_midiPlayer.trackFinished;
+        streamFinished = g_regStreamPlayer.active && g_regStreamPlayer.finished;
+    }
+    if (trackFinished) {
+        StopMIDI();
+        log_command("MIDI playback finished");
 
-                    // Update piano key visual with velocity info
-                    int keyIdx = get_key_index(ymOctave, ymNote);
-                    if (keyIdx >= 0 && keyIdx < 61) {
-                        g_pianoKeyPressed[keyIdx] = true;
-                        g_pianoKeyVelocity[keyIdx] = velocity;  // Store velocity
-                        g_pianoKeyFromKeyboard[keyIdx] = false;  // MIDI source, not keyboard
-                    }
+        // Auto-play next track if enabled
+        if (g_autoPlayNext) {
+            PlayNextMIDI();
+        }
+    }
+    if (streamFinished) {
+        log_command("Register stream finished");
+        StopRegisterStream();
+    }
+}
 
-                    g_midiPlayer.activeNotes[channel][note] = ymChannel;
-                }
-                }  // End of melody channel handling
-            } else {
-                // Note off (velocity 0)
-                if (g_midiPlayer.activeNotes[channel].count(note) > 0) {
-                    int ymChannel = g_midiPlayer.activeNotes[channel][note];
-
-                    // Clear piano key visual
-                    if (g_channels[ymChannel].active) {
-                        int keyIdx = get_key_index(g_channels[ymChannel].octave, g_channels[ymChannel].note);
-                        if (keyIdx >= 0 && keyIdx < 61) {
-                            g_pianoKeyPressed[keyIdx] = false;
-                            g_pianoKeyVelocity[keyIdx] = 0;  // Clear velocity
-                        }
-                    }
+// ===== Sequencer Thread =====
+// Sleeps until the next event deadline on a high-resolution waitable timer, then
+// spins the last SEQ_SPIN_US on QueryPerformanceCounter so events go out within
+// microseconds of their time instead of on the next rendered frame.
 
-                    stop_note(ymChannel);
-                    g_midiPlayer.activeNotes[channel].erase(note);
-                }
-            }
-        } else if (event.isNoteOff()) {
-            int channel = event.getChannel();
-            int note = event.getKeyNumber();
+static LONGLONG qpc_now() {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
 
-            if (g_midiPlayer.activeNotes[channel].count(note) > 0) {
-                int ymChannel = g_midiPlayer.activeNotes[channel][note];
+// Wait until the QPC deadline or until sequencer_wake(); returns false if woken early
+static bool sequencer_wait_until(LONGLONG deadline) {
+    double freq = (double)g_midiPlayer.perfCounterFreq.QuadPart;
+    double spinUs = g_sequencer.highResTimer ? SEQ_SPIN_US : SEQ_SPIN_US_LOWRES;
+    double remainingUs = (double)(deadline - qpc_now()) * 1000000.0 / freq;
+
+    if (remainingUs > spinUs) {
+        LARGE_INTEGER due;
+        due.QuadPart = -(LONGLONG)((remainingUs - spinUs) * 10.0);  // Relative, 100 ns units
+        SetWaitableTimer(g_sequencer.timer, &due, 0, NULL, NULL, FALSE);
+        HANDLE handles[2] = { g_sequencer.timer, g_sequencer.wakeEvent };
+        if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_OBJECT_0 + 1) {
+            return false;
+        }
+    }
 
-                // Clear piano key visual
-                if (g_channels[ymChannel].active) {
-                    int keyIdx = get_key_index(g_channels[ymChannel].octave, g_channels[ymChannel].note);
-                    if (keyIdx >= 0 && keyIdx < 61) {
-                        g_pianoKeyPressed[keyIdx] = false;
-                    }
-                }
+    while (qpc_now() < deadline) {
+        YieldProcessor();
+    }
+    return true;
+}
 
-                stop_note(ymChannel);
-                g_midiPlayer.activeNotes[channel].erase(note);
-            }
-        } else if (event.isTempo()) {
-            // Get tempo in microseconds per quarter note
-            g_midiPlayer.tempo = event.getTempoMicroseconds();
-            // Recalculate accumulated time based on current tick
-            g_midiPlayer.accumulatedTime = (double)g_midiPlayer.currentTick * g_midiPlayer.tempo / g_midiPlayer.ticksPerQuarterNote;
-        } else if (event.isController()) {
-            // Handle MIDI Control Change messages
-            int controller = event[1];
-            int value = event[2];
-
-            // CC64: Sustain Pedal
-            if (controller == 64 && g_pedalMode > 0) {
-                g_sustainPedalActive = (value >= 64);
+void sequencer_thread() {
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+    double freq = (double)g_midiPlayer.perfCounterFreq.QuadPart;
+
+    while (g_sequencer.running) {
+        double waitUs;
+        {
+            std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+            UpdateMIDIPlayback();
+            UpdateRegisterStreamPlayback();
+            uint64_t nowUs = spfm_now_us();
+            ArpeggioUpdate(nowUs);
+            waitUs = std::min(GetMIDIMicrosUntilNextEvent(), GetStreamMicrosUntilNextRecord());
+            uint64_t arpStepUs = ArpeggioNextStepUs();
+            if (arpStepUs != UINT64_MAX) {
+                waitUs = std::min(waitUs, arpStepUs > nowUs ? (double)(arpStepUs - nowUs) : 0.0);
             }
         }
-
-        g_midiPlayer.currentTick++;
+        if (waitUs <= 0.0) continue;
+
+        // Idle or far-off events: re-check periodically (tempo changes, UI edits)
+        bool eventDeadline = waitUs < SEQ_IDLE_US;
+        if (!eventDeadline) waitUs = SEQ_IDLE_US;
+
+        LONGLONG deadline = qpc_now() + (LONGLONG)(waitUs * freq / 1000000.0);
+        if (sequencer_wait_until(deadline) && eventDeadline) {
+            uint64_t lateUs = (uint64_t)((double)(qpc_now() - deadline) * 1000000.0 / freq);
+            g_sequencer.deadlines++;
+            g_sequencer.lateSumUs += lateUs;
+            if (lateUs > g_sequencer.lateMaxUs) g_sequencer.lateMaxUs = lateUs;
+        }
     }
+}
 
-    // Check if playback finished
-    if (g_midiPlayer.currentTick >= track.size()) {
-        StopMIDI();
-        log_command("MIDI playback finished");
+void sequencer_wake() {
+    if (g_sequencer.wakeEvent) SetEvent(g_sequencer.wakeEvent);
+}
 
-        // Auto-play next track if enabled
-        if (g_autoPlayNext) {
-            PlayNextMIDI();
-        }
+void sequencer_start() {
+    if (g_sequencer.running) return;
+
+    // 0.5 ms resolution timer on Windows 10 1803+, otherwise a 1 ms timer with timeBeginPeriod
+    g_sequencer.timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    g_sequencer.highResTimer = (g_sequencer.timer != NULL);
+    if (!g_sequencer.timer) {
+        timeBeginPeriod(1);
+        g_sequencer.timer = CreateWaitableTimerW(NULL, FALSE, NULL);
     }
+    g_sequencer.wakeEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+
+    g_sequencer.running = true;
+    g_sequencer.thread = std::thread(sequencer_thread);
+    log_command("Sequencer thread started (%s timer)", g_sequencer.highResTimer ? "high-resolution" : "1 ms");
+}
+
+void sequencer_stop() {
+    if (!g_sequencer.running) return;
+    g_sequencer.running = false;
+    sequencer_wake();
+    if (g_sequencer.thread.joinable()) g_sequencer.thread.join();
+
+    if (!g_sequencer.highResTimer) timeEndPeriod(1);
+    CloseHandle(g_sequencer.timer);
+    CloseHandle(g_sequencer.wakeEvent);
+    g_sequencer.timer = NULL;
+    g_sequencer.wakeEvent = NULL;
+}
+
+void sequencer_reset_stats() {
+    g_sequencer.deadlines = 0;
+    g_sequencer.lateSumUs = 0;
+    g_sequencer.lateMaxUs = 0;
 }
 
 // ===== Keyboard Mapping =====
@@ -2398,9 +5151,138 @@ static KeyMapping g_keyMappings[] = {
 
 static const int g_numKeyMappings = sizeof(g_keyMappings) / sizeof(KeyMapping);
 
+// ===== Engine View =====
+// What the UI draws of the engine state, copied once per frame under the engine
+// lock so the frame is built without holding it. UI actions lock only around
+// the state they change.
+
+struct EngineView {
+    ChannelState channels[16];
+    bool drumActive[4][5];
+    std::chrono::steady_clock::time_point drumTriggerTime[4][5];
+    bool keyPressed[61];
+    int keyVelocity[61];
+    bool keyFromKeyboard[61];
+    bool sustainPedalActive;
+
+    // MIDI player
+    std::string fileName;
+    bool isPlaying;
+    bool isPaused;
+    bool loading;
+    int loadPercent;
+    int eventCount;
+    double currentUs;        // Time of the next event (end of song once finished)
+    double totalUs;          // -1 while unknown (bounded memory playback before its scan)
+    bool windowed;
+    int windowEvents;
+    VelocityAnalysis velocity;
+    VoicePlanReport voicePlan;
+
+    // Register stream
+    bool streamActive;
+    uint32_t streamIndex;
+    uint32_t streamCount;
+    uint64_t streamUs;
+    uint64_t streamDurationUs;
+
+    // Bus statistics
+    uint64_t writesRequested[4];
+    uint64_t writesElided[4];
+    uint64_t voiceSteals;
+    uint64_t voiceWritesSaved;
+    int arpSharedVoices;
+    uint64_t arpNotesShared;
+    uint64_t arpSteps;
+    uint64_t arpWrites;
+    uint64_t arpSkipped;
+    uint64_t vgmWrites;
+    uint64_t vgmDropped;
+    uint64_t vgmSamples;
+};
+
+static EngineView g_engineView;
+
+// UI thread, engine lock held
+void PublishEngineView() {
+    EngineView& view = g_engineView;
+    std::copy(g_channels, g_channels + 16, view.channels);
+    memcpy(view.drumActive, g_drumActive, sizeof(view.drumActive));
+    std::copy(&g_drumTriggerTime[0][0], &g_drumTriggerTime[0][0] + 4 * 5, &view.drumTriggerTime[0][0]);
+    memcpy(view.keyPressed, g_pianoKeyPressed, sizeof(view.keyPressed));
+    memcpy(view.keyVelocity, g_pianoKeyVelocity, sizeof(view.keyVelocity));
+    memcpy(view.keyFromKeyboard, g_pianoKeyFromKeyboard, sizeof(view.keyFromKeyboard));
+    view.sustainPedalActive = g_sustainPedalActive;
+
+    view.fileName = g_midiPlayer.currentFileName;
+    view.isPlaying = g_midiPlayer.isPlaying;
+    view.isPaused = g_midiPlayer.isPaused;
+    view.loading = g_midiPlayer.loading;
+    view.loadPercent = g_streamLoader.percent;
+    view.eventCount = g_midiPlayer.events.size();
+    view.totalUs = GetMIDITotalDuration();
+    if (g_midiPlayer.currentTick < view.eventCount) {
+        view.currentUs = GetMIDIEventMicros(g_midiPlayer.currentTick);
+    } else if (g_midiPlayer.loading) {
+        view.currentUs = g_midiPlayer.accumulatedTime;  // Song time waits for the loader
+    } else {
+        view.currentUs = view.totalUs;
+    }
+    view.windowed = g_streamLoader.windowed;
+    view.windowEvents = g_streamLoader.windowEvents;
+    view.velocity = g_velocityAnalysis;
+    view.voicePlan = g_voicePlanReport;
+
+    view.streamActive = g_regStreamPlayer.active;
+    view.streamIndex = g_regStreamPlayer.index;
+    view.streamCount = g_regStreamPlayer.count;
+    view.streamUs = g_regStreamPlayer.nextUs;
+    view.streamDurationUs = g_regStreamPlayer.active ? g_regStreamPlayer.header->durationUs : 0;
+
+    memcpy(view.writesRequested, g_regShadow.writesRequested, sizeof(view.writesRequested));
+    memcpy(view.writesElided, g_regShadow.writesElided, sizeof(view.writesElided));
+    view.voiceSteals = g_voiceAlloc.steals;
+    view.voiceWritesSaved = g_voiceAlloc.writesSaved;
+    view.arpSharedVoices = g_arp.sharedVoices;
+    view.arpNotesShared = g_arp.notesShared;
+    view.arpSteps = g_arp.steps;
+    view.arpWrites = g_arp.writes;
+    view.arpSkipped = g_arp.skipped;
+    view.vgmWrites = g_vgmLogger.writes();
+    view.vgmDropped = g_vgmLogger.dropped();
+    view.vgmSamples = g_vgmLogger.samples();
+}
+
+// Settings the sequencer reads are edited on a copy and stored under the engine
+// lock. The UI thread is their only writer, so it reads them without the lock.
+static bool EngineCheckbox(const char* label, bool* value) {
+    bool edited = *value;
+    if (!ImGui::Checkbox(label, &edited)) return false;
+    std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+    *value = edited;
+    return true;
+}
+
+static bool EngineSliderInt(const char* label, int* value, int minValue, int maxValue) {
+    int edited = *value;
+    if (!ImGui::SliderInt(label, &edited, minValue, maxValue)) return false;
+    std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+    *value = edited;
+    return true;
+}
+
+static bool EngineSliderFloat(const char* label, float* value, float minValue, float maxValue, const char* format) {
+    float edited = *value;
+    if (!ImGui::SliderFloat(label, &edited, minValue, maxValue, format)) return false;
+    std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+    *value = edited;
+    return true;
+}
+
 // ===== ImGui UI Functions =====
 
 void RenderMIDIPlayer() {
+    const EngineView& view = g_engineView;
     ImGui::Text("MIDI Player");
     ImGui::Separator();
 
@@ -2447,9 +5329,9 @@ void RenderMIDIPlayer() {
     ImGui::Spacing();
 
     // Status and current file
-    if (g_midiPlayer.isPlaying && !g_midiPlayer.isPaused) {
+    if (view.isPlaying && !view.isPaused) {
         ImGui::TextColored(ImVec4(0.0f, 1.0f, 0.0f, 1.0f), "Playing:");
-    } else if (g_midiPlayer.isPaused) {
+    } else if (view.isPaused) {
         ImGui::TextColored(ImVec4(1.0f, 1.0f, 0.0f, 1.0f), "Paused:");
     } else {
         ImGui::Text("Ready:");
@@ -2457,10 +5339,10 @@ void RenderMIDIPlayer() {
 
     ImGui::SameLine();
 
-    if (!g_midiPlayer.currentFileName.empty()) {
-        const char* filename = strrchr(g_midiPlayer.currentFileName.c_str(), '\\');
-        if (!filename) filename = strrchr(g_midiPlayer.currentFileName.c_str(), '/');
-        if (!filename) filename = g_midiPlayer.currentFileName.c_str();
+    if (!view.fileName.empty()) {
+        const char* filename = strrchr(view.fileName.c_str(), '\\');
+        if (!filename) filename = strrchr(view.fileName.c_str(), '/');
+        if (!filename) filename = view.fileName.c_str();
         else filename++;
         ImGui::Text("%s", filename);
     } else {
@@ -2468,26 +5350,10 @@ void RenderMIDIPlayer() {
     }
 
     // Progress bar with time display (clickable)
-    if (!g_midiPlayer.currentFileName.empty() && g_midiPlayer.midiFile.getEventCount(0) > 0) {
-        // Calculate current time and total duration based on MIDI ticks
-        MidiEventList& track = g_midiPlayer.midiFile[0];
-
-        // Get current MIDI tick
-        int currentMidiTick = 0;
-        if (g_midiPlayer.currentTick < track.size()) {
-            currentMidiTick = track[g_midiPlayer.currentTick].tick;
-        }
-
-        // Get last MIDI tick (total duration)
-        int lastMidiTick = 0;
-        if (track.size() > 0) {
-            lastMidiTick = track[track.size() - 1].tick;
-        }
-
-        // Convert MIDI ticks to microseconds
-        double microsPerTick = g_midiPlayer.tempo / (double)g_midiPlayer.ticksPerQuarterNote;
-        double currentTimeMicros = (double)currentMidiTick * microsPerTick;
-        double totalTimeMicros = (double)lastMidiTick * microsPerTick;
+    if (!view.fileName.empty() && (view.eventCount > 0 || view.loading)) {
+        // Current time and total duration from the event times (tempo map applied)
+        double totalTimeMicros = view.totalUs;
+        double currentTimeMicros = view.currentUs;
 
         // Calculate progress based on time, not event count
         float progress = (totalTimeMicros > 0) ? (float)(currentTimeMicros / totalTimeMicros) : 0.0f;
@@ -2495,75 +5361,67 @@ void RenderMIDIPlayer() {
 
         // Format time strings
         std::string currentTimeStr = FormatTime(currentTimeMicros);
-        std::string totalTimeStr = FormatTime(totalTimeMicros);
+        std::string totalTimeStr = totalTimeMicros >= 0 ? FormatTime(totalTimeMicros) : "--:--";
 
-        // Display time information above progress bar
-        ImGui::Text("%s / %s", currentTimeStr.c_str(), totalTimeStr.c_str());
+        // Display time information above progress bar (total so far while streaming)
+        if (view.loading) {
+            ImGui::Text("%s / %s (loading %d%%)", currentTimeStr.c_str(), totalTimeStr.c_str(),
+                        view.loadPercent);
+        } else {
+            ImGui::Text("%s / %s", currentTimeStr.c_str(), totalTimeStr.c_str());
+        }
 
         ImVec2 progressPos = ImGui::GetCursorScreenPos();
         ImVec2 progressSize = ImVec2(ImGui::GetContentRegionAvail().x, 20);
 
         ImGui::ProgressBar(progress, progressSize, "");
 
-        // Handle progress bar click to seek
-        if (ImGui::IsItemHovered() && ImGui::IsMouseClicked(0)) {
+        // Handle progress bar click to seek (once the song length is known)
+        if (totalTimeMicros > 0 && ImGui::IsItemHovered() && ImGui::IsMouseClicked(0)) {
             ImVec2 mousePos = ImGui::GetMousePos();
             float clickPos = (mousePos.x - progressPos.x) / progressSize.x;
             clickPos = clickPos < 0.0f ? 0.0f : (clickPos > 1.0f ? 1.0f : clickPos);
 
-            // Calculate target MIDI tick based on time
-            int targetMidiTick = (int)(clickPos * lastMidiTick);
-
-            // Find the event index that corresponds to this MIDI tick
-            int targetEventIndex = 0;
-            for (int i = 0; i < (int)track.size(); i++) {
-                if (track[i].tick >= targetMidiTick) {
-                    targetEventIndex = i;
-                    break;
-                }
-            }
-
-            g_midiPlayer.currentTick = targetEventIndex;
-
-            // Remember if we were playing before seek
-            bool wasPlaying = g_midiPlayer.isPlaying && !g_midiPlayer.isPaused;
-
-            // Stop all currently playing notes before seek
-            stop_all_notes();
-            g_midiPlayer.activeNotes.clear();
-            ResetPianoKeyStates();
-
-            // Reset high-precision timer and accumulated time
-            QueryPerformanceCounter(&g_midiPlayer.lastPerfCounter);
-
-            // Calculate accumulated time based on target MIDI tick
-            double ticksPerMicrosecond = (double)g_midiPlayer.ticksPerQuarterNote / g_midiPlayer.tempo;
-            g_midiPlayer.accumulatedTime = targetMidiTick / ticksPerMicrosecond;
-
-            // Recalculate timing based on actual MIDI tick value
-            auto now = std::chrono::steady_clock::now();
-            if (wasPlaying) {
-                // If playing, adjust playStartTime to maintain playing state
-                g_midiPlayer.playStartTime = now - std::chrono::microseconds((int)(targetMidiTick * microsPerTick));
-                g_midiPlayer.pausedDuration = std::chrono::milliseconds(0);
-            } else if (g_midiPlayer.isPaused) {
-                // If paused, update pauseTime to new position
-                g_midiPlayer.playStartTime = now - std::chrono::microseconds((int)(targetMidiTick * microsPerTick));
-                g_midiPlayer.pauseTime = now;
-                g_midiPlayer.pausedDuration = std::chrono::milliseconds(0);
-            }
-
-            // Rebuild active notes state if we're at a position where notes should be playing
-            if (targetEventIndex > 0) {
-                RebuildActiveNotesAfterSeek(targetEventIndex);
-            }
-
+            SeekMIDI(clickPos * totalTimeMicros);
             log_command("Seek to progress: %.1f%% (time: %s)", clickPos * 100.0f, currentTimeStr.c_str());
         }
     } else {
         ImGui::ProgressBar(0.0f, ImVec2(-1, 20), "");
     }
 
+    // Ahead-of-time compiled register stream
+    float streamButtonWidth = (ImGui::GetContentRegionAvail().x - 10.0f) / 3.0f;
+    bool canCompile = !view.fileName.empty() && !view.isPlaying && !view.loading && !view.windowed &&
+                      !view.streamActive;
+    if (!canCompile) ImGui::BeginDisabled();
+    if (ImGui::Button("Compile", ImVec2(streamButtonWidth, 0))) {
+        CompileMIDIToRegisterStream(GetRegisterStreamPath(view.fileName).c_str());
+    }
+    if (!canCompile) ImGui::EndDisabled();
+    if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled)) {
+        ImGui::SetTooltip("Compile the loaded MIDI with the current config into a\n"
+                         ".ym2163s register stream next to the MIDI file");
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Play Compiled", ImVec2(streamButtonWidth, 0))) {
+        if (!view.fileName.empty()) {
+            PlayRegisterStream(GetRegisterStreamPath(view.fileName).c_str());
+        }
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Stop Stream", ImVec2(streamButtonWidth, 0))) {
+        StopRegisterStream();
+    }
+    if (view.streamActive) {
+        float streamProgress = view.streamCount > 0 ?
+            (float)view.streamIndex / (float)view.streamCount : 0.0f;
+        std::string elapsedStr = FormatTime((double)view.streamUs);
+        std::string totalStr = FormatTime((double)view.streamDurationUs);
+        char overlay[64];
+        snprintf(overlay, sizeof(overlay), "Stream %s / %s", elapsedStr.c_str(), totalStr.c_str());
+        ImGui::ProgressBar(streamProgress, ImVec2(-1, 0), overlay);
+    }
+
     ImGui::Spacing();
     ImGui::Separator();
     ImGui::Text("File Browser");
@@ -2854,18 +5712,7 @@ void RenderMIDIPlayer() {
                     g_lastExitedFolder.clear();
                     NavigateToPath(entry.fullPath.c_str());
                 } else {
-                    g_currentPlayingIndex = i;
-                    g_currentPlayingFilePath = entry.fullPath;
-                    ResetAllYM2163Chips();
-                    InitializeAllChannels();
-                    stop_all_notes();
-                    g_midiPlayer.activeNotes.clear();
-                    ResetPianoKeyStates();
-                    if (LoadMIDIFile(entry.fullPath.c_str())) {
-                        g_midiPlayer.currentTick = 0;
-                        g_midiPlayer.pausedDuration = std::chrono::milliseconds(0);
-                        PlayMIDI();
-                    }
+                    PlayMIDIFileAt(i);
                 }
             }
 
@@ -2957,25 +5804,8 @@ void RenderMIDIPlayer() {
                     g_lastExitedFolder.clear();
                     NavigateToPath(entry.fullPath.c_str());
                 } else {
-                    // Load MIDI file and start playing immediately
-                    g_currentPlayingIndex = i;  // Update current playing index
-                    g_currentPlayingFilePath = entry.fullPath;  // Store full path of playing file
-
-                    // Reset YM2163 chips to eliminate residual sound
-                    ResetAllYM2163Chips();
-
-                    // Initialize all channels
-                    InitializeAllChannels();
-                    stop_all_notes();
-                    g_midiPlayer.activeNotes.clear();
-                    ResetPianoKeyStates();
-
-                    if (LoadMIDIFile(entry.fullPath.c_str())) {
-                        // Reset progress bar
-                        g_midiPlayer.currentTick = 0;
-                        g_midiPlayer.pausedDuration = std::chrono::milliseconds(0);
-                        PlayMIDI();  // Auto-play on single-click
-                    }
+                    // Load MIDI file and start playing immediately (auto-play on single-click)
+                    PlayMIDIFileAt(i);
                 }
             }
             isHovered = ImGui::IsItemHovered();
@@ -2995,6 +5825,7 @@ void RenderMIDIPlayer() {
 }
 
 void RenderPianoKeyboard() {
+    const EngineView& view = g_engineView;
     ImGui::BeginChild("Piano", ImVec2(0, 150), true, ImGuiWindowFlags_HorizontalScrollbar);
 
     ImDrawList* draw_list = ImGui::GetWindowDrawList();
@@ -3020,10 +5851,10 @@ void RenderPianoKeyboard() {
         float y = p.y;
 
         ImU32 color;
-        if (g_pianoKeyPressed[keyIdx]) {
-            if (g_pianoKeyFromKeyboard[keyIdx]) {
+        if (view.keyPressed[keyIdx]) {
+            if (view.keyFromKeyboard[keyIdx]) {
                 // Green for keyboard input
-                int velocity = g_pianoKeyVelocity[keyIdx];
+                int velocity = view.keyVelocity[keyIdx];
                 float intensity = velocity / 127.0f;  // 0.0 to 1.0
                 int r = (int)(50 + 155 * intensity);   // 50 to 205
                 int g = 255;  // Full green
@@ -3031,7 +5862,7 @@ void RenderPianoKeyboard() {
                 color = IM_COL32(r, g, b, 255);
             } else {
                 // Blue for MIDI playback
-                int velocity = g_pianoKeyVelocity[keyIdx];
+                int velocity = view.keyVelocity[keyIdx];
                 float intensity = velocity / 127.0f;  // 0.0 to 1.0
                 int r = (int)(50 + 150 * intensity);  // 50 to 200
                 int g = (int)(100 + 155 * intensity); // 100 to 255
@@ -3065,10 +5896,10 @@ void RenderPianoKeyboard() {
             float y = p.y;
 
             ImU32 color;
-            if (g_pianoKeyPressed[keyIdx]) {
-                if (g_pianoKeyFromKeyboard[keyIdx]) {
+            if (view.keyPressed[keyIdx]) {
+                if (view.keyFromKeyboard[keyIdx]) {
                     // Green for keyboard input
-                    int velocity = g_pianoKeyVelocity[keyIdx];
+                    int velocity = view.keyVelocity[keyIdx];
                     float intensity = velocity / 127.0f;  // 0.0 to 1.0
                     int r = (int)(50 + 155 * intensity);   // 50 to 205
                     int g = 255;  // Full green
@@ -3076,7 +5907,7 @@ void RenderPianoKeyboard() {
                     color = IM_COL32(r, g, b, 255);
                 } else {
                     // Blue for MIDI playback
-                    int velocity = g_pianoKeyVelocity[keyIdx];
+                    int velocity = view.keyVelocity[keyIdx];
                     float intensity = velocity / 127.0f;  // 0.0 to 1.0
                     int r = (int)(50 + 150 * intensity);  // 50 to 200
                     int g = (int)(100 + 155 * intensity); // 100 to 255
@@ -3126,10 +5957,10 @@ void RenderPianoKeyboard() {
             float y = p.y;
 
             ImU32 color;
-            if (g_pianoKeyPressed[keyIdx]) {
-                if (g_pianoKeyFromKeyboard[keyIdx]) {
+            if (view.keyPressed[keyIdx]) {
+                if (view.keyFromKeyboard[keyIdx]) {
                     // Green for keyboard input
-                    int velocity = g_pianoKeyVelocity[keyIdx];
+                    int velocity = view.keyVelocity[keyIdx];
                     float intensity = velocity / 127.0f;  // 0.0 to 1.0
                     int r = (int)(40 + 140 * intensity);   // 40 to 180
                     int g = 255;  // Full green
@@ -3137,7 +5968,7 @@ void RenderPianoKeyboard() {
                     color = IM_COL32(r, g, b, 255);
                 } else {
                     // Blue for MIDI playback
-                    int velocity = g_pianoKeyVelocity[keyIdx];
+                    int velocity = view.keyVelocity[keyIdx];
                     float intensity = velocity / 127.0f;  // 0.0 to 1.0
                     int r = (int)(40 + 140 * intensity);  // 40 to 180
                     int g = (int)(80 + 175 * intensity);  // 80 to 255
@@ -3157,7 +5988,7 @@ void RenderPianoKeyboard() {
     }
 
     // Display SUS indicator when sustain pedal is active
-    if (g_sustainPedalActive && g_enableSustainPedal) {
+    if (view.sustainPedalActive && g_enableSustainPedal) {
         ImVec2 susPos = ImVec2(p.x + centerOffset + 10, p.y + whiteKeyHeight + 10);
         draw_list->AddText(susPos, IM_COL32(255, 200, 0, 255), "SUS");
     }
@@ -3167,6 +5998,7 @@ void RenderPianoKeyboard() {
 
 // v10: Render level meters below piano keyboard
 void RenderLevelMeters() {
+    const EngineView& view = g_engineView;
     ImGui::BeginChild("LevelMeters", ImVec2(0, 0), true);
 
     ImDrawList* draw_list = ImGui::GetWindowDrawList();
@@ -3278,7 +6110,7 @@ void RenderLevelMeters() {
             );
 
             // Get level value and convert to dB scale
-            float level = g_channels[channelIndex].currentLevel;
+            float level = view.channels[channelIndex].currentLevel;
             float displayLevel = levelToDBScale(level);
 
             // Draw level bar with gradient
@@ -3336,10 +6168,10 @@ void RenderLevelMeters() {
 
             // Get level value - check if this specific drum is active
             float level = 0.0f;
-            if (g_drumActive[chip][drum]) {
+            if (view.drumActive[chip][drum]) {
                 auto now = std::chrono::steady_clock::now();
                 auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    now - g_drumTriggerTime[chip][drum]);
+                    now - view.drumTriggerTime[chip][drum]);
                 float t = elapsed.count() / 1000.0f;
                 level = expf(-t * 20.0f);  // Fast decay
             }
@@ -3378,6 +6210,7 @@ void RenderLevelMeters() {
 
 
 void RenderChannelStatus() {
+    const EngineView& view = g_engineView;
     ImVec4 slot0Color = ImVec4(0.0f, 1.0f, 0.5f, 1.0f);  // Cyan-green for Slot0
     ImVec4 slot1Color = ImVec4(0.5f, 0.5f, 1.0f, 1.0f);  // Light blue for Slot1
     ImVec4 slot2Color = ImVec4(1.0f, 0.5f, 0.5f, 1.0f);  // Light red for Slot2
@@ -3412,21 +6245,21 @@ void RenderChannelStatus() {
         int baseChannel = chipIndex * 4;
         for (int i = 0; i < 4; i++) {
             int ch = baseChannel + i;
-            if (g_channels[ch].active) {
+            if (view.channels[ch].active) {
                 ImGui::TextColored(activeColor, "CH%d: %s%d", i,
-                    g_noteNames[g_channels[ch].note],
-                    g_channels[ch].octave + 2);
+                    g_noteNames[view.channels[ch].note],
+                    view.channels[ch].octave + 2);
                 ImGui::SameLine();
                 ImGui::TextColored(ImVec4(0.6f, 0.6f, 0.6f, 1.0f),
                     "[%s/%s/%s]",
-                    g_timbreNames[g_channels[ch].timbre],
-                    g_envelopeNames[g_channels[ch].envelope],
-                    g_volumeNames[g_channels[ch].volume]);
+                    g_timbreNames[view.channels[ch].timbre],
+                    g_envelopeNames[view.channels[ch].envelope],
+                    g_volumeNames[view.channels[ch].volume]);
             } else {
                 auto timeSinceRelease = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    now - g_channels[ch].releaseTime).count();
+                    now - view.channels[ch].releaseTime).count();
 
-                if (g_channels[ch].hasBeenUsed && timeSinceRelease < RELEASE_DISPLAY_TIME_MS) {
+                if (view.channels[ch].hasBeenUsed && timeSinceRelease < RELEASE_DISPLAY_TIME_MS) {
                     ImGui::TextColored(releaseColor, "CH%d: Release", i);
                 } else {
                     ImGui::TextDisabled("CH%d: ---", i);
@@ -3439,7 +6272,7 @@ void RenderChannelStatus() {
         ImGui::Text("Drums:");
         ImGui::SameLine();
         for (int i = 0; i < 5; i++) {
-            if (g_drumActive[chipIndex][i]) {
+            if (view.drumActive[chipIndex][i]) {
                 ImGui::TextColored(drumActiveColor, "%s", g_drumNames[i]);
             } else {
                 ImGui::TextDisabled("%s", g_drumNames[i]);
@@ -3460,7 +6293,37 @@ void RenderChannelStatus() {
     renderChipBox(3, "Slot3Channels", slot3Color, g_enableFourthYM2163);
 }
 
+// Re-initialize the chips after a slot was enabled or disabled. The engine lock
+// is taken around the state changes only, not the chip resets and settle delays.
+static void ReconfigureChips(int chip, bool enabled) {
+    if (!g_transport) return;
+    {
+        // Stop all notes and clear state before chip configuration change
+        std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+        stop_all_notes();
+        g_noteTable.clear();
+        ResetPianoKeyStates();
+    }
+
+    // Reset and re-initialize all chips with new configuration
+    ResetAllYM2163Chips();
+    Sleep(100);  // Wait for chips to settle after reset
+    ym2163_init();  // Re-initialize with new settings
+
+    std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+    InitializeAllChannels();
+    if (!enabled) {
+        // Stop any notes playing on the disabled chip
+        for (int i = chip * 4; i < chip * 4 + 4; i++) {
+            if (g_channels[i].active) {
+                stop_note(i);
+            }
+        }
+    }
+}
+
 void RenderControls() {
+    const EngineView& view = g_engineView;
     ImGui::BeginChild("Controls", ImVec2(280, 0), true);
 
     ImGui::Text("Controls");
@@ -3475,11 +6338,13 @@ void RenderControls() {
         ImGui::Text("(C%d-B%d)", g_currentOctave + 2, g_currentOctave + 2);
     }
     if (ImGui::Button("Oct +") && g_currentOctave < 5) {
+        std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
         stop_all_notes();
         g_currentOctave++;
     }
     ImGui::SameLine();
     if (ImGui::Button("Oct -") && g_currentOctave > 0) {
+        std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
         stop_all_notes();
         g_currentOctave--;
     }
@@ -3487,9 +6352,15 @@ void RenderControls() {
     ImGui::Spacing();
 
     ImGui::Text("Volume: %-15s", g_volumeNames[g_currentVolume]);
-    if (ImGui::Button("Vol +") && g_currentVolume > 0) g_currentVolume--;
+    if (ImGui::Button("Vol +") && g_currentVolume > 0) {
+        std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+        g_currentVolume--;
+    }
     ImGui::SameLine();
-    if (ImGui::Button("Vol -") && g_currentVolume < 3) g_currentVolume++;
+    if (ImGui::Button("Vol -") && g_currentVolume < 3) {
+        std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+        g_currentVolume++;
+    }
 
     ImGui::Spacing();
     ImGui::Separator();
@@ -3497,6 +6368,7 @@ void RenderControls() {
     // MIDI Control Mode
     ImGui::Text("MIDI Control Mode");
     if (ImGui::RadioButton("Live Control", g_useLiveControl)) {
+        std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
         g_useLiveControl = true;
     }
     if (ImGui::IsItemHovered()) {
@@ -3504,6 +6376,7 @@ void RenderControls() {
     }
 
     if (ImGui::RadioButton("Config Mode", !g_useLiveControl)) {
+        std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
         g_useLiveControl = false;
         // When switching to Config Mode, load current instrument config to UI
         LoadInstrumentConfigToUI(g_selectedInstrument);
@@ -3515,7 +6388,7 @@ void RenderControls() {
     ImGui::Spacing();
 
     // Velocity mapping option
-    ImGui::Checkbox("Velocity Mapping", &g_enableVelocityMapping);
+    EngineCheckbox("Velocity Mapping", &g_enableVelocityMapping);
     if (ImGui::IsItemHovered()) {
         ImGui::SetTooltip("Map MIDI velocity to 4-level volume\n"
                          "(Enable for dynamic volume control)");
@@ -3524,9 +6397,10 @@ void RenderControls() {
     // Dynamic velocity mapping option (sub-option, indented)
     if (g_enableVelocityMapping) {
         ImGui::Indent(20.0f);
-        if (ImGui::Checkbox("Dynamic Mapping", &g_enableDynamicVelocityMapping)) {
+        if (EngineCheckbox("Dynamic Mapping", &g_enableDynamicVelocityMapping)) {
             // Re-analyze current MIDI file if loaded
-            if (g_enableDynamicVelocityMapping && g_midiPlayer.midiFile.status()) {
+            std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+            if (g_enableDynamicVelocityMapping && !g_midiPlayer.currentFileName.empty()) {
                 AnalyzeVelocityDistribution();
             }
         }
@@ -3542,10 +6416,10 @@ void RenderControls() {
                                  "  -6dB: %d-%d\n"
                                  "  -12dB: %d-%d\n"
                                  "  Mute: < %d",
-                                 g_velocityAnalysis.threshold_0dB,
-                                 g_velocityAnalysis.threshold_6dB, g_velocityAnalysis.threshold_0dB - 1,
-                                 g_velocityAnalysis.threshold_12dB, g_velocityAnalysis.threshold_6dB - 1,
-                                 g_velocityAnalysis.threshold_mute);
+                                 view.velocity.threshold_0dB,
+                                 view.velocity.threshold_6dB, view.velocity.threshold_0dB - 1,
+                                 view.velocity.threshold_12dB, view.velocity.threshold_6dB - 1,
+                                 view.velocity.threshold_mute);
             } else {
                 ImGui::SetTooltip("Fixed velocity mapping:\n"
                                  "  0dB: 113-127\n"
@@ -3558,7 +6432,7 @@ void RenderControls() {
     }
 
     // Sustain pedal mapping option
-    ImGui::Checkbox("Sustain Pedal", &g_enableSustainPedal);
+    EngineCheckbox("Sustain Pedal", &g_enableSustainPedal);
     if (ImGui::IsItemHovered()) {
         ImGui::SetTooltip("Map sustain pedal (CC64) to envelope:\n"
                          "Pedal Down: Fast, Pedal Up: Decay");
@@ -3586,33 +6460,82 @@ void RenderControls() {
                          "Jumps to the first note to avoid waiting");
     }
 
+    // Streaming load
+    ImGui::Checkbox("Streaming Load", &g_streamingLoad);
+    if (ImGui::IsItemHovered()) {
+        ImGui::SetTooltip("Start playing once the first seconds of a MIDI file are decoded\n"
+                         "and decode the rest in the background (voice plan when done)\n"
+                         "Off: read the whole file before playing");
+    }
+
+    // Bounded memory playback
+    ImGui::Checkbox("Bounded Memory Playback", &g_boundedMemory);
+    if (ImGui::IsItemHovered()) {
+        ImGui::SetTooltip("Stream files whose events would exceed the memory limit through\n"
+                         "a fixed window, dropping played events and inaudible notes\n"
+                         "(seeking decodes again from the start; no voice plan or compile)\n"
+                         "Applies to the next file loaded");
+    }
+    if (g_boundedMemory) {
+        ImGui::SetNextItemWidth(150);
+        ImGui::SliderInt("Memory Limit (MB)", &g_memoryLimitMB, 32, 2048);
+    }
+
+    // Look-ahead voice stealing
+    if (EngineCheckbox("Look-Ahead Voice Stealing", &g_lookAheadSteal)) {
+        std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+        voice_alloc_rebuild();  // Steal heap order depends on the mode
+        log_command("Look-ahead voice stealing: %s", g_lookAheadSteal ? "ON" : "OFF");
+    }
+    if (ImGui::IsItemHovered()) {
+        ImGui::SetTooltip("When all voices are busy, replace the note that ends soonest\n"
+                         "(note-off times are known from the MIDI file)\n"
+                         "Off: replace the lowest note that has played long enough");
+    }
+
+    // Load-time voice assignment
+    EngineCheckbox("Planned Voice Assignment", &g_useVoicePlan);
+    if (ImGui::IsItemHovered()) {
+        ImGui::SetTooltip("Use the voice assignment computed when the MIDI file was loaded\n"
+                         "(whole-song simulation with look-ahead voice stealing)\n"
+                         "Off, or with look-ahead stealing off: allocate voices while playing");
+    }
+    if (view.windowed) {
+        ImGui::TextDisabled("No voice plan in bounded memory playback (window of %d events)",
+                            view.windowEvents);
+    } else if (!view.fileName.empty()) {
+        const VoicePlanReport& r = view.voicePlan;
+        int chips = get_chip_count();
+        ImGui::TextDisabled("Peak polyphony %d, needs %s chip(s); now %d steals, %.1f s cut, %d writes saved",
+                            r.peakPolyphony, r.chipsNeeded > 0 ? std::to_string(r.chipsNeeded).c_str() : ">4",
+                            r.steals[chips - 1], r.truncatedSeconds[chips - 1], r.writesSaved[chips - 1]);
+    }
+
+    // Arpeggio multiplexing
+    if (EngineCheckbox("Arpeggio Multiplexing", &g_arp.enabled)) {
+        std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+        ArpeggioReset();
+        log_command("Arpeggio multiplexing: %s", g_arp.enabled ? "ON" : "OFF");
+    }
+    if (ImGui::IsItemHovered()) {
+        ImGui::SetTooltip("When all voices are busy, extra notes share a voice and\n"
+                         "are cycled at the arpeggio rate instead of cutting notes\n"
+                         "(up to 4 notes per voice; voices are assigned while playing)");
+    }
+    if (g_arp.enabled) {
+        ImGui::SetNextItemWidth(150);
+        EngineSliderFloat("Arp Rate (Hz)", &g_arp.rateHz, 20.0f, 120.0f, "%.0f");
+        ImGui::SetNextItemWidth(150);
+        EngineSliderInt("Arp Write Budget (/s)", &g_arp.writeBudget, 200, 8000);
+    }
+
     // v10: YM2163 chip controls
     ImGui::Separator();
     ImGui::Text("YM2163 Chips");
 
     // Second YM2163 (Slot1)
-    if (ImGui::Checkbox("Enable Slot1 (2nd YM2163)", &g_enableSecondYM2163)) {
-        if (g_ftHandle) {
-            // Stop all notes and clear state before chip configuration change
-            stop_all_notes();
-            g_midiPlayer.activeNotes.clear();
-            ResetPianoKeyStates();
-
-            // Reset and re-initialize all chips with new configuration
-            ResetAllYM2163Chips();
-            Sleep(100);  // Wait for chips to settle after reset
-            ym2163_init();  // Re-initialize with new settings
-            InitializeAllChannels();
-
-            if (!g_enableSecondYM2163) {
-                // Stop any notes playing on chip 1
-                for (int i = 4; i < 8; i++) {
-                    if (g_channels[i].active) {
-                        stop_note(i);
-                    }
-                }
-            }
-        }
+    if (EngineCheckbox("Enable Slot1 (2nd YM2163)", &g_enableSecondYM2163)) {
+        ReconfigureChips(1, g_enableSecondYM2163);
     }
     if (ImGui::IsItemHovered()) {
         ImGui::SetTooltip("Enable second YM2163 chip on SPFM Slot1\n"
@@ -3620,28 +6543,8 @@ void RenderControls() {
     }
 
     // Third YM2163 (Slot2)
-    if (ImGui::Checkbox("Enable Slot2 (3rd YM2163)", &g_enableThirdYM2163)) {
-        if (g_ftHandle) {
-            // Stop all notes and clear state before chip configuration change
-            stop_all_notes();
-            g_midiPlayer.activeNotes.clear();
-            ResetPianoKeyStates();
-
-            // Reset and re-initialize all chips with new configuration
-            ResetAllYM2163Chips();
-            Sleep(100);  // Wait for chips to settle after reset
-            ym2163_init();  // Re-initialize with new settings
-            InitializeAllChannels();
-
-            if (!g_enableThirdYM2163) {
-                // Stop any notes playing on chip 2
-                for (int i = 8; i < 12; i++) {
-                    if (g_channels[i].active) {
-                        stop_note(i);
-                    }
-                }
-            }
-        }
+    if (EngineCheckbox("Enable Slot2 (3rd YM2163)", &g_enableThirdYM2163)) {
+        ReconfigureChips(2, g_enableThirdYM2163);
     }
     if (ImGui::IsItemHovered()) {
         ImGui::SetTooltip("Enable third YM2163 chip on SPFM Slot2\n"
@@ -3649,28 +6552,8 @@ void RenderControls() {
     }
 
     // Fourth YM2163 (Slot3)
-    if (ImGui::Checkbox("Enable Slot3 (4th YM2163)", &g_enableFourthYM2163)) {
-        if (g_ftHandle) {
-            // Stop all notes and clear state before chip configuration change
-            stop_all_notes();
-            g_midiPlayer.activeNotes.clear();
-            ResetPianoKeyStates();
-
-            // Reset and re-initialize all chips with new configuration
-            ResetAllYM2163Chips();
-            Sleep(100);  // Wait for chips to settle after reset
-            ym2163_init();  // Re-initialize with new settings
-            InitializeAllChannels();
-
-            if (!g_enableFourthYM2163) {
-                // Stop any notes playing on chip 3
-                for (int i = 12; i < 16; i++) {
-                    if (g_channels[i].active) {
-                        stop_note(i);
-                    }
-                }
-            }
-        }
+    if (EngineCheckbox("Enable Slot3 (4th YM2163)", &g_enableFourthYM2163)) {
+        ReconfigureChips(3, g_enableFourthYM2163);
     }
     if (ImGui::IsItemHovered()) {
         ImGui::SetTooltip("Enable fourth YM2163 chip on SPFM Slot3\n"
@@ -3760,6 +6643,7 @@ void RenderControls() {
     ImGui::Text("Envelope");
     for (int i = 0; i < 4; i++) {
         if (ImGui::RadioButton(g_envelopeNames[i], g_currentEnvelope == i)) {
+            std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
             g_currentEnvelope = i;
         }
         if (i % 2 == 0 && i < 3) ImGui::SameLine();
@@ -3771,9 +6655,11 @@ void RenderControls() {
     ImGui::Text("Pedal Mode");
 
     if (ImGui::RadioButton("Disabled##PedalMode", g_pedalMode == 0)) {
+        std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
         g_pedalMode = 0;
     }
     if (ImGui::RadioButton("Piano Pedal##PedalMode", g_pedalMode == 1)) {
+        std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
         g_pedalMode = 1;
     }
     if (ImGui::IsItemHovered()) {
@@ -3781,6 +6667,7 @@ void RenderControls() {
                          "Pedal Up: Decay envelope");
     }
     if (ImGui::RadioButton("Organ Pedal##PedalMode", g_pedalMode == 2)) {
+        std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
         g_pedalMode = 2;
     }
     if (ImGui::IsItemHovered()) {
@@ -3794,6 +6681,7 @@ void RenderControls() {
     ImGui::Text("Timbre");
     for (int i = 1; i <= 5; i++) {
         if (ImGui::RadioButton(g_timbreNames[i], g_currentTimbre == i)) {
+            std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
             g_currentTimbre = i;
         }
         if (i % 2 == 1 && i < 5) ImGui::SameLine();
@@ -3806,6 +6694,7 @@ void RenderControls() {
     for (int i = 0; i < 5; i++) {
         ImGui::PushID(i);
         if (ImGui::Button(g_drumNames[i], ImVec2(45, 40))) {
+            std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
             play_drum(g_drumBits[i]);
         }
         if (i < 4) ImGui::SameLine();
@@ -3818,6 +6707,117 @@ void RenderControls() {
     ImGui::EndChild();
 }
 
+void StopVgmLog() {
+    std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+    if (!g_vgmLogger.active()) return;
+    uint64_t writes = g_vgmLogger.writes();
+    uint64_t dropped = g_vgmLogger.dropped();
+    g_vgmLogger.stop();
+    log_command("VGM log saved: %s (%llu writes, %llu dropped, %.1f KB)",
+                g_vgmLogger.path().c_str(), (unsigned long long)writes,
+                (unsigned long long)dropped, (double)g_vgmLogger.bytesOnDisk() / 1024.0);
+}
+
+// SPFM bus traffic counters (collapsible, default collapsed)
+void RenderBusStatistics() {
+    if (!ImGui::CollapsingHeader("Bus Statistics")) return;
+    const EngineView& view = g_engineView;
+
+    ImGui::SameLine();
+    if (ImGui::Button("Reset##BusStats")) {
+        std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+        spfm_reset_stats();
+        reset_register_shadow_stats();
+        sequencer_reset_stats();
+        g_voiceAlloc.steals = 0;
+        g_voiceAlloc.writesSaved = 0;
+        g_arp.notesShared = g_arp.steps = g_arp.writes = g_arp.skipped = 0;
+    }
+
+    if (g_transport) {
+        ImGui::Text("Transport: %s (%s)  Write errors: %llu", g_transport->kind(),
+                    g_transport->spec().c_str(), (unsigned long long)g_transport->writeErrors());
+    } else {
+        ImGui::Text("Transport: not open (%s)", g_transportSpec);
+    }
+
+    double avgPackets = g_spfmQueue.totalFlushes > 0 ?
+        (double)g_spfmQueue.totalPackets / (double)g_spfmQueue.totalFlushes : 0.0;
+    ImGui::Text("Packets: %llu  Bytes: %llu",
+                (unsigned long long)g_spfmQueue.totalPackets,
+                (unsigned long long)g_spfmQueue.totalBytes);
+    ImGui::Text("Transport writes: %llu  (avg %.1f, last %d, max %d packets/write)",
+                (unsigned long long)g_spfmQueue.totalFlushes, avgPackets,
+                g_spfmQueue.lastFlushPackets.load(), g_spfmQueue.maxFlushPackets.load());
+    ImGui::Text("Ring: %u / %d  (high-water %u)  Overflows: %llu (%.1f ms waited)",
+                spfm_ring_occupancy(), SPFM_RING_CAPACITY, g_spfmQueue.ringHighWater.load(),
+                (unsigned long long)g_spfmQueue.overflowEvents,
+                (double)g_spfmQueue.overflowWaitUs / 1000.0);
+    ImGui::Text("Queue latency: avg %.0f us  max %llu us",
+                g_spfmQueue.totalPackets > 0 ?
+                    (double)g_spfmQueue.latencySumUs / (double)g_spfmQueue.totalPackets : 0.0,
+                (unsigned long long)g_spfmQueue.latencyMaxUs);
+    uint64_t deadlines = g_sequencer.deadlines;
+    ImGui::Text("Sequencer lateness: avg %.0f us  max %llu us  (%llu events, %s timer)",
+                deadlines > 0 ? (double)g_sequencer.lateSumUs / (double)deadlines : 0.0,
+                (unsigned long long)g_sequencer.lateMaxUs, (unsigned long long)deadlines,
+                g_sequencer.highResTimer ? "high-res" : "1 ms");
+
+    uint64_t requested = 0;
+    uint64_t elided = 0;
+    for (int chip = 0; chip < 4; chip++) {
+        requested += view.writesRequested[chip];
+        elided += view.writesElided[chip];
+    }
+    ImGui::Text("Register writes: %llu  Elided: %llu (%.1f%%)",
+                (unsigned long long)requested, (unsigned long long)elided,
+                requested > 0 ? 100.0 * (double)elided / (double)requested : 0.0);
+    for (int chip = 0; chip < 4; chip++) {
+        if (view.writesRequested[chip] == 0) continue;
+        ImGui::Text("  Slot%d: %llu / %llu elided", chip,
+                    (unsigned long long)view.writesElided[chip],
+                    (unsigned long long)view.writesRequested[chip]);
+    }
+    ImGui::Text("Voice steals: %llu  Timbre/volume writes saved by affinity: %llu (this song)",
+                (unsigned long long)view.voiceSteals, (unsigned long long)view.voiceWritesSaved);
+    if (g_arp.enabled) {
+        ImGui::Text("Arpeggio: %d shared voices, %llu notes shared, %llu steps, %llu writes, %llu deferred by budget",
+                    view.arpSharedVoices, (unsigned long long)view.arpNotesShared, (unsigned long long)view.arpSteps,
+                    (unsigned long long)view.arpWrites, (unsigned long long)view.arpSkipped);
+    }
+
+    // VGM register log
+    ImGui::Separator();
+    if (!g_vgmLogger.active()) {
+        ImGui::SetNextItemWidth(300);
+        ImGui::InputText("##VgmLogPath", g_vgmLogPath, sizeof(g_vgmLogPath));
+        ImGui::SameLine();
+        if (ImGui::Button("Start VGM Log")) {
+            std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+            if (g_vgmLogger.start(g_vgmLogPath, spfm_now_us())) {
+                log_command("VGM log started: %s", g_vgmLogPath);
+            } else {
+                log_command("ERROR: Cannot create VGM log %s", g_vgmLogPath);
+            }
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Record every register write (all slots, melody and drums)\n"
+                             "with 44100 Hz timestamps to a VGM-style file");
+        }
+    } else {
+        if (ImGui::Button("Stop VGM Log")) {
+            StopVgmLog();
+        }
+        ImGui::SameLine();
+        ImGui::Text("Recording %s", g_vgmLogger.path().c_str());
+        ImGui::Text("Logged writes: %llu  Dropped: %llu  %.1f s  %.1f KB",
+                    (unsigned long long)view.vgmWrites,
+                    (unsigned long long)view.vgmDropped,
+                    (double)view.vgmSamples / VGM_SAMPLE_RATE,
+                    (double)g_vgmLogger.bytesOnDisk() / 1024.0);
+    }
+}
+
 void RenderLog() {
     // v10: Log area is collapsible, default collapsed
     static bool g_logExpanded = false;  // Default collapsed
@@ -3829,6 +6829,7 @@ void RenderLog() {
         ImGui::SameLine();
         ImGui::Checkbox("Auto-scroll", &g_autoScroll);
         ImGui::SameLine();
+        std::unique_lock<std::mutex> logLock(g_logMutex);
         if (ImGui::Button("Clear##Log")) {
             g_logBuffer.clear();
             g_logDisplayBuffer[0] = '\0';
@@ -3842,6 +6843,7 @@ void RenderLog() {
 
         bool log_changed = (g_logBuffer.length() != g_lastLogSize);
         g_lastLogSize = g_logBuffer.length();
+        logLock.unlock();
 
         if (g_autoScroll && log_changed) {
             g_logScrollToBottom = true;
@@ -3872,6 +6874,9 @@ void RenderLog() {
         g_logExpanded = false;
     }
 
+    // ===== Bus Statistics Section (Collapsible) =====
+    RenderBusStatistics();
+
     ImGui::Spacing();
 
     // ===== MIDI Folder History Section =====
@@ -3927,6 +6932,27 @@ void RenderLog() {
 
 // ===== Tuning Window =====
 
+// FNUM input (0-2047, mouse wheel +/-10); the edited value is stored under the
+// engine lock since note-ons read the tables
+static bool InputFnum(int* fnum) {
+    int edited = *fnum;
+    bool changed = ImGui::InputInt("", &edited, 1, 10, ImGuiInputTextFlags_CharsDecimal);
+    if (ImGui::IsItemHovered()) {
+        float wheel = ImGui::GetIO().MouseWheel;
+        if (wheel != 0.0f) {
+            edited += (int)(wheel * 10);
+            changed = true;
+        }
+    }
+    if (!changed) return false;
+
+    if (edited < 0) edited = 0;
+    if (edited > 2047) edited = 2047;
+    std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+    *fnum = edited;
+    return true;
+}
+
 void RenderTuningWindow() {
     if (!g_showTuningWindow) return;
 
@@ -3940,6 +6966,7 @@ void RenderTuningWindow() {
         // Load and Save buttons
         float btnWidth = (ImGui::GetContentRegionAvail().x - 5.0f) / 2.0f;
         if (ImGui::Button("Load All Frequencies", ImVec2(btnWidth, 0))) {
+            std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
             LoadFrequenciesFromINI();
             log_command("All frequencies loaded from INI");
         }
@@ -3972,23 +6999,10 @@ void RenderTuningWindow() {
             ImGui::SetNextItemWidth(120);
 
             // InputInt with mouse wheel support
-            if (ImGui::InputInt("", &g_fnums[i], 1, 10, ImGuiInputTextFlags_CharsDecimal)) {
-                if (g_fnums[i] < 0) g_fnums[i] = 0;
-                if (g_fnums[i] > 2047) g_fnums[i] = 2047;
+            if (InputFnum(&g_fnums[i])) {
                 log_command("Base Freq updated: %s = %d", g_noteNames[i], g_fnums[i]);
             }
 
-            // Mouse wheel adjustment
-            if (ImGui::IsItemHovered()) {
-                float wheel = ImGui::GetIO().MouseWheel;
-                if (wheel != 0.0f) {
-                    g_fnums[i] += (int)(wheel * 10);
-                    if (g_fnums[i] < 0) g_fnums[i] = 0;
-                    if (g_fnums[i] > 2047) g_fnums[i] = 2047;
-                    log_command("Base Freq updated: %s = %d", g_noteNames[i], g_fnums[i]);
-                }
-            }
-
             if ((i + 1) % 6 != 0) ImGui::SameLine();
             ImGui::PopID();
         }
@@ -4006,21 +7020,9 @@ void RenderTuningWindow() {
         ImGui::SameLine();
         ImGui::SetNextItemWidth(120);
 
-        if (ImGui::InputInt("", &g_fnum_b2, 1, 10, ImGuiInputTextFlags_CharsDecimal)) {
-            if (g_fnum_b2 < 0) g_fnum_b2 = 0;
-            if (g_fnum_b2 > 2047) g_fnum_b2 = 2047;
+        if (InputFnum(&g_fnum_b2)) {
             log_command("B2 Freq updated: B2 = %d", g_fnum_b2);
         }
-
-        if (ImGui::IsItemHovered()) {
-            float wheel = ImGui::GetIO().MouseWheel;
-            if (wheel != 0.0f) {
-                g_fnum_b2 += (int)(wheel * 10);
-                if (g_fnum_b2 < 0) g_fnum_b2 = 0;
-                if (g_fnum_b2 > 2047) g_fnum_b2 = 2047;
-                log_command("B2 Freq updated: B2 = %d", g_fnum_b2);
-            }
-        }
         ImGui::PopID();
 
         ImGui::Spacing();
@@ -4037,22 +7039,10 @@ void RenderTuningWindow() {
             ImGui::SameLine();
             ImGui::SetNextItemWidth(120);
 
-            if (ImGui::InputInt("", &g_fnums_c7[i], 1, 10, ImGuiInputTextFlags_CharsDecimal)) {
-                if (g_fnums_c7[i] < 0) g_fnums_c7[i] = 0;
-                if (g_fnums_c7[i] > 2047) g_fnums_c7[i] = 2047;
+            if (InputFnum(&g_fnums_c7[i])) {
                 log_command("C7 Freq updated: %s7 = %d", g_noteNames[i], g_fnums_c7[i]);
             }
 
-            if (ImGui::IsItemHovered()) {
-                float wheel = ImGui::GetIO().MouseWheel;
-                if (wheel != 0.0f) {
-                    g_fnums_c7[i] += (int)(wheel * 10);
-                    if (g_fnums_c7[i] < 0) g_fnums_c7[i] = 0;
-                    if (g_fnums_c7[i] > 2047) g_fnums_c7[i] = 2047;
-                    log_command("C7 Freq updated: %s7 = %d", g_noteNames[i], g_fnums_c7[i]);
-                }
-            }
-
             if ((i + 1) % 6 != 0) ImGui::SameLine();
             ImGui::PopID();
         }
@@ -4165,9 +7155,10 @@ void HandleKeyPress(int vk) {
             }
 
             if (valid) {
-                int channel = find_free_channel();
+                int channel = find_free_channel(g_currentTimbre, g_currentEnvelope, g_currentVolume);
                 if (channel >= 0) {
                     play_note(channel, note, octave);
+                    g_noteTable.link(NOTE_TABLE_KEYBOARD, get_absolute_pitch(note, octave), channel);
 
                     int keyIdx = get_key_index(octave, note);
                     if (keyIdx >= 0 && keyIdx < 61) {
@@ -4235,27 +7226,6 @@ LRESULT WINAPI WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                 return 0;
             break;
 
-        case WM_ENTERSIZEMOVE:
-            // Window is being dragged or resized - start timer to keep MIDI playing
-            g_isWindowDragging = true;
-            SetTimer(hWnd, TIMER_MIDI_UPDATE, 16, NULL);  // ~60Hz update
-            return 0;
-
-        case WM_EXITSIZEMOVE:
-            // Window drag/resize finished - stop timer
-            g_isWindowDragging = false;
-            KillTimer(hWnd, TIMER_MIDI_UPDATE);
-            return 0;
-
-        case WM_TIMER:
-            if (wParam == TIMER_MIDI_UPDATE && g_isWindowDragging) {
-                // Continue MIDI playback during window drag
-                UpdateMIDIPlayback();
-                UpdateDrumStates();
-                CleanupStuckChannels();
-            }
-            return 0;
-
         case WM_HOTKEY:
             // Handle global media key presses
             if (g_enableGlobalMediaKeys) {
@@ -4281,23 +7251,35 @@ LRESULT WINAPI WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                         PlayPreviousMIDI();
                         break;
                 }
+                std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+                spfm_flush();
             }
             return 0;
 
-        case WM_KEYDOWN:
+        case WM_KEYDOWN: {
+            std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
             HandleKeyPress((int)wParam);
+            spfm_flush();
             return 0;
+        }
 
-        case WM_KEYUP:
+        case WM_KEYUP: {
+            std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
             HandleKeyRelease((int)wParam);
+            spfm_flush();
             return 0;
+        }
 
         case WM_DESTROY:
             SaveFrequenciesToINI();
             if (g_enableGlobalMediaKeys) {
                 UnregisterGlobalMediaKeys();
             }
-            if (g_ftHandle) FT_Close(g_ftHandle);
+            sequencer_stop();
+            StopStreamLoader();
+            StopVgmLog();
+            spfm_output_stop();
+            spfm_transport_shutdown();
             PostQuitMessage(0);
             return 0;
     }
@@ -4416,9 +7398,10 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     ImGui_ImplWin32_Init(hwnd);
     ImGui_ImplDX11_Init(g_pd3dDevice, g_pd3dDeviceContext);
 
-    // Initialize FTDI and YM2163
+    // Initialize output transport and YM2163
     LoadFrequenciesFromINI();
     LoadMIDIConfig();
+    LoadTransportSpec(lpCmdLine);
     InitializeFileBrowser();
 
     // Load config to UI if starting in Config Mode
@@ -4426,11 +7409,13 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
         LoadInstrumentConfigToUI(g_selectedInstrument);
     }
 
-    if (ftdi_init(0) == 0) {
+    if (spfm_transport_init(g_transportSpec) == 0) {
+        spfm_output_start();
         ym2163_init();
     } else {
-        log_command("ERROR: Failed to initialize FTDI device!");
+        log_command("ERROR: Failed to initialize output transport '%s'!", g_transportSpec);
     }
+    sequencer_start();
 
     // Register global media keys if enabled by default
     if (g_enableGlobalMediaKeys) {
@@ -4461,18 +7446,24 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
             pBackBuffer->Release();
         }
 
-        // Update MIDI playback
-        UpdateMIDIPlayback();
+        // Playback itself runs on the sequencer thread; the frame is built from
+        // a copy of the engine state (Engine View)
+        HandlePlaybackFinished();
+        {
+            std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
 
-        // Update drum states
-        UpdateDrumStates();
+            // Update drum states
+            UpdateDrumStates();
 
-        // Cleanup stuck channels
-        CleanupStuckChannels();
+            // Cleanup stuck channels
+            CleanupStuckChannels();
 
-        // v10: Update level meters
-        UpdateChannelLevels();
-        UpdateDrumLevels();
+            // v10: Update level meters
+            UpdateChannelLevels();
+            UpdateDrumLevels();
+
+            PublishEngineView();
+        }
 
         // Start ImGui frame
         ImGui_ImplDX11_NewFrame();
@@ -4542,6 +7533,12 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
         // Render tuning window if open
         RenderTuningWindow();
 
+        // Send register writes issued by UI callbacks (drum pads, chip toggles, ...)
+        {
+            std::lock_guard<std::recursive_mutex> lock(g_engineMutex);
+            spfm_flush();
+        }
+
         // Check if any input field is active (disable keyboard piano)
         g_isInputActive = ImGui::IsAnyItemActive();
 